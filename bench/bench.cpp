@@ -0,0 +1,315 @@
+/* Timing harness for the main libdwarfidl entry points.
+ *
+ * Usage: bench [--sizes n,n,...] [--min-seconds s] [elf-file...]
+ *
+ * The dwarfidl-text stages (parse, create_dies) run over synthetic inputs
+ * (see dwarfidl/synthetic.hpp) of each given size, counted in structs.
+ * The DIE stages (gather, close+order, print_dies, dwarf::tool::print) run
+ * over the same synthetic DIEs and then over each ELF file given, or over
+ * this executable if none is. Results go to stdout as one JSON object. */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <string>
+#include <vector>
+#include <set>
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include <functional>
+#include <memory>
+
+#include <srk31/indenting_ostream.hpp>
+#include <dwarfpp/lib.hpp>
+#include "dwarfidl/create.hpp"
+#include "dwarfidl/dwarfprint.hpp"
+#include "dwarfidl/print.hpp"
+#include "dwarfidl/cxx_model.hpp"
+#include "dwarfidl/dependency_ordering_cxx_target.hpp"
+#include "dwarfidl/dwarf_interface_walk.hpp"
+#include "dwarfidl/metrics.hpp"
+#include "dwarfidl/synthetic.hpp"
+
+using namespace std;
+using namespace dwarf;
+using namespace dwarf::core;
+using dwarf::tool::gather_interface_dies;
+using dwarf::tool::dependency_ordering_cxx_target;
+
+struct result
+{
+	string stage;
+	string input;
+	unsigned iterations;
+	double seconds;    // total over all iterations
+	uint64_t items;    // per iteration: DIEs, declarations or fragments
+	uint64_t bytes;    // per iteration: input consumed or output produced
+};
+static vector<result> results;
+static double min_seconds = 0.5;
+
+/* Run 'f' until at least min_seconds have passed (and at least once).
+ * 'setup' runs before each iteration, untimed. */
+static void time_stage(const string& stage, const string& input,
+	function<void()> setup, function<pair<uint64_t, uint64_t>()> f)
+{
+	result r = { stage, input, 0, 0.0, 0, 0 };
+	while (r.iterations == 0 || r.seconds < min_seconds)
+	{
+		if (setup) setup();
+		auto start = chrono::steady_clock::now();
+		auto counts = f();
+		r.seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		r.items = counts.first;
+		r.bytes = counts.second;
+		++r.iterations;
+	}
+	clog << stage << " on " << input << ": " << r.iterations << " iterations, "
+		<< (r.seconds / r.iterations) << "s each" << endl;
+	results.push_back(r);
+}
+
+struct parsed
+{
+	pANTLR3_INPUT_STREAM str;
+	pdwarfidlNewCLexer lexer;
+	pANTLR3_COMMON_TOKEN_STREAM tokens;
+	pdwarfidlNewCParser parser;
+	antlr::tree::Tree *tree;
+
+	explicit parsed(const string& text)
+	{
+		str = antlr3StringStreamNew(
+			const_cast<unsigned char *>(reinterpret_cast<const unsigned char *>(text.c_str())),
+			ANTLR3_ENC_8BIT, text.length(),
+			const_cast<unsigned char *>(reinterpret_cast<const unsigned char *>("bench")));
+		assert(str);
+		lexer = dwarfidlNewCLexerNew(str);
+		tokens = antlr3CommonTokenStreamSourceNew(ANTLR3_SIZE_HINT, TOKENSOURCE(lexer));
+		parser = dwarfidlNewCParserNew(tokens);
+		tree = parser->toplevel(parser).tree;
+		assert(tree);
+	}
+	~parsed()
+	{
+		parser->free(parser);
+		tokens->free(tokens);
+		lexer->free(lexer);
+		str->close(str);
+	}
+	parsed(const parsed&) = delete;
+	parsed& operator=(const parsed&) = delete;
+};
+
+static dwarfidl::synthetic_params synthetic_params_for(unsigned size)
+{
+	dwarfidl::synthetic_params params;
+	params.structs_per_cu = size;
+	return params;
+}
+
+static void bench_text(unsigned size)
+{
+	string text = dwarfidl::generate_synthetic_dwarfidl(synthetic_params_for(size), 0);
+	ostringstream input; input << "synthetic-" << size;
+
+	/* The tree stays valid only while its parser is alive. */
+	parsed p(text);
+	uint64_t ndecls = GET_CHILD_COUNT(p.tree);
+	time_stage("parse", input.str(), nullptr, [&text, ndecls]() {
+		parsed p(text);
+		return make_pair(ndecls, (uint64_t) text.length());
+	});
+
+	unique_ptr<in_memory_root_die> r;
+	iterator_base cu;
+	time_stage("create_dies", input.str(),
+		[&r, &cu]() {
+			r.reset(new in_memory_root_die);
+			cu = r->make_new(r->begin(), DW_TAG_compile_unit);
+		},
+		[&p, &cu, &text, ndecls]() {
+			dwarfidl::create_dies(cu, p.tree);
+			return make_pair(ndecls, (uint64_t) text.length());
+		});
+
+	/* Build-then-discard, so the time to free the root counts too. */
+	time_stage("create_dies+discard (arena)", input.str(), nullptr, [&p, &text, ndecls]() {
+		dwarfidl::create_dies(p.tree);
+		return make_pair(ndecls, (uint64_t) text.length());
+	});
+	time_stage("create_dies+discard (in_memory)", input.str(), nullptr, [&p, &text, ndecls]() {
+		in_memory_root_die r;
+		dwarfidl::create_dies(r.begin(), p.tree);
+		return make_pair(ndecls, (uint64_t) text.length());
+	});
+	/* From text, since the concurrent path parses in its threads. */
+	time_stage("parse+create_dies (arena, serial)", input.str(), nullptr, [&text, ndecls]() {
+		dwarfidl::arena_root_die r;
+		dwarfidl::create_dies(r.begin(), text);
+		return make_pair(ndecls, (uint64_t) text.length());
+	});
+	time_stage("parse+create_dies (arena, concurrent)", input.str(), nullptr, [&text, ndecls]() {
+		dwarfidl::arena_root_die r;
+		dwarfidl::create_dies_concurrently(r.begin(), text);
+		return make_pair(ndecls, (uint64_t) text.length());
+	});
+}
+
+/* The same predicate as tests/dwarfprint with no names given: every
+ * visible subprogram and every static variable. */
+static bool is_interface_element(const iterator_base& i)
+{
+	auto i_pe = i.as_a<program_element_die>();
+	return i_pe && i_pe.name_here()
+		&& ((i_pe.is_a<variable_die>() && i_pe.as_a<variable_die>()->has_static_storage())
+			|| i_pe.is_a<subprogram_die>())
+		&& (!i_pe->get_visibility() || *i_pe->get_visibility() == DW_VIS_exported);
+}
+
+struct bench_cxx_target : dependency_ordering_cxx_target
+{
+	using dependency_ordering_cxx_target::dependency_ordering_cxx_target;
+	virtual string get_reserved_prefix() const { return "_bench_"; }
+};
+
+static void bench_root(root_die& r, const string& input)
+{
+	set<iterator_base> dies;
+	type_set types;
+	time_stage("gather_interface_dies", input,
+		[&dies, &types]() { dies.clear(); types.clear(); },
+		[&r, &dies, &types]() {
+			gather_interface_dies(r, dies, types, is_interface_element);
+			return make_pair((uint64_t) dies.size(), (uint64_t) 0);
+		});
+
+	/* Constructing the target runs the compiler to find its base types,
+	 * which is not what we want to measure, so it is part of the setup. */
+	set<pair<dependency_ordering_cxx_target::emit_kind, iterator_base>,
+		dependency_ordering_cxx_target::compare_with_type_equality> to_output;
+	for (auto i_d = dies.begin(); i_d != dies.end(); ++i_d)
+	{
+		if (i_d->is_a<subprogram_die>())
+		{ to_output.insert(make_pair(dependency_ordering_cxx_target::EMIT_DECL, *i_d)); }
+	}
+	ostringstream discard;
+	srk31::indenting_ostream indenting_discard(discard);
+	unique_ptr<bench_cxx_target> target;
+	time_stage("transitively_close+write_ordered_output", input,
+		[&]() {
+			target.reset(new bench_cxx_target("void *", indenting_discard, to_output));
+		},
+		[&target]() {
+			target->transitively_close();
+			uint64_t nfrags = target->output_fragments().size();
+			ostringstream out;
+			target->write_ordered_output(out);
+			return make_pair(nfrags, (uint64_t) out.str().length());
+		});
+
+	time_stage("print_dies", input, nullptr, [&dies, &types]() {
+		ostringstream out;
+		print_dies(out, dies, types);
+		return make_pair((uint64_t) dies.size(), (uint64_t) out.str().length());
+	});
+
+	time_stage("dwarf::tool::print", input, nullptr, [&r]() {
+		ostringstream out;
+		srk31::indenting_ostream indenting_out(out);
+		dwarf::tool::print(indenting_out, r);
+		return make_pair((uint64_t) 0, (uint64_t) out.str().length());
+	});
+}
+
+static void bench_binary(const string& path)
+{
+	FILE *f = fopen(path.c_str(), "r");
+	if (!f) { cerr << "Could not open " << path << endl; exit(1); }
+	{
+		root_die r(fileno(f));
+		bench_root(r, path);
+	}
+	fclose(f);
+}
+
+/* s as the inside of a JSON string: input paths can contain anything. */
+static string json_escape(const string& s)
+{
+	ostringstream out;
+	for (unsigned char c : s)
+	{
+		switch (c)
+		{
+			case '"': out << "\\\""; break;
+			case '\\': out << "\\\\"; break;
+			case '\n': out << "\\n"; break;
+			case '\r': out << "\\r"; break;
+			case '\t': out << "\\t"; break;
+			default:
+				if (c < 0x20)
+				{
+					char buf[8];
+					snprintf(buf, sizeof buf, "\\u%04x", c);
+					out << buf;
+				}
+				else out << c;
+		}
+	}
+	return out.str();
+}
+
+/* The same stages over synthetic DIEs, for scaling curves that do not
+ * depend on what binaries are to hand. */
+static void bench_synthetic(unsigned size)
+{
+	in_memory_root_die r;
+	dwarfidl::create_synthetic_dies(r, synthetic_params_for(size));
+	ostringstream input; input << "synthetic-" << size;
+	bench_root(r, input.str());
+}
+
+int main(int argc, char **argv)
+{
+	vector<unsigned> sizes = { 10, 100, 1000, 10000, 100000 };
+	vector<string> elf_inputs;
+	for (int i = 1; i < argc; ++i)
+	{
+		string arg = argv[i];
+		if (arg == "--sizes" && i + 1 < argc)
+		{
+			sizes.clear();
+			istringstream s(argv[++i]);
+			string n;
+			while (getline(s, n, ',')) if (n.length() > 0) sizes.push_back(atoi(n.c_str()));
+		}
+		else if (arg == "--min-seconds" && i + 1 < argc) min_seconds = atof(argv[++i]);
+		else elf_inputs.push_back(arg);
+	}
+	if (elf_inputs.empty()) elf_inputs.push_back(argv[0]);
+
+	for (unsigned size : sizes) bench_text(size);
+	for (unsigned size : sizes) bench_synthetic(size);
+	for (const string& path : elf_inputs) bench_binary(path);
+
+	cout << "{\"results\": [";
+	for (auto i_r = results.begin(); i_r != results.end(); ++i_r)
+	{
+		double per_iteration = i_r->seconds / i_r->iterations;
+		cout << (i_r == results.begin() ? "" : ",") << endl
+			<< "  {\"stage\": \"" << json_escape(i_r->stage)
+			<< "\", \"input\": \"" << json_escape(i_r->input) << "\""
+			<< ", \"iterations\": " << i_r->iterations
+			<< ", \"seconds_per_iteration\": " << per_iteration
+			<< ", \"items\": " << i_r->items
+			<< ", \"items_per_second\": " << (per_iteration > 0 ? i_r->items / per_iteration : 0)
+			<< ", \"bytes\": " << i_r->bytes
+			<< ", \"bytes_per_second\": " << (per_iteration > 0 ? i_r->bytes / per_iteration : 0)
+			<< "}";
+	}
+	cout << endl << "], \"metrics\": ";
+	dwarfidl::metrics::dump_json(cout);
+	cout << "}" << endl;
+	return 0;
+}
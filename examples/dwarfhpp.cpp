@@ -4,13 +4,19 @@
 #include <vector>
 #include <set>
 #include <sstream>
+#include <fstream>
+#include <cstdlib>
 #include <cmath>
+#include <memory>
+#include <functional>
 
 #include <boost/algorithm/string.hpp>
 #include <srk31/indenting_ostream.hpp>
 #include "dwarfidl/cxx_model.hpp"
 #include "dwarfidl/dependency_ordering_cxx_target.hpp"
 #include "dwarfidl/dwarf_interface_walk.hpp"
+#include "dwarfidl/name_index.hpp"
+#include "dwarfidl/selection.hpp"
 #include <srk31/algorithm.hpp>
 
 using namespace srk31;
@@ -38,6 +44,7 @@ using dwarf::core::type_set;
 using dwarf::core::subprogram_die;
 using dwarf::core::with_data_members_die;
 using dwarf::tool::gather_interface_dies;
+using dwarf::tool::gather_scoped_interface_dies;
 
 int main(int argc, char **argv)
 {
@@ -68,6 +75,7 @@ int main(int argc, char **argv)
 	struct dwarfhpp_cxx_target : dependency_ordering_cxx_target
 	{
 		using dependency_ordering_cxx_target::dependency_ordering_cxx_target;
+		std::unique_ptr<dwarfidl::toplevel_name_index> toplevel_names;
 		virtual string get_reserved_prefix() const { return "_dwarfhpp_"; }
 		spec::opt<string> maybe_get_name(iterator_base i, enum ref_kind k)
 		{
@@ -87,9 +95,10 @@ int main(int argc, char **argv)
 
 				// to make sure we don't get ourselves as "conflicting",
 				// we should check that we're a member_die or other non-CU-level thing
+				if (!toplevel_names) toplevel_names.reset(new dwarfidl::toplevel_name_index(i.root()));
 				auto conflicting_toplevel_die = 
 					(i.parent().tag_here() != DW_TAG_compile_unit) 
-						? i.root().find_visible_grandchild_named(*i.name_here())
+						? toplevel_names->find_visible_grandchild_named(*i.name_here())
 						: iterator_base::END;
 				// if we get a conflict, we shouldn't be conflicting with ourselves
 				assert(!conflicting_toplevel_die || conflicting_toplevel_die != i);
@@ -128,34 +137,37 @@ int main(int argc, char **argv)
 		s, set<pair<dependency_ordering_cxx_target::emit_kind, iterator_base>, dependency_ordering_cxx_target::compare_with_type_equality >(),
 		compiler_argv);
 	
-	/* If the user gives us a list of function names on stdin, we use that. */
-	using std::cin;
-	std::istream& in = /* p_in ? *p_in :*/ cin;
-	/* populate the subprogram and types lists. */
-	char buf[4096];
-	set<string> subprogram_names;
-	while (in.getline(buf, sizeof buf - 1))
-	{
-		/* Find a toplevel grandchild that is a subprogram of this name. */
-		subprogram_names.insert(buf);
-	}
+	/* If the user gives us a list of function names on stdin, we use that,
+	 * along with any selection rules after the filename. */
+	dwarfidl::selection sel;
+	ostringstream rules;
+	for (int i = 2; i < argc; ++i) rules << argv[i] << "\n";
+	rules << std::cin.rdbuf();
+	istringstream rules_in(rules.str());
+	sel.read(rules_in);
 
 	set<iterator_base> dies;
 	type_set types;
-	gather_interface_dies(r, dies, types, [subprogram_names](const iterator_base& i){
-		/* This is the basic test for whether an interface element is of 
-		 * interest. For us, it's just whether it's a visible subprogram or variable
-		 * in our list. Or, if our list is empty, it's any subprogram. 
-		 * FIXME: variables too!*/
-		auto i_subp = i.as_a<subprogram_die>();
-		return i_subp && i_subp.name_here() 
-			&& (!i_subp->get_visibility() || *i_subp->get_visibility() == DW_VIS_exported)
-			&& (
-				subprogram_names.size() > 0 ? 
-					subprogram_names.find(*i_subp.name_here()) != subprogram_names.end()
-				:   true
-				);
-	});
+	/* This is the basic test for whether an interface element is of
+	 * interest: a visible subprogram in our list, or any subprogram if
+	 * the list is empty. Variables too, given tag:variable.
+	 * If DWARFIDL_GATHER_CACHE names a file, we keep each CU's slice there
+	 * and only re-walk the CUs that have changed since last time.
+	 * Qualified rules like "ns::f" need us to look inside scopes. */
+	bool scoped = sel.has_qualified_rules();
+	const char *cache_filename = getenv("DWARFIDL_GATHER_CACHE");
+	if (cache_filename)
+	{
+		dwarf::tool::gather_cache cache(rules.str());
+		std::ifstream cache_in(cache_filename);
+		if (cache_in) cache.load(cache_in);
+		if (scoped) gather_scoped_interface_dies(r, dies, types, std::cref(sel), cache, true);
+		else gather_interface_dies(r, dies, types, std::cref(sel), cache);
+		std::ofstream cache_out(cache_filename);
+		cache.save(cache_out);
+	}
+	else if (scoped) gather_scoped_interface_dies(r, dies, types, std::cref(sel), true);
+	else gather_interface_dies(r, dies, types, std::cref(sel));
 
 	//target.emit_decls(dies);
 		/* We now don't bother doing the topological sort, so we just
@@ -0,0 +1,457 @@
+/* Answer slice, print and header requests from resident roots.
+ *
+ * dwarfidld [--max-roots N] socket-path
+ *
+ * Listens on a Unix-domain socket. A client sends one request per line:
+ *
+ *   SLICE binary [rule...]   the selected interface, as dwarfidl text
+ *   HPP binary [rule...]     C++ forward declarations, as dwarfhpp makes
+ *   PRINT binary             the whole of binary's debugging information
+ *   STATS                    counters, as JSON
+ *   QUIT                     stop the daemon
+ *
+ * Words are separated by spaces, so paths and rules can't contain any.
+ * Each reply is "OK <length>\n" followed by that many bytes, or
+ * "ERR <message>\n". Rules are selection rules, as for dwarfhpp; with none,
+ * every exported subprogram is selected.
+ *
+ * Each binary's root_die stays loaded between requests, with its lazily
+ * built indexes, and the most recent replies are kept by request; both are
+ * dropped if the file changes. The compiler's base types, which every
+ * header request needs, are discovered once. Requests are answered one at
+ * a time, since roots aren't thread-safe, but clients are polled and take
+ * turns, one request each, so an idle or slow client holds up no one. The
+ * least recently used root is closed when more than N (default 16) are
+ * loaded. Only the daemon's user can connect. */
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <list>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fileno.hpp>
+#include <srk31/indenting_ostream.hpp>
+#include <dwarfpp/lib.hpp>
+#include "dwarfidl/cxx_model.hpp"
+#include "dwarfidl/dependency_ordering_cxx_target.hpp"
+#include "dwarfidl/dwarf_interface_walk.hpp"
+#include "dwarfidl/dwarfprint.hpp"
+#include "dwarfidl/print.hpp"
+#include "dwarfidl/selection.hpp"
+#include "dwarfidl/metrics.hpp"
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+using std::set;
+using std::map;
+using std::pair;
+using std::ostringstream;
+using std::istringstream;
+using namespace dwarf;
+using namespace dwarf::core;
+using dwarf::tool::cxx_compiler;
+using dwarf::tool::dependency_ordering_cxx_target;
+
+struct loaded_root
+{
+	FILE *f;
+	std::unique_ptr<root_die> r;
+	/* To notice the file being rebuilt under us. */
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	map<string, string> replies;
+	/* Oldest first, to keep replies within bounds. */
+	std::deque<map<string, string>::iterator> reply_order;
+	size_t reply_bytes;
+	uint64_t last_used;
+
+	/* PRINT replies in particular can be big. */
+	static const size_t max_replies = 64;
+	static const size_t max_reply_bytes = 64 * 1024 * 1024;
+
+	loaded_root() : f(nullptr), reply_bytes(0), last_used(0) {}
+	loaded_root(const loaded_root&) = delete;
+	~loaded_root() { r.reset(); if (f) fclose(f); }
+
+	bool is_current(const struct stat& st) const
+	{
+		return st.st_dev == dev && st.st_ino == ino && st.st_size == size
+			&& st.st_mtim.tv_sec == mtime.tv_sec && st.st_mtim.tv_nsec == mtime.tv_nsec;
+	}
+
+	void keep_reply(const string& request, const string& reply)
+	{
+		if (reply.size() > max_reply_bytes) return;
+		while (!reply_order.empty()
+			&& (replies.size() >= max_replies || reply_bytes + reply.size() > max_reply_bytes))
+		{
+			reply_bytes -= reply_order.front()->second.size();
+			replies.erase(reply_order.front());
+			reply_order.pop_front();
+		}
+		reply_order.push_back(replies.insert(std::make_pair(request, reply)).first);
+		reply_bytes += reply.size();
+	}
+};
+
+class daemon_state
+{
+	map<string, std::unique_ptr<loaded_root> > m_roots;
+	unsigned m_max_roots;
+	uint64_t m_clock = 0;
+	std::unique_ptr<cxx_compiler> m_compiler;
+	uint64_t m_requests = 0;
+	uint64_t m_reply_hits = 0;
+	uint64_t m_loads = 0;
+	uint64_t m_reloads = 0;
+
+	loaded_root& get(const string& path)
+	{
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0) throw std::runtime_error("cannot stat " + path + ": " + strerror(errno));
+		auto found = m_roots.find(path);
+		if (found != m_roots.end())
+		{
+			if (found->second->is_current(st))
+			{
+				found->second->last_used = ++m_clock;
+				return *found->second;
+			}
+			m_roots.erase(found);
+			++m_reloads;
+		}
+		if (m_roots.size() >= m_max_roots)
+		{
+			auto oldest = m_roots.begin();
+			for (auto i_r = m_roots.begin(); i_r != m_roots.end(); ++i_r)
+			{
+				if (i_r->second->last_used < oldest->second->last_used) oldest = i_r;
+			}
+			m_roots.erase(oldest);
+		}
+		std::unique_ptr<loaded_root> l(new loaded_root);
+		l->f = fopen(path.c_str(), "r");
+		if (!l->f) throw std::runtime_error("cannot open " + path + ": " + strerror(errno));
+		l->r.reset(new root_die(fileno(l->f)));
+		l->dev = st.st_dev;
+		l->ino = st.st_ino;
+		l->size = st.st_size;
+		l->mtime = st.st_mtim;
+		l->last_used = ++m_clock;
+		++m_loads;
+		return *(m_roots[path] = std::move(l));
+	}
+
+	cxx_compiler& compiler()
+	{
+		if (!m_compiler)
+		{
+			/* The same flags dwarfhpp uses. */
+			vector<string> argv = cxx_compiler::default_compiler_argv(true);
+			argv.push_back("-fno-eliminate-unused-debug-types");
+			argv.push_back("-fno-eliminate-unused-debug-symbols");
+			m_compiler.reset(new cxx_compiler(argv));
+		}
+		return *m_compiler;
+	}
+
+	static void gather(root_die& r, const vector<string>& words, set<iterator_base>& dies, type_set& types)
+	{
+		dwarfidl::selection sel;
+		for (unsigned i = 2; i < words.size(); ++i) sel.add(words[i]);
+		/* As dwarfhpp does: qualified rules like "ns::f" need us to look
+		 * inside scopes. */
+		if (sel.has_qualified_rules())
+		{
+			dwarf::tool::gather_scoped_interface_dies(r, dies, types, std::cref(sel), true);
+		}
+		else dwarf::tool::gather_interface_dies(r, dies, types, std::cref(sel));
+	}
+
+	string hpp(root_die& r, const vector<string>& words)
+	{
+		set<iterator_base> dies;
+		type_set types;
+		gather(r, words, dies, types);
+		ostringstream out;
+		srk31::indenting_ostream s(out);
+		dependency_ordering_cxx_target target(" ::cake::unspecified_wordsize_type", s,
+			set<pair<dependency_ordering_cxx_target::emit_kind, iterator_base>,
+				dependency_ordering_cxx_target::compare_with_type_equality>(),
+			compiler());
+		/* As dwarfhpp does: forward-declare every named struct and union. */
+		set<iterator_base> to_fd;
+		for (auto i_d = dies.begin(); i_d != dies.end(); ++i_d)
+		{
+			if (i_d->is_a<with_data_members_die>() && i_d->name_here()) to_fd.insert(*i_d);
+		}
+		if (to_fd.empty()) return out.str();
+		s << "// begin a group of forward decls" << endl;
+		for (auto i = to_fd.begin(); i != to_fd.end(); ++i)
+		{
+			bool is_struct = i->tag_here() == DW_TAG_structure_type;
+			s << (is_struct ? "struct " : "union ") << target.protect_ident(*i->name_here())
+				<< "; // forward decl" << endl;
+		}
+		s << "// end a group of forward decls" << endl;
+		return out.str();
+	}
+
+	string stats() const
+	{
+		ostringstream s;
+		s << "{\"requests\": " << m_requests
+			<< ", \"reply_cache_hits\": " << m_reply_hits
+			<< ", \"roots_loaded\": " << m_roots.size()
+			<< ", \"loads\": " << m_loads
+			<< ", \"reloads\": " << m_reloads
+			<< ", \"metrics\": ";
+		dwarfidl::metrics::dump_json(s);
+		s << "}\n";
+		return s.str();
+	}
+
+public:
+	explicit daemon_state(unsigned max_roots) : m_max_roots(max_roots ? max_roots : 1) {}
+
+	/* The reply to one request line. */
+	string answer(const string& line)
+	{
+		++m_requests;
+		vector<string> words;
+		istringstream in(line);
+		for (string w; in >> w; ) words.push_back(w);
+		if (words.empty()) throw std::runtime_error("empty request");
+		const string& cmd = words[0];
+		if (cmd == "STATS") return stats();
+		if (cmd != "SLICE" && cmd != "HPP" && cmd != "PRINT")
+		{
+			throw std::runtime_error("unknown request " + cmd);
+		}
+		if (words.size() < 2) throw std::runtime_error(cmd + " needs a binary");
+		loaded_root& l = get(words[1]);
+		auto found = l.replies.find(line);
+		if (found != l.replies.end()) { ++m_reply_hits; return found->second; }
+
+		string reply;
+		if (cmd == "SLICE")
+		{
+			set<iterator_base> dies;
+			type_set types;
+			gather(*l.r, words, dies, types);
+			ostringstream s;
+			print_dies(s, dies, types);
+			reply = s.str();
+		}
+		else if (cmd == "HPP") reply = hpp(*l.r, words);
+		else
+		{
+			ostringstream s;
+			srk31::indenting_ostream out(s);
+			dwarf::tool::print(out, *l.r);
+			reply = s.str();
+		}
+		l.keep_reply(line, reply);
+		return reply;
+	}
+};
+
+/* A connected client: what it has sent that we haven't answered, and
+ * what we have answered that it hasn't read. */
+struct client
+{
+	int fd;
+	string in;
+	string out;
+	/* It has sent all it will, but may still want answers. */
+	bool hung_up;
+
+	explicit client(int fd) : fd(fd), hung_up(false) {}
+	client(const client&) = delete;
+	~client() { close(fd); }
+};
+
+/* Longer than any sensible request; a client sending more is dropped. */
+static const size_t max_request = 1024 * 1024;
+
+/* Answer the first request c has sent, if it has sent a whole one; false
+ * if it asked us to quit. */
+static bool answer_one(client& c, daemon_state& state)
+{
+	size_t nl = c.in.find('\n');
+	if (nl == string::npos) return true;
+	string line = c.in.substr(0, nl);
+	c.in.erase(0, nl + 1);
+	if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+	if (line == "QUIT")
+	{
+		c.out += "OK 0\n";
+		return false;
+	}
+	string message;
+	try
+	{
+		string body = state.answer(line);
+		ostringstream s;
+		s << "OK " << body.size() << "\n";
+		c.out += s.str() + body;
+		return true;
+	}
+	catch (std::exception& e) { message = e.what(); }
+	/* libdwarfpp's errors aren't std::exceptions. */
+	catch (...) { message = "internal error"; }
+	for (auto i = message.begin(); i != message.end(); ++i) if (*i == '\n') *i = ' ';
+	c.out += "ERR " + message + "\n";
+	return true;
+}
+
+/* Read what c has sent; false if it has failed or sent too much. */
+static bool read_some(client& c)
+{
+	char chunk[4096];
+	for (;;)
+	{
+		ssize_t n = read(c.fd, chunk, sizeof chunk);
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+		if (n == 0) { c.hung_up = true; return true; }
+		if (n < 0) return false;
+		c.in.append(chunk, n);
+		if (c.in.size() > max_request && c.in.find('\n') == string::npos) return false;
+		if (static_cast<size_t>(n) < sizeof chunk) return true;
+	}
+}
+
+/* Write what c can take of its replies; false if it has gone. */
+static bool write_some(client& c)
+{
+	while (!c.out.empty())
+	{
+		ssize_t n = write(c.fd, c.out.data(), c.out.size());
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+		if (n <= 0) return false;
+		c.out.erase(0, n);
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned max_roots = 16;
+	string path;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (string(argv[i]) == "--max-roots" && i + 1 < argc) max_roots = std::stoul(argv[++i]);
+		else path = argv[i];
+	}
+	if (path.empty())
+	{
+		cerr << "Usage: " << argv[0] << " [--max-roots N] socket-path" << endl;
+		return 2;
+	}
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof addr.sun_path)
+	{
+		cerr << "Socket path too long: " << path << endl;
+		return 2;
+	}
+	strcpy(addr.sun_path, path.c_str());
+
+	signal(SIGPIPE, SIG_IGN);
+	int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	unlink(path.c_str());
+	/* Nobody can connect before listen(), so there is no window in which
+	 * others could. */
+	if (listener < 0 || bind(listener, (struct sockaddr *) &addr, sizeof addr) != 0
+		|| chmod(path.c_str(), 0600) != 0 || listen(listener, 64) != 0)
+	{
+		cerr << "Could not listen on " << path << ": " << strerror(errno) << endl;
+		return 1;
+	}
+
+	daemon_state state(max_roots);
+	std::list<client> clients;
+	for (bool running = true; running; )
+	{
+		/* A client with replies outstanding is not read from until it
+		 * has taken them. */
+		vector<struct pollfd> fds(1);
+		fds[0].fd = listener;
+		fds[0].events = POLLIN;
+		for (auto i_c = clients.begin(); i_c != clients.end(); ++i_c)
+		{
+			short events = !i_c->out.empty() ? POLLOUT : i_c->hung_up ? 0 : POLLIN;
+			struct pollfd p = { i_c->fd, events, 0 };
+			fds.push_back(p);
+		}
+		/* Don't wait on a client that has more requests waiting. */
+		bool ready = false;
+		for (auto i_c = clients.begin(); i_c != clients.end(); ++i_c)
+		{
+			if (i_c->out.empty() && i_c->in.find('\n') != string::npos) ready = true;
+		}
+		if (poll(&fds[0], fds.size(), ready ? 0 : -1) < 0)
+		{
+			if (errno == EINTR) continue;
+			cerr << "poll: " << strerror(errno) << endl;
+			break;
+		}
+		auto i_c = clients.begin();
+		for (unsigned n = 1; n < fds.size(); ++n)
+		{
+			client& c = *i_c;
+			bool ok = true;
+			if (fds[n].revents & POLLOUT) ok = write_some(c);
+			else if (fds[n].revents & (POLLIN | POLLHUP | POLLERR)) ok = read_some(c);
+			/* One request per client per turn. */
+			if (ok && c.out.empty())
+			{
+				running = answer_one(c, state) && running;
+				if (!c.out.empty()) ok = write_some(c);
+			}
+			if (!ok || (c.hung_up && c.out.empty() && c.in.find('\n') == string::npos))
+			{
+				i_c = clients.erase(i_c);
+			}
+			else ++i_c;
+		}
+		if (fds[0].revents & POLLIN)
+		{
+			int fd;
+			while ((fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK)) >= 0) clients.emplace_back(fd);
+		}
+	}
+	/* Let whoever asked us to quit know we have. */
+	for (auto i_c = clients.begin(); i_c != clients.end(); ++i_c)
+	{
+		fcntl(i_c->fd, F_SETFL, fcntl(i_c->fd, F_GETFL) & ~O_NONBLOCK);
+		write_some(*i_c);
+	}
+	clients.clear();
+	close(listener);
+	unlink(path.c_str());
+	return 0;
+}
@@ -0,0 +1,65 @@
+/* Report ABI changes between two binaries' interfaces.
+ *
+ * dwarfidldiff [--patch] old-binary new-binary [rule...]
+ *
+ * Gathers each binary's interface, as chosen by the selection rules (by
+ * default every exported subprogram), and lists what changed. With --patch,
+ * prints a dwarfidl patch instead. Exits with status 1 if anything changed,
+ * so that it can gate a release. */
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include "dwarfidl/dwarf_interface_walk.hpp"
+#include "dwarfidl/selection.hpp"
+#include "dwarfidl/abi_diff.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::set;
+using namespace dwarf;
+using namespace dwarf::core;
+
+int main(int argc, char **argv)
+{
+	bool patch = false;
+	std::vector<string> args;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (string(argv[i]) == "--patch") patch = true;
+		else args.push_back(argv[i]);
+	}
+	if (args.size() < 2)
+	{
+		cerr << "Usage: " << argv[0] << " [--patch] old-binary new-binary [rule...]" << endl;
+		return 2;
+	}
+	FILE *old_f = fopen(args[0].c_str(), "r");
+	FILE *new_f = fopen(args[1].c_str(), "r");
+	if (!old_f || !new_f)
+	{
+		cerr << "Could not open " << (old_f ? args[1] : args[0]) << endl;
+		return 2;
+	}
+	root_die old_r(fileno(old_f));
+	root_die new_r(fileno(new_f));
+
+	dwarfidl::selection sel;
+	for (unsigned i = 2; i < args.size(); ++i) sel.add(args[i]);
+
+	set<iterator_base> old_dies, new_dies;
+	type_set old_types, new_types;
+	dwarf::tool::gather_interface_dies(old_r, old_dies, old_types, std::cref(sel));
+	dwarf::tool::gather_interface_dies(new_r, new_dies, new_types, std::cref(sel));
+
+	auto changes = dwarfidl::diff_interfaces(old_dies, new_dies);
+	if (patch) dwarfidl::write_dwarfidl_patch(cout, changes);
+	else for (auto i_c = changes.begin(); i_c != changes.end(); ++i_c) cout << *i_c << endl;
+	return changes.empty() ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+/* Compile the footprints in a dwarfidl file.
+ *
+ * dwarfidlfootprint [--cxx] file.dwarfidl
+ *
+ * Creates the file's DIEs, compiles the footprint of each subprogram that
+ * has one, and prints the bytecode or, with --cxx, a C++ checker function
+ * per footprint, ready to compile into a tracer. */
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <dwarfpp/lib.hpp>
+#include "dwarfidl/create.hpp"
+#include "dwarfidl/footprint.hpp"
+#include "dwarfidl/footprint_cxx.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using namespace dwarf;
+using namespace dwarf::core;
+
+int main(int argc, char **argv)
+{
+	bool cxx = false;
+	const char *filename = nullptr;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (string(argv[i]) == "--cxx") cxx = true;
+		else if (!filename) filename = argv[i];
+		else { filename = nullptr; break; }
+	}
+	if (!filename)
+	{
+		cerr << "Usage: " << argv[0] << " [--cxx] file.dwarfidl" << endl;
+		return 1;
+	}
+
+	auto str = antlr3FileStreamNew(
+		reinterpret_cast<uint8_t*>(const_cast<char*>(filename)),
+		ANTLR3_ENC_UTF8
+	);
+	if (!str)
+	{
+		cerr << "Could not open " << filename << endl;
+		return 1;
+	}
+	auto lexer = dwarfidlNewCLexerNew(str);
+	auto tokenStream = antlr3CommonTokenStreamSourceNew(ANTLR3_SIZE_HINT, TOKENSOURCE(lexer));
+	auto parser = dwarfidlNewCParserNew(tokenStream);
+	antlr::tree::Tree *tree = parser->toplevel(parser).tree;
+
+	in_memory_root_die r;
+	auto cu = r.make_new(r.begin(), DW_TAG_compile_unit);
+	dwarfidl::create_dies(cu, tree);
+
+	std::map<string, dwarfidl::footprint::program> programs;
+	try
+	{
+		programs = dwarfidl::footprint::compiler().compile_all(tree, cu);
+	}
+	catch (dwarfidl::footprint::compile_error& e)
+	{
+		cerr << filename << ": " << e.what() << endl;
+		return 1;
+	}
+
+	if (cxx) dwarfidl::footprint::write_cxx(cout, programs);
+	else for (auto i_p = programs.begin(); i_p != programs.end(); ++i_p) cout << i_p->second << endl;
+	return 0;
+}
@@ -0,0 +1,103 @@
+/* Generate synthetic DWARF for scaling tests.
+ *
+ * dwarfidlsynth [options] [--text | --print | --slice]
+ *
+ * With --text, writes the generated dwarfidl to stdout, wrapping each CU's
+ * contents in a compile_unit. Otherwise it materialises the DIEs with
+ * create_dies and reports how many there are and how long that took; --print
+ * then dumps the whole tree and --slice prints the gathered interface slice. */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <chrono>
+#include <srk31/indenting_ostream.hpp>
+#include <dwarfpp/lib.hpp>
+#include "dwarfidl/synthetic.hpp"
+#include "dwarfidl/dwarfprint.hpp"
+#include "dwarfidl/print.hpp"
+#include "dwarfidl/dwarf_interface_walk.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using namespace dwarf;
+using namespace dwarf::core;
+using dwarf::tool::gather_interface_dies;
+
+static void usage(const char *progname)
+{
+	cerr << "Usage: " << progname << " [--cus n] [--structs n] [--width n] [--depth n]" << endl
+		<< "\t[--cycle n] [--typedef-chain n] [--anon-union-every n] [--shared n]" << endl
+		<< "\t[--no-functions] [--text | --print | --slice]" << endl;
+	exit(1);
+}
+
+static unsigned count_dies(iterator_df<> i)
+{
+	unsigned n = 0;
+	for (; i; ++i) ++n;
+	return n;
+}
+
+int main(int argc, char **argv)
+{
+	dwarfidl::synthetic_params p;
+	enum { SUMMARY, TEXT, PRINT, SLICE } mode = SUMMARY;
+	for (int i = 1; i < argc; ++i)
+	{
+		string arg = argv[i];
+		auto next_number = [&]() -> unsigned {
+			if (i + 1 >= argc) usage(argv[0]);
+			return atoi(argv[++i]);
+		};
+		if      (arg == "--cus")              p.ncus = next_number();
+		else if (arg == "--structs")          p.structs_per_cu = next_number();
+		else if (arg == "--width")            p.width = next_number();
+		else if (arg == "--depth")            p.depth = next_number();
+		else if (arg == "--cycle")            p.pointer_cycle_length = next_number();
+		else if (arg == "--typedef-chain")    p.typedef_chain_length = next_number();
+		else if (arg == "--anon-union-every") p.anonymous_union_every = next_number();
+		else if (arg == "--shared")           p.shared_structs = next_number();
+		else if (arg == "--no-functions")     p.functions = false;
+		else if (arg == "--text")             mode = TEXT;
+		else if (arg == "--print")            mode = PRINT;
+		else if (arg == "--slice")            mode = SLICE;
+		else usage(argv[0]);
+	}
+
+	if (mode == TEXT)
+	{
+		for (unsigned c = 0; c < p.ncus; ++c)
+		{
+			cout << "compile_unit synthetic_cu" << c << " {" << endl
+				<< dwarfidl::generate_synthetic_dwarfidl(p, c)
+				<< "};" << endl;
+		}
+		return 0;
+	}
+
+	in_memory_root_die r;
+	auto start = std::chrono::steady_clock::now();
+	dwarfidl::create_synthetic_dies(r, p);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	cerr << "Created " << count_dies(r.begin()) << " DIEs in " << p.ncus << " CUs in "
+		<< seconds << "s" << endl;
+
+	if (mode == PRINT)
+	{
+		srk31::indenting_ostream out(cout);
+		dwarf::tool::print(out, r);
+	}
+	else if (mode == SLICE)
+	{
+		std::set<iterator_base> dies;
+		type_set types;
+		gather_interface_dies(r, dies, types, [](const iterator_base& i) {
+			return i.tag_here() == DW_TAG_subprogram;
+		});
+		print_dies(cout, dies, types);
+	}
+	return 0;
+}
@@ -11,6 +11,7 @@
 #include <cctype>
 #include <cstdlib>
 #include <memory>
+#include <functional>
 #include <boost/regex.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/icl/interval_map.hpp>
@@ -20,6 +21,7 @@
 #include <dwarfpp/lib.hpp>
 #include <fileno.hpp>
 #include "dwarfidl/dwarf_interface_walk.hpp"
+#include "dwarfidl/selection.hpp"
 
 using std::cin;
 using std::cout;
@@ -189,24 +191,15 @@ int main(int argc, char **argv)
 	std::istream& in = /* p_in ? *p_in :*/ cin;
 	
 	/* populate the subprogram and types lists. */
-	char buf[4096];
-	set<string> subprogram_names;
-	while (in.getline(buf, sizeof buf - 1))
-	{
-		/* Find a toplevel grandchild that is a subprogram of this name. */
-		subprogram_names.insert(buf);
-	}
+	dwarfidl::selection sel(/* empty_matches_all = */ false);
+	for (int i = 2; i < argc; ++i) sel.add(argv[i]);
+	sel.read(in);
 	
 	set<iterator_base> dies;
 	type_set types;
-	gather_interface_dies(root, dies, types, [subprogram_names](const iterator_base& i){
-		/* This is the basic test for whether an interface element is of 
-		 * interest. For us, it's just whether it's a visible subprogram in our list. */
-		auto i_subp = i.as_a<subprogram_die>();
-		return i_subp && i_subp.name_here() 
-			&& (!i_subp->get_visibility() || *i_subp->get_visibility() == DW_VIS_exported)
-			&& (subprogram_names.find(*i_subp.name_here()) != subprogram_names.end());
-	});
+	/* This is the basic test for whether an interface element is of 
+	 * interest. For us, it's just whether it's a visible subprogram in our list. */
+	gather_interface_dies(root, dies, types, std::cref(sel));
 	
 	/* Filter out just the subprograms. */
 	for (auto i_d = dies.begin(); i_d != dies.end(); ++i_d)
@@ -0,0 +1,62 @@
+/* Comparing two interface slices for ABI changes. */
+#ifndef DWARFIDL_ABI_DIFF_HPP_
+#define DWARFIDL_ABI_DIFF_HPP_
+
+#include <set>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <dwarfpp/lib.hpp>
+
+namespace dwarfidl
+{
+	using std::string;
+	using dwarf::core::iterator_base;
+
+	struct abi_change
+	{
+		enum kind
+		{
+			ADDED,
+			REMOVED,
+			KIND_CHANGED,        // e.g. a struct became a union
+			SIZE_CHANGED,
+			MEMBER_ADDED,
+			MEMBER_REMOVED,
+			MEMBER_MOVED,
+			MEMBER_TYPE_CHANGED,
+			ENUMERATOR_CHANGED,  // added, removed or renumbered
+			SIGNATURE_CHANGED,
+			TYPE_CHANGED         // of a variable, typedef, pointer or base type
+		};
+		kind k;
+		/* What changed, e.g. "struct foo", "struct foo.bar" or "f(arg 2)". */
+		string where;
+		string detail;
+		/* The innermost DIEs concerned; either may be END. */
+		iterator_base old_die;
+		iterator_base new_die;
+		/* The toplevel elements whose change this is part of. */
+		iterator_base old_element;
+		iterator_base new_element;
+	};
+	const char *change_kind_name(abi_change::kind k);
+	std::ostream& operator<<(std::ostream& s, const abi_change& c);
+
+	/* Compare two results of gather_interface_dies. Named elements are
+	 * matched by qualified name, and struct, union and enum names are kept
+	 * apart from the rest as C does. Pairs whose summary codes agree are
+	 * taken as unchanged without looking inside, so apart from hashing and
+	 * matching names, the work is in proportion to what changed. Each pair
+	 * of types is reported once, under the first place it was reached. */
+	std::vector<abi_change> diff_interfaces(
+		const std::set<iterator_base>& old_slice,
+		const std::set<iterator_base>& new_slice);
+
+	/* A dwarfidl patch: for each changed or added element, its new
+	 * definition and those of the changed types reported under it, after
+	 * comments listing the changes; for each removed element, a comment. */
+	void write_dwarfidl_patch(std::ostream& out, const std::vector<abi_change>& changes);
+}
+
+#endif
@@ -0,0 +1,232 @@
+/* An in-memory root whose DIEs live in bump-allocated arenas. */
+#ifndef DWARFIDL_ARENA_ROOT_HPP_
+#define DWARFIDL_ARENA_ROOT_HPP_
+
+#include <memory>
+#include <map>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <unordered_set>
+#include <dwarfpp/lib.hpp>
+#include "dwarfidl/binary_slice.hpp"
+#include "dwarfidl/resolution_index.hpp"
+#include "dwarfidl/structural_index.hpp"
+
+namespace dwarfidl
+{
+	using std::string;
+	using dwarf::core::root_die;
+	using dwarf::core::abstract_die;
+	using dwarf::core::basic_die;
+	using dwarf::core::iterator_base;
+	using dwarf::lib::Dwarf_Off;
+	using dwarf::lib::Dwarf_Half;
+	using dwarf::spec::opt;
+
+	/* Bump allocation from large chunks, all freed together when the arena
+	 * goes. No destructors are run, so only trivially destructible things
+	 * should go in. */
+	class arena
+	{
+		std::vector<std::unique_ptr<char[]> > m_chunks;
+		char *m_next;
+		size_t m_left;
+		size_t m_chunk_size;
+		size_t m_used;
+		size_t m_reserved;
+	public:
+		explicit arena(size_t chunk_size = 64 * 1024)
+		 : m_next(nullptr), m_left(0), m_chunk_size(chunk_size), m_used(0), m_reserved(0) {}
+		arena(const arena&) = delete;
+		arena& operator=(const arena&) = delete;
+
+		void *allocate(size_t size, size_t align = alignof(uint64_t));
+		template <typename T> T *allocate_array(size_t n)
+		{ return static_cast<T *>(allocate(n * sizeof (T), alignof(T))); }
+		const char *copy_string(const string& s);
+		/* Take over all of other's memory; other is left empty. */
+		void take(arena& other);
+
+		size_t bytes_used() const { return m_used; }
+		size_t bytes_reserved() const { return m_reserved; }
+	};
+
+	/* A DIE's attributes as create_dies gathers them, in source order. */
+	typedef std::vector<std::pair<Dwarf_Half, dwarf::encap::attribute_value> > attribute_list;
+
+	/* Each distinct string is stored once, in the arena, so interned
+	 * strings can be compared by pointer. */
+	class string_interner
+	{
+		struct cstr_hash { size_t operator()(const char *s) const; };
+		struct cstr_eq { bool operator()(const char *a, const char *b) const { return strcmp(a, b) == 0; } };
+		arena& m_arena;
+		std::unordered_set<const char *, cstr_hash, cstr_eq> m_strings;
+	public:
+		explicit string_interner(arena& a) : m_arena(a) {}
+		const char *intern(const string& s);
+		/* The interned copy of s, or null if s was never interned. */
+		const char *find(const string& s) const;
+		/* Intern s, which already lives in our arena, without copying it. */
+		const char *adopt(const char *s);
+		size_t size() const { return m_strings.size(); }
+	};
+
+	/* Like in_memory_root_die, DIEs are made with make_new and then given
+	 * attributes, but here with set_attr; create_dies knows to do that.
+	 * The DIE records, their attribute lists, strings and location
+	 * expressions all come from the root's arena, so building a root costs
+	 * a few large allocations, and destroying it a few frees. Names and
+	 * string attributes are interned, so each distinct one is stored once
+	 * however many DIEs carry it. As with mapped_slice_root_die, the DIEs
+	 * are not sticky: libdwarfpp's payloads are decoded from the records
+	 * when an iterator needs one.
+	 *
+	 * Offsets are synthetic: the root is 0 and DIEs are numbered from 1 in
+	 * the order they were made. Only replace_dies removes DIEs, and it
+	 * renumbers the rest. */
+	class arena_root_die : public root_die
+	{
+	public:
+		struct attr_node
+		{
+			attr_node *next;
+			uint16_t attr;
+			uint8_t form;    // a binslice::attr_form, but never REF_INTERNAL
+			uint8_t flags;   // binslice::REF_ABS, REF_LOCAL
+			uint32_t count;  // for LOCLIST, the number of entries
+			uint64_t value;  // for STRING and LOCLIST, points into the arena
+		};
+		struct loc_node
+		{
+			uint64_t lopc;
+			uint64_t hipc;
+			uint32_t nops;
+			const binslice::op_record *ops;
+		};
+		struct die_node
+		{
+			const char *name;
+			attr_node *first_attr;
+			attr_node *last_attr;
+			uint32_t parent;       // binslice::no_index for toplevel DIEs
+			uint32_t first_child;
+			uint32_t last_child;
+			uint32_t next_sibling;
+			uint32_t depth;
+			Dwarf_Half tag;
+		};
+	private:
+		arena m_arena;
+		string_interner m_strings;
+		std::vector<die_node *> m_dies;
+		uint32_t m_first_toplevel;
+		uint32_t m_last_toplevel;
+		resolution_index m_resolution;
+		structural_index m_structure;
+
+		bool wants_attr(die_node& d, Dwarf_Half attr, const dwarf::encap::attribute_value& v);
+		void append_attr(die_node& d, attr_node *a, Dwarf_Half attr, const dwarf::encap::attribute_value& v);
+		void encode_attr(attr_node *a, Dwarf_Half attr, const dwarf::encap::attribute_value& v);
+	public:
+		arena_root_die();
+
+		Dwarf_Off offset_of_index(uint32_t idx) const { return idx + 1; }
+		opt<uint32_t> index_of_offset(Dwarf_Off off) const
+		{
+			if (off == 0 || off > m_dies.size()) return opt<uint32_t>();
+			return static_cast<uint32_t>(off - 1);
+		}
+		const die_node& node(uint32_t idx) const { return *m_dies[idx]; }
+		/* The interned name of the DIE at off, or null; unlike get_name,
+		 * nothing is copied. */
+		const char *name_of(Dwarf_Off off) const
+		{
+			auto idx = index_of_offset(off);
+			return idx ? m_dies[*idx]->name : nullptr;
+		}
+		size_t ndies() const { return m_dies.size(); }
+		const arena& get_arena() const { return m_arena; }
+		const string_interner& strings() const { return m_strings; }
+		/* create_dies keeps this up to date as it adds DIEs. */
+		resolution_index& resolution() { return m_resolution; }
+		/* And this, for sharing inline DIEs. */
+		structural_index& structure() { return m_structure; }
+
+		bool is_sticky(const abstract_die& d) { return false; }
+		iterator_base make_new(const iterator_base& parent, Dwarf_Half tag);
+		/* As with inserting into an in_memory_abstract_die's attrs(), an
+		 * attribute the DIE already has is left alone. */
+		void set_attr(const iterator_base& it, Dwarf_Half attr, const dwarf::encap::attribute_value& v);
+		/* The same for a whole DIE's worth, with one allocation. */
+		void set_attrs(const iterator_base& it, const attribute_list& attrs);
+		/* Like set_attr, but an attribute the DIE already has is
+		 * overwritten. The old value's storage is not reclaimed. */
+		void replace_attr(const iterator_base& it, Dwarf_Half attr, const dwarf::encap::attribute_value& v);
+		/* Point an existing reference attribute somewhere else. */
+		void set_ref(const iterator_base& it, Dwarf_Half attr, Dwarf_Off target);
+
+		/* A reference to this offset is a placeholder, to be set_ref'd. */
+		static const Dwarf_Off pending_ref = ~static_cast<Dwarf_Off>(0);
+		/* In attr_node::flags: the reference is to one of this root's own
+		 * DIEs, so adopt renumbers it. */
+		static const uint8_t REF_LOCAL = 0x80;
+		/* Flag the reference attribute attr of it as REF_LOCAL.
+		 * create_dies does this for the names and inline DIEs it resolves,
+		 * but not for a reference written as an absolute offset; set_ref
+		 * does it too. */
+		void mark_local_ref(const iterator_base& it, Dwarf_Half attr);
+
+		/* Move every DIE of 'from' into this root, in one step: from's
+		 * arena is taken over and its records renumbered in place. The
+		 * children of from_parent (which may be from's root) become the
+		 * last children of to_parent, here. from_parent itself is not
+		 * carried over, and anything else outside it ends up unreachable.
+		 * A DIE at offset o in 'from' is afterwards at adopted_offset(o,
+		 * base, from_parent's offset), base being what adopt returns, and
+		 * REF_LOCAL references are rewritten to match, except pending_ref
+		 * ones; references to from_parent go to to_parent, and other
+		 * references keep the offset they were given. 'from' can only be
+		 * destroyed afterwards. */
+		Dwarf_Off adopt(arena_root_die& from, const iterator_base& from_parent,
+			const iterator_base& to_parent);
+		static Dwarf_Off adopted_offset(Dwarf_Off o, Dwarf_Off base, Dwarf_Off from_parent_off)
+		{ return (from_parent_off != 0 && o > from_parent_off) ? o + base - 1 : o + base; }
+		/* Drop each DIE that is a key of replacements, and point every
+		 * reference to it at its value (or, if that is dropped too, at
+		 * what replaces that). A dropped DIE's children must be dropped
+		 * as well. The rest are renumbered to close up, keeping their
+		 * order, and references rewritten to match. Returns where each
+		 * offset went, indexed by the old offset; a dropped DIE's entry is
+		 * its replacement's. The record storage is not reclaimed. */
+		std::vector<Dwarf_Off> replace_dies(const std::map<Dwarf_Off, Dwarf_Off>& replacements);
+		dwarf::encap::attribute_value decode_attr(const attr_node& a, Dwarf_Off context_off) const;
+
+	protected:
+		bool move_to_parent(iterator_base& it);
+		bool move_to_first_child(iterator_base& it);
+		bool move_to_next_sibling(iterator_base& it);
+		iterator_base find_downwards(Dwarf_Off off);
+		basic_die *make_payload(const iterator_base& it);
+	};
+
+	struct arena_die : public virtual abstract_die
+	{
+		const arena_root_die *p_root;
+		uint32_t idx;
+
+		arena_die(const arena_root_die& r, uint32_t idx) : p_root(&r), idx(idx) {}
+
+		Dwarf_Off get_offset() const;
+		Dwarf_Half get_tag() const;
+		opt<string> get_name() const;
+		Dwarf_Off get_enclosing_cu_offset() const;
+		bool has_attr(Dwarf_Half attr) const;
+		dwarf::encap::attribute_map copy_attrs() const;
+		dwarf::spec::abstract_def& get_spec(root_die& r) const;
+	};
+}
+
+#endif
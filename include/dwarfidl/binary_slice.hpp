@@ -0,0 +1,163 @@
+/* Compact binary encoding of interface slices. */
+#ifndef DWARFIDL_BINARY_SLICE_HPP_
+#define DWARFIDL_BINARY_SLICE_HPP_
+
+#include <set>
+#include <string>
+#include <iostream>
+#include <cstdint>
+#include <boost/optional.hpp>
+#include <dwarfpp/lib.hpp>
+
+namespace dwarfidl
+{
+	using std::string;
+	using dwarf::core::iterator_base;
+	using dwarf::core::type_set;
+
+	/* A binary slice holds the same information that print_dies writes as
+	 * dwarfidl text, but laid out so that it can be used straight from an
+	 * mmap'd file. It is a header followed by five flat arrays:
+	 *
+	 * - DIE records, in preorder, linked by parent/first-child/next-sibling
+	 *   indices (so a record's index is also a valid ordering key);
+	 * - attribute records, each DIE owning a contiguous run;
+	 * - location list entries, each owning a contiguous run of ...
+	 * - ... location expression operations;
+	 * - a string table of NUL-terminated, deduplicated strings.
+	 *
+	 * References to DIEs that are inside the slice are stored as record
+	 * indices; references to anything else keep their original offset,
+	 * just as the textual form prints them as "@0x...".
+	 * Everything is in host byte order. */
+	namespace binslice
+	{
+		const char magic[8] = { 'D', 'W', 'I', 'D', 'L', 'S', 'L', '\0' };
+		const uint32_t version = 1;
+		const uint32_t no_index = ~(uint32_t)0;
+
+		struct header
+		{
+			char magic[8];
+			uint32_t version;
+			uint32_t ndies;
+			uint32_t nattrs;
+			uint32_t nloclists;
+			uint32_t nops;
+			uint32_t strtab_size;
+			uint64_t dies_off;
+			uint64_t attrs_off;
+			uint64_t loclists_off;
+			uint64_t ops_off;
+			uint64_t strtab_off;
+		};
+
+		struct die_record
+		{
+			uint64_t orig_offset;
+			uint32_t parent;       // no_index for toplevel records
+			uint32_t first_child;
+			uint32_t next_sibling;
+			uint32_t first_attr;
+			uint32_t name;         // strtab offset, or no_index if anonymous
+			uint16_t nattrs;
+			uint16_t tag;
+		};
+
+		enum attr_form : uint8_t
+		{
+			STRING,       // value is a strtab offset
+			FLAG,
+			UNSIGNED,
+			SIGNED,
+			ADDR,
+			REF_INTERNAL, // value is a die_record index
+			REF_EXTERNAL, // value is an offset in the originating root
+			LOCLIST       // value is (first loclist entry << 32) | count
+		};
+		enum attr_flags : uint8_t
+		{
+			REF_ABS = 1
+		};
+
+		struct attr_record
+		{
+			uint16_t attr;
+			uint8_t form;
+			uint8_t flags;
+			uint32_t reserved;
+			uint64_t value;
+		};
+
+		struct loclist_record
+		{
+			uint64_t lopc;
+			uint64_t hipc;
+			uint32_t first_op;
+			uint32_t nops;
+		};
+
+		struct op_record
+		{
+			uint64_t number;
+			uint64_t number2;
+			uint64_t offset;
+			uint32_t atom;
+			uint32_t reserved;
+		};
+	}
+
+	/* Write 'dies' (and everything beneath them that print_dies would print)
+	 * as a binary slice. If 'types' is given, type references are redirected
+	 * to the deduplicated representative, as print_dies does. */
+	void write_binary_slice(std::ostream& s, const std::set<iterator_base>& dies,
+		boost::optional<type_set&> types = boost::optional<type_set&>());
+
+	/* A read-only mapping of a binary slice file. When the file is opened,
+	 * the header, and every index, string offset and range in the records,
+	 * are checked to lie within the file; a bad file throws
+	 * std::runtime_error. */
+	class mapped_binary_slice
+	{
+		void *m_base;
+		size_t m_length;
+		int m_fd;
+	public:
+		explicit mapped_binary_slice(const string& path);
+		~mapped_binary_slice();
+		mapped_binary_slice(const mapped_binary_slice&) = delete;
+		mapped_binary_slice& operator=(const mapped_binary_slice&) = delete;
+
+		const binslice::header& hdr() const
+		{ return *reinterpret_cast<const binslice::header *>(m_base); }
+		const binslice::die_record *dies() const
+		{ return at<binslice::die_record>(hdr().dies_off); }
+		const binslice::attr_record *attrs() const
+		{ return at<binslice::attr_record>(hdr().attrs_off); }
+		const binslice::loclist_record *loclists() const
+		{ return at<binslice::loclist_record>(hdr().loclists_off); }
+		const binslice::op_record *ops() const
+		{ return at<binslice::op_record>(hdr().ops_off); }
+		const char *string_at(uint32_t off) const
+		{ return at<char>(hdr().strtab_off) + off; }
+		size_t length() const { return m_length; }
+	private:
+		template <typename T> const T *at(uint64_t off) const
+		{ return reinterpret_cast<const T *>(reinterpret_cast<const char *>(m_base) + off); }
+	};
+
+	/* Materialise a binary slice under 'parent', which must belong to an
+	 * in_memory_root_die. As with create_dies, if 'parent' is not within
+	 * a compile unit, a fresh one is created to hold the slice.
+	 * Returns the first DIE created. */
+	iterator_base load_binary_slice(const iterator_base& parent, const mapped_binary_slice& slice);
+	iterator_base load_binary_slice(const iterator_base& parent, const string& path);
+
+	/* Decode one attribute record. References to record n within the slice
+	 * become absolute references to offset 'internal_base + n' in 'r'. */
+	dwarf::encap::attribute_value decode_binary_slice_attr(const mapped_binary_slice& slice,
+		const binslice::attr_record& a, dwarf::core::root_die& r,
+		dwarf::lib::Dwarf_Off context_off, dwarf::lib::Dwarf_Off internal_base);
+}
+
+#endif
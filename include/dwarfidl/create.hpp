@@ -3,31 +3,100 @@
 #define DWARFIDL_CREATE_HPP_
 
 #include "dwarfidl/lang.hpp"
+#include "dwarfidl/arena_root.hpp"
+#include "dwarfidl/resolution_index.hpp"
+#include "dwarfidl/structural_index.hpp"
 #include <dwarfpp/lib.hpp>
+#include <memory>
 #include <vector>
 #include <map>
+#include <unordered_map>
 
 namespace dwarfidl
 {
 	using namespace dwarf;
 	using namespace dwarf::core;
 
-	iterator_base create_dies(antlr::tree::Tree *ast);
+	/* A reference to 'ident', as seen from the DIE at 'die', that
+	 * couldn't be resolved yet. */
+	struct deferred_ref
+	{
+		Dwarf_Off die;
+		Dwarf_Half attr;
+		string ident;
+	};
+
+	/* What we remember between DIEs while creating them. Inline DIEs,
+	 * like the (pointer_type ...) in "member p : (pointer_type ...)", are
+	 * hash-consed: one structurally identical to a DIE already in the same
+	 * CU is shared rather than created again. The key is the tag, the
+	 * attributes and the children's keys, with names resolved to offsets;
+	 * see structural_index. Keep one of these for as long as the DIEs it
+	 * has created stay put. */
+	struct creation_state
+	{
+		/* Where to look for inline DIEs to share. As with index, arena
+		 * roots have their own; for other roots, one is made for this
+		 * state unless this is set. */
+		structural_index *structure = nullptr;
+		std::unique_ptr<structural_index> own_structure;
+		/* Where to resolve names, if not scoped_resolve. Arena roots have
+		 * their own and it is used unless this is set. For other roots,
+		 * point this at one that lives as long as the root, and pass the
+		 * same state to each create_dies call. */
+		resolution_index *index = nullptr;
+		/* What create_dies_cached made from each snippet, by the parent's
+		 * CU offset and the snippet's text. */
+		std::unordered_map<string, iterator_base> snippets;
+		/* If set, and the root is an arena_root_die, a name that doesn't
+		 * resolve is recorded here and given a pending_ref, rather than
+		 * postponing its DIE. */
+		std::vector<deferred_ref> *deferred = nullptr;
+		/* If set, the offset of each inline DIE created (not shared) is
+		 * recorded here, in order. */
+		std::vector<Dwarf_Off> *inlined = nullptr;
+	};
+
+	/* Create the DIEs in a root of their own. create_dies works just as
+	 * well on an existing arena_root_die or in_memory_root_die. */
+	std::unique_ptr<arena_root_die> create_dies(antlr::tree::Tree *ast);
 	iterator_base create_dies(const iterator_base& parent, antlr::tree::Tree *ast);
+	iterator_base create_dies(const iterator_base& parent, antlr::tree::Tree *ast, creation_state& state);
 	iterator_base create_dies(const iterator_base& parent, const string& some_dwarfidl);
+	iterator_base create_dies(const iterator_base& parent, const string& some_dwarfidl, creation_state& state);
+	/* Like create_dies, but a snippet already created in the same CU with
+	 * this state is neither parsed nor created again; the DIE made the
+	 * first time is returned. */
+	iterator_base create_dies_cached(const iterator_base& parent, const string& some_dwarfidl, creation_state& state);
+	/* Like create_dies, for a parent in an arena_root_die, but with the
+	 * text split between threads at top-level DIEs (nthreads 0 means one
+	 * per core). Each thread parses its part and creates it in a root of
+	 * its own, deferring names it can't resolve there; the parts are then
+	 * moved into parent's root in order and the deferred names resolved
+	 * there. Inline DIEs that came out the same in several parts, or the
+	 * same as one already in the CU, are then shared as create_dies
+	 * would have, and the copies dropped. Throws std::runtime_error for a
+	 * name that still won't resolve. */
+	iterator_base create_dies_concurrently(const iterator_base& parent, const string& some_dwarfidl,
+		unsigned nthreads = 0);
 	iterator_base create_one_die(const iterator_base& parent, antlr::tree::Tree *ast, 
 								 std::vector<std::pair<const iterator_base&, antlr::tree::Tree*> > &postpone,
 								 const std::map<antlr::tree::Tree *, iterator_base>& nested
-								 = std::map<antlr::tree::Tree *, iterator_base>());
+								 = std::map<antlr::tree::Tree *, iterator_base>(),
+								 creation_state *state = nullptr);
 	 iterator_base create_one_die_with_children(const iterator_base& parent, antlr::tree::Tree *ast,
-												std::vector<std::pair<const iterator_base&, antlr::tree::Tree*> > &postpone);
+												std::vector<std::pair<const iterator_base&, antlr::tree::Tree*> > &postpone,
+												creation_state *state = nullptr);
+	 /* Without a state, this always creates. */
 	 iterator_base find_or_create_die(const iterator_base& parent, antlr::tree::Tree *ast,
-									  std::vector<std::pair<const iterator_base&, antlr::tree::Tree*> > &postpone);
+									  std::vector<std::pair<const iterator_base&, antlr::tree::Tree*> > &postpone,
+									  creation_state *state = nullptr);
 
 	encap::attribute_value make_attribute_value(antlr::tree::Tree *d, 
 		const iterator_base& context, 
 		Dwarf_Half attr,
-		const std::map<antlr::tree::Tree *, iterator_base>& nested);
+		const std::map<antlr::tree::Tree *, iterator_base>& nested,
+		creation_state *state = nullptr);
 }
 
 
@@ -171,6 +171,10 @@ public:
 	cxx_target(const spec::abstract_def& s)
 	 : cxx_generator_from_dwarf(s) {}
 
+	/* Reuse another compiler's base types rather than discovering them
+	 * again, which means running the compiler. */
+	cxx_target(const cxx_compiler& compiler) : cxx_compiler(compiler) {}
+
 	cxx_target() {}
 	
 	// implementation of pure virtual function in cxx_generator_from_dwarf
@@ -4,6 +4,7 @@
 #include <set>
 #include <utility>
 #include <map>
+#include <iostream>
 
 namespace dwarf { namespace tool { 
 
@@ -80,6 +81,17 @@ public:
 	out(out),
 	m_to_output(to_output)
 	{}
+	dependency_ordering_cxx_target(
+		const string& untyped_argument_typename,
+		srk31::indenting_ostream& out,
+		set<pair<emit_kind, iterator_base>, compare_with_type_equality > const& to_output,
+		cxx_compiler const& compiler
+	)
+	 : cxx_target(compiler),
+	m_untyped_argument_typename(untyped_argument_typename), 
+	out(out),
+	m_to_output(to_output)
+	{}
 	map<pair<emit_kind, iterator_base>, string, compare_with_type_equality > const&
 	output_fragments() const { return m_output_fragments; }
 
@@ -87,7 +99,8 @@ public:
 	opt<string> maybe_get_name(iterator_base i, enum ref_kind k);
 
 	void transitively_close();
-	void write_ordered_output();
+	void write_ordered_output(std::ostream& out);
+	void write_ordered_output() { write_ordered_output(std::cout); }
 };
 
 /* close namespaces */
@@ -2,20 +2,127 @@
 #define DWARFIDL_DWARF_INTERFACE_WALK_HPP_
 
 #include <set>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
 #include <functional>
 #include <dwarfpp/lib.hpp>
 
 namespace dwarf { namespace tool {
 
 using std::set;
+using std::string;
+using std::vector;
 using dwarf::core::root_die;
 using dwarf::core::iterator_base;
 using dwarf::core::type_set;
 
+/* By default we consider only CU grandchildren. With walk_nested_scopes,
+ * we also consider everything declared inside namespaces, classes,
+ * structs and unions (but not inside subprograms). */
 void 
 gather_interface_dies(root_die& root, 
 	set<iterator_base>& out, type_set& dedup_types_out, 
-	std::function<bool(const iterator_base&)> pred);
+	std::function<bool(const iterator_base&)> pred,
+	bool walk_nested_scopes = false);
+
+/* As above, but pred also gets the DIE's fully qualified name parts, as
+ * fq_name_parts_for would give, so that it can select by qualified name.
+ * The parts come from the walk, so no parents are visited. */
+typedef std::function<bool(const iterator_base&, const vector<string>&)> scoped_predicate;
+void
+gather_scoped_interface_dies(root_die& root,
+	set<iterator_base>& out, type_set& dedup_types_out,
+	scoped_predicate pred,
+	bool walk_nested_scopes = false);
+
+class gather_cache;
+namespace detail
+{
+	void gather_cached(root_die& root, set<iterator_base>& out, type_set& dedup_types_out,
+		const scoped_predicate& pred, bool want_parts, gather_cache& cache,
+		bool walk_nested_scopes);
+}
+
+/* Incremental gathering, for re-running on rebuilds of a binary where
+ * only a few CUs changed. The cache holds each CU's slice, keyed by a hash
+ * of the CU's DIEs; CUs whose hash we have seen are replayed from the
+ * cache rather than walked. Save it and load it to carry it between runs.
+ * pred_key should identify the predicate, e.g. the selection rules, since
+ * slices made with one predicate are no use with another; the cache also
+ * remembers whether it was made walking nested scopes. The hash is of the
+ * CU's .debug_info bytes where the root has them, otherwise of its DIEs. */
+class gather_cache
+{
+public:
+	struct cu_slice
+	{
+		/* Offsets relative to the CU. The types are all those reached from
+		 * the CU's elements, so that replaying them repairs the dedup set. */
+		vector<dwarf::lib::Dwarf_Off> elements;
+		vector<dwarf::lib::Dwarf_Off> types;
+	};
+private:
+	string m_pred_key;
+	/* Part of the key too, but only known when we gather. */
+	bool m_walk_nested_scopes = false;
+	std::unordered_map<uint64_t, cu_slice> m_slices;
+	unsigned m_cus_reused = 0;
+	unsigned m_cus_walked = 0;
+	friend void detail::gather_cached(root_die&, set<iterator_base>&, type_set&,
+		const scoped_predicate&, bool, gather_cache&, bool);
+public:
+	explicit gather_cache(const string& pred_key = string()) : m_pred_key(pred_key) {}
+	const cu_slice *find(uint64_t cu_hash) const;
+	size_t size() const { return m_slices.size(); }
+	/* How the last gather went. */
+	unsigned cus_reused() const { return m_cus_reused; }
+	unsigned cus_walked() const { return m_cus_walked; }
+
+	void save(std::ostream& s) const;
+	/* False, leaving the cache empty, if s doesn't hold a cache made
+	 * with our pred_key. */
+	bool load(std::istream& s);
+};
+
+uint64_t cu_content_hash(const iterator_base& cu);
+
+void 
+gather_interface_dies(root_die& root, 
+	set<iterator_base>& out, type_set& dedup_types_out, 
+	std::function<bool(const iterator_base&)> pred,
+	gather_cache& cache,
+	bool walk_nested_scopes = false);
+
+void
+gather_scoped_interface_dies(root_die& root,
+	set<iterator_base>& out, type_set& dedup_types_out,
+	scoped_predicate pred,
+	gather_cache& cache,
+	bool walk_nested_scopes = false);
+
+/* Call f on each DIE that gather_interface_dies would consider with
+ * walk_nested_scopes, in preorder, along with its fully qualified name
+ * parts (as fq_name_parts_for would give, but without walking parents). */
+void
+walk_scopes(root_die& root,
+	std::function<void(const iterator_base&, const vector<string>&)> f);
+
+/* Fully qualified names, joined with "::", of everything walk_scopes
+ * visits, both ways round. */
+class scope_index
+{
+	std::unordered_map<string, vector<iterator_base> > m_by_name;
+	std::unordered_map<dwarf::lib::Dwarf_Off, string> m_name_of;
+public:
+	explicit scope_index(root_die& root);
+
+	/* Empty if none. Several DIEs can share a name, e.g. one per CU. */
+	const vector<iterator_base>& find(const string& fq_name) const;
+	/* Falls back to fq_name_parts_for for DIEs we didn't index. */
+	string fq_name_of(const iterator_base& i) const;
+};
 
 } }
 
@@ -0,0 +1,174 @@
+/* Compiling and evaluating dwarfidl footprint expressions. */
+#ifndef DWARFIDL_FOOTPRINT_HPP_
+#define DWARFIDL_FOOTPRINT_HPP_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <stdexcept>
+#include <cstdint>
+#include <boost/icl/interval_map.hpp>
+#include <dwarfpp/lib.hpp>
+#include "dwarfidl/lang.hpp"
+
+namespace dwarfidl
+{
+namespace footprint
+{
+	using std::string;
+	using std::vector;
+	using dwarf::core::iterator_base;
+	using dwarf::core::iterator_df;
+	using dwarf::core::subprogram_die;
+
+	/* A footprint says which memory a call may read or write, given its
+	 * arguments. Clauses look like
+	 *
+	 *     footprint = { r: iov[0..iovcnt]; w: v.iov_base{0..v.iov_len} for v in iov[0..iovcnt]; }
+	 *
+	 * where, for p a pointer to T,
+	 *   p[i]       is the object p[i], i.e. sizeof(T) bytes at p + i * sizeof(T);
+	 *   p[a..b]    is the objects p[a] up to but not including p[b];
+	 *   p{a..b}    is the bytes p + a up to but not including p + b;
+	 *   p[{a..b}]  is (*p){a..b};
+	 *   *p, x.m    are objects as in C, and '.' also looks through a pointer;
+	 *   e for v in n        is the union of e for v = 0 .. n - 1;
+	 *   e for v in p[a..b]  is the union of e with v bound to each object;
+	 *   e1, e2 and e1 # e2  are both the union of e1 and e2.
+	 * Objects used as values are read from memory. T of void or unknown size
+	 * counts as one byte, as in GNU C pointer arithmetic. Arithmetic is on
+	 * signed 64-bit integers. Functions defined by footprint_function (or
+	 * 'fun') are inlined where applied.
+	 *
+	 * A loop whose body's range moves by a fixed stride no greater than its
+	 * length, such as 'p[i] for i in n' or 'buf{4*i..4*i+8} for i in n',
+	 * covers one contiguous range; that is computed directly rather than
+	 * by iterating. */
+	enum direction : uint8_t
+	{
+		READ = 1,
+		WRITE = 2,
+		READ_WRITE = 3
+	};
+	std::ostream& operator<<(std::ostream& s, direction d);
+
+	struct access
+	{
+		uint64_t base;
+		uint64_t length;
+		direction dir;
+	};
+
+	/* Accesses coalesced into disjoint, maximal ranges of bytes, each mapped
+	 * to the directions (as a mask) of the accesses that cover it. */
+	typedef boost::icl::interval_map<uint64_t, uint8_t, boost::icl::partial_absorber,
+		ICL_COMPARE_INSTANCE(ICL_COMPARE_DEFAULT, uint64_t), boost::icl::inplace_bit_add> footprint_set;
+
+	/* The bytecode is for a register machine. Operands a, b and c are
+	 * register numbers unless noted. */
+	enum opcode : uint8_t
+	{
+		OP_HALT,
+		OP_LOADI,  // a = imm
+		OP_ARG,    // a = argument imm, truncated to c bytes (if c < 8)
+		OP_MOV,    // a = b
+		OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD,
+		OP_SHL, OP_SHR, OP_BITAND, OP_BITOR, OP_BITXOR,
+		OP_EQ, OP_NE, OP_LT, OP_GT, OP_LTE, OP_GTE, // a = b op c
+		OP_ADDI,   // a = b + imm
+		OP_MULI,   // a = b * imm
+		OP_NEG, OP_BITNOT, OP_LNOT, OP_BOOL,       // a = op b
+		OP_LOAD,   // a = the c bytes at address b + imm
+		OP_JMP,    // go to imm
+		OP_JZ,     // if a == 0, go to imm
+		OP_EMIT,   // access of r[b] bytes at r[a]
+		OP_EMITI   // access of imm bytes at r[a]
+	};
+	enum insn_flags : uint8_t
+	{
+		SIGNED = 1 // for OP_ARG and OP_LOAD: sign-extend
+		/* For OP_EMIT and OP_EMITI, flags holds the direction. */
+	};
+	struct insn
+	{
+		uint8_t op;
+		uint8_t a;
+		uint8_t b;
+		uint8_t c;
+		uint8_t flags;
+		uint8_t reserved[3];
+		int64_t imm;
+	};
+	const char *opcode_name(opcode op);
+
+	struct program
+	{
+		string name;
+		vector<string> arg_names;
+		vector<insn> code;
+		unsigned nregs;
+	};
+	std::ostream& operator<<(std::ostream& s, const program& p); // disassembly
+
+	class compile_error : public std::runtime_error
+	{
+	public:
+		explicit compile_error(const string& what) : std::runtime_error(what) {}
+	};
+
+	class compiler
+	{
+		std::map<string, antlr::tree::Tree *> m_functions;
+	public:
+		/* Remember the footprint_function definitions among the toplevel
+		 * nodes of a parsed dwarfidl file. The tree must outlive us. */
+		void add_functions(antlr::tree::Tree *toplevel);
+		void add_function(antlr::tree::Tree *fp_fun);
+
+		/* Compile an FP_CLAUSES tree for 'subprogram', whose formal
+		 * parameters give the argument names and types. */
+		program compile(antlr::tree::Tree *clauses, iterator_df<subprogram_die> subprogram) const;
+
+		/* Compile the footprint of every subprogram in a parsed dwarfidl file
+		 * that has one, finding each subprogram's DIE by name from 'scope'
+		 * (typically the CU that create_dies put them in). Also calls
+		 * add_functions. */
+		std::map<string, program> compile_all(antlr::tree::Tree *toplevel, const iterator_base& scope);
+
+		const std::map<string, antlr::tree::Tree *>& functions() const { return m_functions; }
+	};
+
+	/* Reads 'len' bytes at 'addr' in the traced process; false if it can't. */
+	typedef bool (*read_fn)(void *ctx, uint64_t addr, void *buf, size_t len);
+
+	enum status
+	{
+		OK,
+		READ_FAILED,
+		DIVIDE_BY_ZERO,
+		STEP_LIMIT_EXCEEDED
+	};
+	const char *status_name(status s);
+
+	/* Run 'p' with one argument per p.arg_names, appending its accesses to
+	 * 'out'. Backward jumps count against 'step_limit', so a footprint over
+	 * a garbage length fails rather than running for ever. */
+	status evaluate(const program& p, const uint64_t *args, read_fn read, void *read_ctx,
+		vector<access>& out, uint64_t step_limit = 1u << 24);
+	/* The same, but accumulating into a footprint_set. */
+	status evaluate(const program& p, const uint64_t *args, read_fn read, void *read_ctx,
+		footprint_set& out, uint64_t step_limit = 1u << 24);
+
+	/* Evaluate 'p' over 'ntuples' argument tuples stored by column, so that
+	 * argument j of tuple k is columns[j][k], leaving tuple k's footprint in
+	 * out[k] and its status in statuses[k]. Tuples are shared among
+	 * 'nthreads' threads (0 for one per hardware thread), so with more than
+	 * one, 'read' must be safe to call concurrently. */
+	void evaluate_batch(const program& p, const uint64_t *const *columns, size_t ntuples,
+		read_fn read, void *read_ctx, vector<footprint_set>& out, vector<status>& statuses,
+		unsigned nthreads = 0, uint64_t step_limit = 1u << 24);
+}
+}
+
+#endif
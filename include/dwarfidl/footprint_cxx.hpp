@@ -0,0 +1,34 @@
+/* Generating C++ from compiled footprints. */
+#ifndef DWARFIDL_FOOTPRINT_CXX_HPP_
+#define DWARFIDL_FOOTPRINT_CXX_HPP_
+
+#include <iostream>
+#include <map>
+#include <string>
+#include "dwarfidl/footprint.hpp"
+
+namespace dwarfidl
+{
+namespace footprint
+{
+	/* Each footprint becomes a function template
+	 *
+	 *     template <typename Read, typename Sink>
+	 *     int footprint_NAME(const uint64_t *args, Read read, Sink sink,
+	 *         uint64_t step_limit = 1u << 24);
+	 *
+	 * behaving like evaluate(), where read(addr, buf, len) returns false if
+	 * it can't, sink(base, length, dir) takes each access, and the return
+	 * value is a status. Member offsets and sizes are baked in from the DIEs
+	 * the footprint was compiled against, so the output needs no headers
+	 * beyond those in the prelude. */
+	void write_cxx_prelude(std::ostream& out);
+	void write_cxx(std::ostream& out, const program& p, const std::string& function_name);
+
+	/* The prelude, then one function per program, named footprint_ plus
+	 * the map key. */
+	void write_cxx(std::ostream& out, const std::map<std::string, program>& programs);
+}
+}
+
+#endif
@@ -0,0 +1,25 @@
+/* Tag, attribute and opcode names as dwarfidl spells them. */
+#ifndef DWARFIDL_KEYWORDS_HPP_
+#define DWARFIDL_KEYWORDS_HPP_
+
+#include <dwarfpp/lib.hpp>
+
+namespace dwarfidl
+{
+	using dwarf::lib::Dwarf_Half;
+
+	/* The name without its DW_TAG_, DW_AT_ or DW_OP_ prefix, e.g.
+	 * "structure_type", or null if the code is unknown. The strings are
+	 * static, so nothing is allocated. */
+	const char *keyword_for_tag(Dwarf_Half tag);
+	const char *keyword_for_attr(Dwarf_Half attr);
+	const char *keyword_for_op(unsigned op);
+
+	/* The reverse, ignoring case (the parser's imaginary tokens come out
+	 * as "NAME" and "TYPE"); 0 if the keyword is unknown. */
+	Dwarf_Half tag_for_keyword(const char *keyword);
+	Dwarf_Half attr_for_keyword(const char *keyword);
+	unsigned op_for_keyword(const char *keyword);
+}
+
+#endif
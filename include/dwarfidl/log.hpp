@@ -0,0 +1,42 @@
+/* Leveled diagnostic logging for libdwarfidl. */
+#ifndef DWARFIDL_LOG_HPP_
+#define DWARFIDL_LOG_HPP_
+
+#include <iostream>
+#include <atomic>
+
+/* Messages above this level are compiled out entirely. Level 0 is for
+ * warnings, which are always printed; higher levels are progressively
+ * chattier, and the runtime level comes from DWARFIDL_DEBUG_LEVEL. */
+#ifndef DWARFIDL_LOG_MAX_LEVEL
+#define DWARFIDL_LOG_MAX_LEVEL 3
+#endif
+
+namespace dwarfidl
+{
+	namespace detail
+	{
+		/* -1 until DWARFIDL_DEBUG_LEVEL has been read. Atomic because
+		 * create_dies_concurrently's threads log too; any of them may be
+		 * the first to read it. */
+		extern std::atomic<int> log_level;
+		int init_log_level();
+	}
+	inline int log_level()
+	{
+		int l = detail::log_level.load(std::memory_order_relaxed);
+		return (l >= 0) ? l : detail::init_log_level();
+	}
+	void set_log_level(int level);
+}
+
+#define DWARFIDL_LOG_ENABLED(lvl) \
+	((lvl) <= DWARFIDL_LOG_MAX_LEVEL && (lvl) <= ::dwarfidl::log_level())
+
+/* The message is a stream expression, e.g.
+ *     DWARFIDL_LOG(2, "Created " << d.summary() << std::endl);
+ * and is not evaluated at all unless the level is enabled. */
+#define DWARFIDL_LOG(lvl, msg) \
+	do { if (DWARFIDL_LOG_ENABLED(lvl)) { std::cerr << msg; } } while (0)
+
+#endif
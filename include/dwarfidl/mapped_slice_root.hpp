@@ -0,0 +1,84 @@
+/* A read-only root_die view over a mapped binary slice. */
+#ifndef DWARFIDL_MAPPED_SLICE_ROOT_HPP_
+#define DWARFIDL_MAPPED_SLICE_ROOT_HPP_
+
+#include <memory>
+#include <dwarfpp/lib.hpp>
+#include "dwarfidl/binary_slice.hpp"
+
+namespace dwarfidl
+{
+	using dwarf::core::root_die;
+	using dwarf::core::abstract_die;
+	using dwarf::core::basic_die;
+	using dwarf::lib::Dwarf_Off;
+	using dwarf::lib::Dwarf_Half;
+	using dwarf::spec::opt;
+
+	/* Unlike load_binary_slice, this copies nothing out of the mapping.
+	 * Tags, names and attributes are decoded from the records each time
+	 * they are asked for, and DIEs are never sticky, so the only DIE
+	 * objects are the transient payloads that libdwarfpp's iterators
+	 * hold while in use. Many processes can then share one slice through
+	 * the page cache.
+	 *
+	 * Offsets are synthetic: the root is 0 and records follow in preorder.
+	 * If the slice's toplevel records are not compile units (as with a
+	 * gathered interface slice), a compile unit with no attributes is made
+	 * up at offset 1 to hold them, so that walkers such as
+	 * gather_interface_dies see the usual root/CU/grandchild shape.
+	 * References to DIEs outside the slice carry the original root's
+	 * offsets, which mean nothing here, so those attributes are absent. */
+	class mapped_slice_root_die : public root_die
+	{
+		std::shared_ptr<const mapped_binary_slice> m_slice;
+		bool m_synthetic_cu;
+		Dwarf_Off m_index_base;
+	public:
+		explicit mapped_slice_root_die(const string& path);
+		explicit mapped_slice_root_die(std::shared_ptr<const mapped_binary_slice> slice);
+
+		const mapped_binary_slice& slice() const { return *m_slice; }
+		bool has_synthetic_cu() const { return m_synthetic_cu; }
+		Dwarf_Off synthetic_cu_offset() const { return 1; }
+		Dwarf_Off offset_of_index(uint32_t idx) const { return m_index_base + idx; }
+		opt<uint32_t> index_of_offset(Dwarf_Off off) const
+		{
+			if (off < m_index_base || off - m_index_base >= m_slice->hdr().ndies)
+			{ return opt<uint32_t>(); }
+			return static_cast<uint32_t>(off - m_index_base);
+		}
+
+		/* We are read-only. */
+		bool is_sticky(const abstract_die& d) { return false; }
+		iterator_base make_new(const iterator_base& parent, Dwarf_Half tag);
+
+	protected:
+		bool move_to_parent(iterator_base& it);
+		bool move_to_first_child(iterator_base& it);
+		bool move_to_next_sibling(iterator_base& it);
+		iterator_base find_downwards(Dwarf_Off off);
+		basic_die *make_payload(const iterator_base& it);
+	};
+
+	/* The abstract_die for one record (or the synthetic CU). It is two
+	 * words and owns nothing. */
+	struct mapped_slice_die : public virtual abstract_die
+	{
+		const mapped_slice_root_die *p_root;
+		uint32_t idx; // binslice::no_index for the synthetic CU
+
+		mapped_slice_die(const mapped_slice_root_die& r, uint32_t idx)
+		 : p_root(&r), idx(idx) {}
+
+		Dwarf_Off get_offset() const;
+		Dwarf_Half get_tag() const;
+		opt<string> get_name() const;
+		Dwarf_Off get_enclosing_cu_offset() const;
+		bool has_attr(Dwarf_Half attr) const;
+		dwarf::encap::attribute_map copy_attrs() const;
+		dwarf::spec::abstract_def& get_spec(root_die& r) const;
+	};
+}
+
+#endif
@@ -0,0 +1,106 @@
+/* Merging a dwarfidl overlay into existing DIEs. */
+#ifndef DWARFIDL_MERGE_HPP_
+#define DWARFIDL_MERGE_HPP_
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <dwarfpp/lib.hpp>
+#include "dwarfidl/resolution_index.hpp"
+
+namespace dwarfidl
+{
+	using std::string;
+	using dwarf::core::iterator_base;
+	using dwarf::core::root_die;
+	using dwarf::lib::Dwarf_Half;
+	using dwarf::lib::Dwarf_Off;
+
+	struct merge_conflict
+	{
+		/* Where, e.g. "structure_type point.x". */
+		string where;
+		/* The attribute concerned, or 0. */
+		Dwarf_Half attr;
+		string detail;
+		/* The existing DIE, or END. */
+		iterator_base target;
+		/* Whether the overlay's value went in anyway. */
+		bool overridden;
+	};
+	std::ostream& operator<<(std::ostream& s, const merge_conflict& c);
+
+	struct merge_report
+	{
+		unsigned dies_matched = 0;
+		unsigned dies_added = 0;
+		unsigned attrs_added = 0;
+		unsigned attrs_overridden = 0;
+		/* DIEs read from the file, copied into memory to be merged into. */
+		unsigned dies_copied = 0;
+		std::vector<merge_conflict> conflicts;
+	};
+
+	/* Where the merge looks for the DIEs an overlay describes: the
+	 * children of every CU, by tag and name, and the children of each DIE
+	 * the overlay reaches into. Each table is built the first time it is
+	 * needed and kept up to date with what merging adds, so one index can
+	 * serve several overlays on the same root. Unnamed children are keyed
+	 * by their position among their unnamed siblings of the same tag.
+	 * Names are resolved with an arena root's own resolution index, so it
+	 * stays up to date too, and otherwise with one of the merge_index's. */
+	class merge_index
+	{
+		typedef std::unordered_map<string, std::vector<iterator_base> > table;
+		root_die& m_root;
+		bool m_toplevel_built;
+		table m_toplevel;
+		std::unordered_map<Dwarf_Off, table> m_children;
+		std::unique_ptr<resolution_index> m_own_resolution;
+		resolution_index *m_resolution;
+		iterator_base m_additions_cu;
+	public:
+		explicit merge_index(root_die& r);
+
+		static string key(Dwarf_Half tag, const string& name_or_position);
+		const std::vector<iterator_base>& toplevel(const string& key);
+		const std::vector<iterator_base>& children(const iterator_base& parent, const string& key);
+		/* Record a DIE that merging created, once it has its name. */
+		void added(const iterator_base& created);
+		/* Record that a top-level DIE was copied, and is to be found in
+		 * place of the original from now on. */
+		void replaced(const iterator_base& original, const iterator_base& copy);
+
+		root_die& root() { return m_root; }
+		resolution_index& resolution() { return *m_resolution; }
+		/* Where top-level additions go; made when first asked for. */
+		iterator_base additions_cu();
+	};
+
+	/* Merge the DIEs described by 'overlay' into target's root, which must
+	 * be an in_memory_root_die or an arena_root_die. Each top-level overlay
+	 * DIE is matched by tag and name against the children of the CUs, and
+	 * its children against the matched DIE's children likewise. A DIE with
+	 * no match is added; one that matches several definitions that differ
+	 * in structure is reported and left alone. Attributes the matched DIE
+	 * lacks are added; ones whose values differ are reported as conflicts
+	 * and overwritten if override_existing. Names in the overlay are
+	 * resolved in the target, as seen from the DIE being merged into.
+	 *
+	 * Everything is matched before anything is changed. DIEs an
+	 * in_memory_root_die reads from its file can't be written, so a
+	 * top-level DIE with one that would be is first copied, children and
+	 * all, into the CU that additions go in, and merged into there; the
+	 * file's own DIEs still refer to the original.
+	 *
+	 * Apart from building the top-level table once per index, the work is
+	 * in proportion to the overlay and the children of what it matches. */
+	merge_report merge_dwarfidl(merge_index& index, const string& overlay,
+		bool override_existing = true);
+	merge_report merge_dwarfidl(root_die& target, const string& overlay,
+		bool override_existing = true);
+}
+
+#endif
@@ -0,0 +1,94 @@
+/* Phase timers and event counters for libdwarfidl. */
+#ifndef DWARFIDL_METRICS_HPP_
+#define DWARFIDL_METRICS_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+namespace dwarfidl
+{
+namespace metrics
+{
+	/* These are always compiled in. Counting is a relaxed atomic add, and
+	 * hot loops accumulate locally and add once, so there is no need for a
+	 * debug build to get the numbers. They can be read with get(), or dumped
+	 * as JSON at exit by setting DWARFIDL_METRICS to a filename ("-" means
+	 * stderr). */
+	enum phase
+	{
+		PARSE,
+		CREATE,
+		GATHER,
+		CLOSE,
+		ORDER,
+		PRINT,
+		NPHASES
+	};
+	enum counter
+	{
+		DIES_VISITED,
+		SCOPED_RESOLVE_CALLS,
+		POSTPONED_PASSES,
+		FRAGMENTS_GENERATED,
+		CONSTRAINT_SCAN_ITERATIONS,
+		BYTES_EMITTED,
+		INLINE_DIES_SHARED,
+		SNIPPET_CACHE_HITS,
+		NCOUNTERS
+	};
+	const char *phase_name(phase p);
+	const char *counter_name(counter c);
+
+	struct snapshot
+	{
+		uint64_t phase_calls[NPHASES];
+		uint64_t phase_nanoseconds[NPHASES];
+		uint64_t counters[NCOUNTERS];
+	};
+	snapshot get();
+	void reset();
+	void dump_json(std::ostream& s);
+	void dump_json(std::ostream& s, const snapshot& snap);
+
+	namespace detail
+	{
+		extern std::atomic<uint64_t> phase_calls[NPHASES];
+		extern std::atomic<uint64_t> phase_nanoseconds[NPHASES];
+		extern std::atomic<uint64_t> counters[NCOUNTERS];
+		/* Phases nest (create_dies calls itself, print recurses), so only
+		 * the outermost timer of each phase on a thread adds to the total. */
+		extern thread_local unsigned phase_depth[NPHASES];
+	}
+
+	inline void count(counter c, uint64_t n = 1)
+	{
+		detail::counters[c].fetch_add(n, std::memory_order_relaxed);
+	}
+
+	class phase_timer
+	{
+		phase m_phase;
+		std::chrono::steady_clock::time_point m_start;
+	public:
+		explicit phase_timer(phase p) : m_phase(p)
+		{
+			if (detail::phase_depth[p]++ == 0) m_start = std::chrono::steady_clock::now();
+		}
+		~phase_timer()
+		{
+			if (--detail::phase_depth[m_phase] != 0) return;
+			auto elapsed = std::chrono::steady_clock::now() - m_start;
+			detail::phase_calls[m_phase].fetch_add(1, std::memory_order_relaxed);
+			detail::phase_nanoseconds[m_phase].fetch_add(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+				std::memory_order_relaxed);
+		}
+		phase_timer(const phase_timer&) = delete;
+		phase_timer& operator=(const phase_timer&) = delete;
+	};
+}
+}
+
+#endif
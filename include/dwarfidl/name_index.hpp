@@ -0,0 +1,40 @@
+/* Indexing the names declared at the top level of a root. */
+#ifndef DWARFIDL_NAME_INDEX_HPP_
+#define DWARFIDL_NAME_INDEX_HPP_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <dwarfpp/lib.hpp>
+
+namespace dwarfidl
+{
+	using std::string;
+	using dwarf::core::iterator_base;
+	using dwarf::core::root_die;
+
+	/* Every named, visible child of every CU, i.e. what C code in any of
+	 * the CUs could see at file scope, found by name in constant time.
+	 * Subprograms and variables are visible only if external; everything
+	 * else (types, typedefs, enumerators...) is. Built in one pass, so it
+	 * won't see DIEs created afterwards unless they are added. */
+	class toplevel_name_index
+	{
+		std::unordered_map<string, std::vector<iterator_base> > m_by_name;
+	public:
+		explicit toplevel_name_index(root_die& r);
+
+		/* Index i, a child of a CU, if it is named and visible. */
+		void add(const iterator_base& i);
+
+		/* Like root_die::find_visible_grandchild_named: the first match
+		 * in DIE order, or END. */
+		iterator_base find_visible_grandchild_named(const string& name) const;
+		/* All matches, in DIE order; empty if none. */
+		const std::vector<iterator_base>& visible_grandchildren_named(const string& name) const;
+
+		size_t size() const { return m_by_name.size(); }
+	};
+}
+
+#endif
@@ -17,6 +17,7 @@
 #include <srk31/algorithm.hpp>
 #include <srk31/indenting_ostream.hpp>
 #include <dwarfpp/lib.hpp>
+#include "dwarfidl/metrics.hpp"
 
 namespace dwarf {
 namespace tool {
@@ -125,6 +126,7 @@ print(
 	indenting_ostream& out,
 	root_die& r)
 {
+	dwarfidl::metrics::phase_timer timer(dwarfidl::metrics::PRINT);
 	print<0>(out, r.begin());
 }
 
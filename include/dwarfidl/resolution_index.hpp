@@ -0,0 +1,65 @@
+/* Resolving names in a root without walking its scopes each time. */
+#ifndef DWARFIDL_RESOLUTION_INDEX_HPP_
+#define DWARFIDL_RESOLUTION_INDEX_HPP_
+
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <dwarfpp/lib.hpp>
+#include "dwarfidl/name_index.hpp"
+
+namespace dwarfidl
+{
+	using std::string;
+	using dwarf::core::iterator_base;
+	using dwarf::core::root_die;
+	using dwarf::lib::Dwarf_Off;
+	class arena_root_die;
+
+	/* Answers what scoped_resolve would for a single name: the first
+	 * child so named of the innermost enclosing scope that has one, or
+	 * failing that a visible grandchild of the root. Each scope's children
+	 * are indexed the first time a lookup passes through it, and the
+	 * visible grandchildren the first time one reaches the root, so a
+	 * lookup costs the depth of its context once those are done.
+	 *
+	 * DIEs created afterwards must be passed to add(), as create_dies
+	 * does; anything else added to the root behind the index's back
+	 * won't be found. Keep one for as long as the root.
+	 *
+	 * Scopes are keyed on interned names, compared by pointer. An arena
+	 * root's names are interned already, so its DIEs' names are used as
+	 * they are, without copying; for other roots the index keeps its own
+	 * copy of each distinct name. */
+	class resolution_index
+	{
+		typedef std::unordered_map<const char *, iterator_base> scope_names;
+		root_die& m_root;
+		const arena_root_die *m_arena;
+		std::unordered_set<string> m_names;
+		std::unordered_map<Dwarf_Off, scope_names> m_children;
+		std::unique_ptr<toplevel_name_index> m_visible;
+
+		scope_names& children_of(const iterator_base& scope);
+		/* The interned copy of name, or null if no DIE we've seen has it. */
+		const char *key_for(const string& name) const;
+		const char *intern_name_of(const iterator_base& i);
+	public:
+		explicit resolution_index(root_die& r) : m_root(r), m_arena(nullptr) {}
+		explicit resolution_index(arena_root_die& r);
+
+		iterator_base resolve(const iterator_base& context, const string& name);
+		/* Tell the index about a newly created DIE, once it has its name. */
+		void add(const iterator_base& created);
+		/* Drop what we know of scope's children, e.g. after many were
+		 * added at once; it is indexed again when next needed. */
+		void forget(const iterator_base& scope);
+		/* Drop everything, e.g. after the DIEs were renumbered. */
+		void clear() { m_children.clear(); m_visible.reset(); }
+
+		size_t nscopes() const { return m_children.size(); }
+	};
+}
+
+#endif
@@ -0,0 +1,91 @@
+/* Selecting interface elements by name, pattern, tag and visibility. */
+#ifndef DWARFIDL_SELECTION_HPP_
+#define DWARFIDL_SELECTION_HPP_
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <unordered_set>
+#include <boost/regex.hpp>
+#include <dwarfpp/lib.hpp>
+
+namespace dwarf { namespace tool { class scope_index; } }
+
+namespace dwarfidl
+{
+	using std::string;
+	using dwarf::core::iterator_base;
+
+	/* A predicate for gather_interface_dies, built from rules such as
+	 *
+	 *     fopen               the element named exactly "fopen"
+	 *     glob:str*           names matching a shell glob (*, ?, [...], [!...])
+	 *     re:mem(cpy|set)     names matching a regular expression (Perl syntax)
+	 *     tag:variable        consider variables (by default, only subprograms)
+	 *     visibility:any      don't insist on DW_VIS_exported
+	 *
+	 * A name, glob or regex containing "::" matches against the qualified
+	 * name instead, e.g. "ns::f" or "glob:ns::*". Qualified names are
+	 * given by gather_scoped_interface_dies; otherwise we look them up in
+	 * the scope index, if we have one, or work them out.
+	 *
+	 * Exact names go in a hash set; all globs and regexes are compiled
+	 * into one combined regex, so the cost per DIE doesn't grow with the
+	 * number of rules. A regex that refers back to its own groups, as
+	 * with \1 or \k<name>, would refer to the wrong ones there, so it is
+	 * matched on its own. Variables are selected only if they have
+	 * static storage. */
+	class selection
+	{
+		/* Unqualified rules, then qualified ones. */
+		struct name_rules
+		{
+			std::unordered_set<string> names;
+			std::vector<string> patterns; // as regexes
+			/* Those that can't go in the combined regex. */
+			std::vector<boost::regex> separate;
+			/* Rebuilt lazily, so adding many patterns costs one compile. */
+			mutable boost::regex combined;
+			mutable bool combined_stale = false;
+			bool empty() const { return names.empty() && patterns.empty() && separate.empty(); }
+			bool matches(const string& name) const;
+			/* Compile re, from rule, to check it; throws
+			 * std::invalid_argument if it won't. */
+			void add_pattern(const string& re, const string& rule);
+		} m_plain, m_qualified;
+		std::unordered_set<dwarf::lib::Dwarf_Half> m_tags;
+		bool m_default_tags;
+		bool m_exported_only;
+		bool m_empty_matches_all;
+		const dwarf::tool::scope_index *m_scopes = nullptr;
+		bool element_ok(const iterator_base& i) const;
+	public:
+		/* If 'empty_matches_all', a selection with no name, glob or regex
+		 * rules selects every element of the right tag and visibility. */
+		explicit selection(bool empty_matches_all = true);
+
+		/* Throws std::invalid_argument for a bad tag, visibility, glob or
+		 * regex. */
+		void add(const string& rule);
+		/* One rule per line, of any length. Blank lines and lines
+		 * starting with '#' are skipped. */
+		void read(std::istream& in);
+		/* Not owned; must outlive us, and index the root we're used on. */
+		void use_scope_index(const dwarf::tool::scope_index *scopes) { m_scopes = scopes; }
+
+		bool matches_name(const string& name) const;
+		bool matches_qualified_name(const string& fq_name) const;
+		bool matches_qualified_name(const std::vector<string>& fq_name_parts) const;
+		bool operator()(const iterator_base& i) const;
+		/* For gather_scoped_interface_dies. */
+		bool operator()(const iterator_base& i, const std::vector<string>& fq_name_parts) const;
+
+		bool has_name_rules() const { return !m_plain.empty() || !m_qualified.empty(); }
+		bool has_qualified_rules() const { return !m_qualified.empty(); }
+	};
+
+	/* The regex for a shell glob. */
+	string glob_to_regex(const string& glob);
+}
+
+#endif
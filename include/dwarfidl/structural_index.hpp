@@ -0,0 +1,53 @@
+/* Finding DIEs by what they contain, so that identical ones can be shared. */
+#ifndef DWARFIDL_STRUCTURAL_INDEX_HPP_
+#define DWARFIDL_STRUCTURAL_INDEX_HPP_
+
+#include <string>
+#include <set>
+#include <iostream>
+#include <unordered_map>
+#include <dwarfpp/lib.hpp>
+
+namespace dwarfidl
+{
+	using std::string;
+	using dwarf::core::iterator_base;
+	using dwarf::core::root_die;
+	using dwarf::lib::Dwarf_Off;
+	using dwarf::lib::Dwarf_Half;
+
+	/* Maps a DIE's key, its tag, its attributes in order with references
+	 * as offsets, and its children's keys, to a DIE in the same CU with
+	 * that key. create_dies builds keys from the text and add()s what it
+	 * creates; DIEs already in a CU are keyed from their attributes, one
+	 * tag at a time, the first time find() looks for that tag there.
+	 * Keep one for as long as the root. */
+	class structural_index
+	{
+		root_die& m_root;
+		std::unordered_map<string, iterator_base> m_dies;
+		/* (CU offset, tag) pairs whose DIEs we have keyed. */
+		std::set<std::pair<Dwarf_Off, Dwarf_Half> > m_scanned;
+	public:
+		explicit structural_index(root_die& r) : m_root(r) {}
+
+		/* Keys are made of these, one per attribute. */
+		static void write_attr(std::ostream& s, Dwarf_Half attr, const dwarf::encap::attribute_value& v);
+		static void write_ref(std::ostream& s, Dwarf_Half attr, Dwarf_Off target);
+		/* The key of a DIE that is already there. */
+		static string key_of(const iterator_base& i);
+
+		/* END if the CU has no DIE with this tag and key. */
+		iterator_base find(const iterator_base& cu, Dwarf_Half tag, const string& key);
+		void add(const iterator_base& cu, const string& key, const iterator_base& created);
+		/* Key the CU's DIEs again when next needed, e.g. after many were
+		 * added behind our back. */
+		void forget(const iterator_base& cu);
+		/* Drop every key, e.g. after the DIEs were renumbered. */
+		void clear() { m_dies.clear(); m_scanned.clear(); }
+
+		size_t size() const { return m_dies.size(); }
+	};
+}
+
+#endif
@@ -0,0 +1,51 @@
+/* Generating synthetic DWARF of configurable shape and scale. */
+#ifndef DWARFIDL_SYNTHETIC_HPP_
+#define DWARFIDL_SYNTHETIC_HPP_
+
+#include <string>
+#include <dwarfpp/lib.hpp>
+
+namespace dwarfidl
+{
+	using std::string;
+	using dwarf::core::iterator_base;
+	using dwarf::core::in_memory_root_die;
+
+	/* The output depends only on these, so the same parameters always give
+	 * the same DIEs. */
+	struct synthetic_params
+	{
+		unsigned ncus = 1;
+		unsigned structs_per_cu = 100;
+		/* Scalar members per struct, not counting the extras below. */
+		unsigned width = 4;
+		/* Structs are built in levels: one at level d > 0 embeds one from
+		 * level d - 1, so the deepest nesting is 'depth' structs. */
+		unsigned depth = 2;
+		/* Structs are grouped in rings of this length, each member pointing
+		 * to the next; 0 for no pointers. Each ring's one forward pointer
+		 * goes through an inline declaration of the struct it points to. */
+		unsigned pointer_cycle_length = 3;
+		/* Each struct is reached through this many chained typedefs
+		 * wherever another struct embeds it. */
+		unsigned typedef_chain_length = 2;
+		/* Every nth struct gets an anonymous union member; 0 for none. */
+		unsigned anonymous_union_every = 5;
+		/* The first this-many structs of every CU are identical, as a
+		 * header's types would be. */
+		unsigned shared_structs = 10;
+		/* Give each struct an external accessor function taking a pointer
+		 * to it, so that gather_interface_dies has something to start from. */
+		bool functions = true;
+	};
+
+	/* The dwarfidl text for the contents of CU number 'cu_index'. It has
+	 * no compile_unit of its own; create_dies will supply one. */
+	string generate_synthetic_dwarfidl(const synthetic_params& p, unsigned cu_index);
+
+	/* Create p.ncus compile units in 'r', each filled by create_dies from
+	 * the generated text. Returns the first CU. */
+	iterator_base create_synthetic_dies(in_memory_root_die& r, const synthetic_params& p);
+}
+
+#endif
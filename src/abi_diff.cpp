@@ -0,0 +1,525 @@
+#include <map>
+#include <sstream>
+#include <unordered_map>
+#include "dwarfidl/abi_diff.hpp"
+#include "dwarfidl/print.hpp"
+#include "dwarfidl/dwarfprint.hpp"
+#include "dwarfidl/keywords.hpp"
+
+using namespace dwarf;
+using namespace dwarf::core;
+using dwarf::lib::Dwarf_Off;
+using dwarf::lib::Dwarf_Unsigned;
+using dwarf::spec::opt;
+using std::ostringstream;
+using std::vector;
+using std::set;
+using std::map;
+using std::pair;
+using std::make_pair;
+
+namespace dwarfidl
+{
+	namespace
+	{
+		string tag_name(const iterator_base& i)
+		{
+			const char *keyword = keyword_for_tag(i.tag_here());
+			return keyword ? keyword : "(unknown tag)";
+		}
+		/* Things C names as "struct foo" and so on. */
+		const char *tag_keyword(const iterator_base& i)
+		{
+			switch (i.tag_here())
+			{
+				case DW_TAG_structure_type:   return "struct";
+				case DW_TAG_union_type:       return "union";
+				case DW_TAG_class_type:       return "class";
+				case DW_TAG_enumeration_type: return "enum";
+				default:                      return nullptr;
+			}
+		}
+		string qualified_name(const iterator_base& i)
+		{
+			auto parts = dwarf::tool::fq_name_parts_for(i);
+			string s;
+			for (auto i_p = parts.begin(); i_p != parts.end(); ++i_p)
+			{
+				if (i_p != parts.begin()) s += "::";
+				s += *i_p;
+			}
+			return s;
+		}
+		string element_where(const iterator_base& i)
+		{
+			const char *keyword = tag_keyword(i);
+			return (keyword ? string(keyword) + " " : string()) + qualified_name(i);
+		}
+		string describe(iterator_df<type_die> t)
+		{
+			if (!t) return "void";
+			if (t.name_here())
+			{
+				const char *keyword = tag_keyword(t);
+				return (keyword ? string(keyword) + " " : string()) + *t.name_here();
+			}
+			if (t.is_a<type_chain_die>())
+			{
+				string target = describe(t.as_a<type_chain_die>()->find_type());
+				if (t.tag_here() == DW_TAG_pointer_type) return target + "*";
+				return tag_name(t) + " " + target;
+			}
+			return "anonymous " + tag_name(t);
+		}
+
+		bool same_type(iterator_df<type_die> o, iterator_df<type_die> n)
+		{
+			if (!o || !n) return !o && !n;
+			auto o_code = o->summary_code();
+			auto n_code = n->summary_code();
+			return o_code && n_code && *o_code == *n_code;
+		}
+		/* For types we know differ. */
+		string change_of(iterator_df<type_die> o, iterator_df<type_die> n)
+		{
+			string o_name = describe(o), n_name = describe(n);
+			return (o_name == n_name) ? o_name + " changed" : o_name + " became " + n_name;
+		}
+		string size_string(opt<Dwarf_Unsigned> s)
+		{
+			if (!s) return "unknown";
+			ostringstream str;
+			str << *s;
+			return str.str();
+		}
+		opt<int64_t> member_offset(iterator_df<member_die> m)
+		{
+			auto loc = m->get_data_member_location();
+			if (!loc || loc->size() == 0) return opt<int64_t>();
+			return (int64_t) dwarf::expr::evaluator(loc->at(0), m.spec_here(), { 0 }).tos();
+		}
+		string const_value_of(const iterator_base& enumerator)
+		{
+			auto attrs = enumerator.copy_attrs();
+			auto found = attrs.find(DW_AT_const_value);
+			if (found == attrs.end()) return string();
+			ostringstream s;
+			s << found->second;
+			return s.str();
+		}
+
+		bool element_unchanged(const iterator_base& o, const iterator_base& n)
+		{
+			if (o.tag_here() != n.tag_here()) return false;
+			if (o.is_a<type_die>()) return same_type(o.as_a<type_die>(), n.as_a<type_die>());
+			if (o.is_a<variable_die>())
+			{
+				return same_type(o.as_a<variable_die>()->find_type(), n.as_a<variable_die>()->find_type());
+			}
+			return false;
+		}
+
+		class differ
+		{
+			vector<abi_change>& m_out;
+			/* Pairs of types we've already compared. */
+			set<pair<Dwarf_Off, Dwarf_Off> > m_seen;
+			iterator_base m_old_element;
+			iterator_base m_new_element;
+
+			void report(abi_change::kind k, const string& where, const string& detail,
+				const iterator_base& o, const iterator_base& n)
+			{
+				abi_change c = { k, where, detail, o, n, m_old_element, m_new_element };
+				m_out.push_back(c);
+			}
+			void members(iterator_df<with_data_members_die> o, iterator_df<with_data_members_die> n,
+				const string& where);
+			void enumerators(const iterator_base& o, const iterator_base& n, const string& where);
+			void signature(iterator_df<type_describing_subprogram_die> o,
+				iterator_df<type_describing_subprogram_die> n, const string& where);
+			void types(iterator_df<type_die> o, iterator_df<type_die> n, const string& where);
+		public:
+			explicit differ(vector<abi_change>& out) : m_out(out) {}
+			void elements(const iterator_base& o, const iterator_base& n);
+			void added(const iterator_base& n)
+			{
+				m_old_element = iterator_base::END; m_new_element = n;
+				report(abi_change::ADDED, element_where(n), string(), iterator_base::END, n);
+			}
+			void removed(const iterator_base& o)
+			{
+				m_old_element = o; m_new_element = iterator_base::END;
+				report(abi_change::REMOVED, element_where(o), string(), o, iterator_base::END);
+			}
+		};
+
+		void differ::elements(const iterator_base& o, const iterator_base& n)
+		{
+			m_old_element = o;
+			m_new_element = n;
+			string where = element_where(n);
+			if (o.tag_here() != n.tag_here())
+			{
+				report(abi_change::KIND_CHANGED, where, tag_name(o) + " became " + tag_name(n), o, n);
+			}
+			else if (o.is_a<type_describing_subprogram_die>())
+			{
+				signature(o.as_a<type_describing_subprogram_die>(),
+					n.as_a<type_describing_subprogram_die>(), where);
+			}
+			else if (o.is_a<type_die>())
+			{
+				types(o.as_a<type_die>(), n.as_a<type_die>(), where);
+			}
+			else if (o.is_a<variable_die>())
+			{
+				auto o_t = o.as_a<variable_die>()->find_type();
+				auto n_t = n.as_a<variable_die>()->find_type();
+				if (same_type(o_t, n_t)) return;
+				if (describe(o_t) != describe(n_t))
+				{
+					report(abi_change::TYPE_CHANGED, where, describe(o_t) + " became " + describe(n_t), o, n);
+				}
+				types(o_t, n_t, where);
+			}
+		}
+
+		void differ::types(iterator_df<type_die> o, iterator_df<type_die> n, const string& where)
+		{
+			if (same_type(o, n)) return;
+			if (!o || !n)
+			{
+				report(abi_change::TYPE_CHANGED, where, describe(o) + " became " + describe(n), o, n);
+				return;
+			}
+			if (!m_seen.insert(make_pair(o.offset_here(), n.offset_here())).second) return;
+
+			auto o_c = o->get_concrete_type();
+			auto n_c = n->get_concrete_type();
+			if (same_type(o_c, n_c) || !o_c || !n_c)
+			{
+				/* Only the typedefs differ, or one side is void. */
+				if (describe(o) != describe(n))
+				{
+					report(abi_change::TYPE_CHANGED, where, describe(o) + " became " + describe(n), o, n);
+				}
+				return;
+			}
+			if (o_c.tag_here() != n_c.tag_here())
+			{
+				report(abi_change::KIND_CHANGED, where, describe(o) + " became " + describe(n), o_c, n_c);
+				return;
+			}
+			auto o_size = o_c->calculate_byte_size();
+			auto n_size = n_c->calculate_byte_size();
+			if (o_size != n_size)
+			{
+				report(abi_change::SIZE_CHANGED, where,
+					"size " + size_string(o_size) + " became " + size_string(n_size), o_c, n_c);
+			}
+
+			if (o_c.is_a<with_data_members_die>())
+			{
+				members(o_c.as_a<with_data_members_die>(), n_c.as_a<with_data_members_die>(), where);
+			}
+			else if (o_c.is_a<enumeration_type_die>())
+			{
+				enumerators(o_c, n_c, where);
+			}
+			else if (o_c.is_a<type_describing_subprogram_die>())
+			{
+				signature(o_c.as_a<type_describing_subprogram_die>(),
+					n_c.as_a<type_describing_subprogram_die>(), where);
+			}
+			else if (o_c.is_a<type_chain_die>())
+			{
+				types(o_c.as_a<type_chain_die>()->find_type(), n_c.as_a<type_chain_die>()->find_type(),
+					where + (o_c.tag_here() == DW_TAG_pointer_type ? "*" : "[]"));
+			}
+			else if (describe(o_c) != describe(n_c) || (o_c.is_a<base_type_die>()
+				&& o_c.as_a<base_type_die>()->get_encoding() != n_c.as_a<base_type_die>()->get_encoding()))
+			{
+				report(abi_change::TYPE_CHANGED, where, describe(o_c) + " became " + describe(n_c), o_c, n_c);
+			}
+		}
+
+		void differ::members(iterator_df<with_data_members_die> o, iterator_df<with_data_members_die> n,
+			const string& where)
+		{
+			/* Anonymous members are matched by position among the anonymous. */
+			auto member_key = [](iterator_df<member_die> m, unsigned& nanon) {
+				if (m.name_here()) return *m.name_here();
+				ostringstream s;
+				s << "(anonymous member " << ++nanon << ")";
+				return s.str();
+			};
+			map<string, iterator_df<member_die> > old_members;
+			unsigned nanon = 0;
+			auto o_ms = o.children().subseq_of<member_die>();
+			for (auto i_m = o_ms.first; i_m != o_ms.second; ++i_m)
+			{
+				old_members.insert(make_pair(member_key(i_m, nanon), i_m));
+			}
+			nanon = 0;
+			auto n_ms = n.children().subseq_of<member_die>();
+			for (auto i_m = n_ms.first; i_m != n_ms.second; ++i_m)
+			{
+				string name = member_key(i_m, nanon);
+				string member_where = where + "." + name;
+				auto found = old_members.find(name);
+				if (found == old_members.end())
+				{
+					report(abi_change::MEMBER_ADDED, member_where, describe(i_m->find_type()),
+						iterator_base::END, i_m);
+					continue;
+				}
+				iterator_df<member_die> o_m = found->second;
+				old_members.erase(found);
+				auto o_off = member_offset(o_m);
+				auto n_off = member_offset(i_m);
+				if (o_off != n_off)
+				{
+					ostringstream s;
+					s << "offset ";
+					if (o_off) s << *o_off; else s << "unknown";
+					s << " became ";
+					if (n_off) s << *n_off; else s << "unknown";
+					report(abi_change::MEMBER_MOVED, member_where, s.str(), o_m, i_m);
+				}
+				auto o_t = o_m->find_type();
+				auto n_t = i_m->find_type();
+				if (same_type(o_t, n_t)) continue;
+				if (describe(o_t) != describe(n_t))
+				{
+					report(abi_change::MEMBER_TYPE_CHANGED, member_where,
+						describe(o_t) + " became " + describe(n_t), o_m, i_m);
+				}
+				types(o_t, n_t, member_where);
+			}
+			for (auto i_m = old_members.begin(); i_m != old_members.end(); ++i_m)
+			{
+				report(abi_change::MEMBER_REMOVED, where + "." + i_m->first,
+					describe(i_m->second->find_type()), i_m->second, iterator_base::END);
+			}
+		}
+
+		void differ::enumerators(const iterator_base& o, const iterator_base& n, const string& where)
+		{
+			map<string, iterator_base> old_enumerators;
+			auto o_children = o.children_here();
+			for (auto i_e = o_children.first; i_e != o_children.second; ++i_e)
+			{
+				if (i_e.tag_here() == DW_TAG_enumerator && i_e.name_here())
+				{
+					old_enumerators.insert(make_pair(*i_e.name_here(), i_e));
+				}
+			}
+			auto n_children = n.children_here();
+			for (auto i_e = n_children.first; i_e != n_children.second; ++i_e)
+			{
+				if (i_e.tag_here() != DW_TAG_enumerator || !i_e.name_here()) continue;
+				string enumerator_where = where + "." + *i_e.name_here();
+				auto found = old_enumerators.find(*i_e.name_here());
+				if (found == old_enumerators.end())
+				{
+					report(abi_change::ENUMERATOR_CHANGED, enumerator_where,
+						"added with value " + const_value_of(i_e), iterator_base::END, i_e);
+					continue;
+				}
+				string o_value = const_value_of(found->second);
+				string n_value = const_value_of(i_e);
+				if (o_value != n_value)
+				{
+					report(abi_change::ENUMERATOR_CHANGED, enumerator_where,
+						"value " + o_value + " became " + n_value, found->second, i_e);
+				}
+				old_enumerators.erase(found);
+			}
+			for (auto i_e = old_enumerators.begin(); i_e != old_enumerators.end(); ++i_e)
+			{
+				report(abi_change::ENUMERATOR_CHANGED, where + "." + i_e->first,
+					"removed", i_e->second, iterator_base::END);
+			}
+		}
+
+		void differ::signature(iterator_df<type_describing_subprogram_die> o,
+			iterator_df<type_describing_subprogram_die> n, const string& where)
+		{
+			if (same_type(o, n)) return;
+			auto o_ret = o->find_type();
+			auto n_ret = n->find_type();
+			if (!same_type(o_ret, n_ret))
+			{
+				report(abi_change::SIGNATURE_CHANGED, where, "return type " + change_of(o_ret, n_ret), o, n);
+				types(o_ret, n_ret, where + "(return)");
+			}
+
+			vector<iterator_df<formal_parameter_die> > o_args, n_args;
+			bool o_variadic = false, n_variadic = false;
+			auto o_children = o.children_here();
+			for (auto i = o_children.first; i != o_children.second; ++i)
+			{
+				if (i.tag_here() == DW_TAG_formal_parameter) o_args.push_back(i.as_a<formal_parameter_die>());
+				else if (i.tag_here() == DW_TAG_unspecified_parameters) o_variadic = true;
+			}
+			auto n_children = n.children_here();
+			for (auto i = n_children.first; i != n_children.second; ++i)
+			{
+				if (i.tag_here() == DW_TAG_formal_parameter) n_args.push_back(i.as_a<formal_parameter_die>());
+				else if (i.tag_here() == DW_TAG_unspecified_parameters) n_variadic = true;
+			}
+			if (o_args.size() != n_args.size() || o_variadic != n_variadic)
+			{
+				ostringstream s;
+				s << "took " << o_args.size() << (o_variadic ? "+" : "") << " arguments, now "
+					<< n_args.size() << (n_variadic ? "+" : "");
+				report(abi_change::SIGNATURE_CHANGED, where, s.str(), o, n);
+			}
+			for (unsigned k = 0; k < o_args.size() && k < n_args.size(); ++k)
+			{
+				auto o_t = o_args[k]->find_type();
+				auto n_t = n_args[k]->find_type();
+				if (same_type(o_t, n_t)) continue;
+				ostringstream s;
+				s << where << "(arg " << (k + 1) << ")";
+				report(abi_change::SIGNATURE_CHANGED, s.str(), change_of(o_t, n_t), o_args[k], n_args[k]);
+				types(o_t, n_t, s.str());
+			}
+		}
+
+		/* The outermost struct, union, enum or typedef that a change is
+		 * inside, e.g. the struct for a member; END if none. */
+		iterator_base defining_type(const iterator_base& i)
+		{
+			iterator_base found = iterator_base::END;
+			for (iterator_base p = i; p && p.offset_here() != 0 && p.tag_here() != DW_TAG_compile_unit;
+				p = p.parent())
+			{
+				if (tag_keyword(p) || p.tag_here() == DW_TAG_typedef) found = p;
+				else if (found) break;
+			}
+			return found;
+		}
+
+		/* Elements that C would find under the same name: struct, union
+		 * and enum tags are a separate namespace. */
+		string match_key(const iterator_base& i)
+		{
+			return (tag_keyword(i) ? "tag " : "") + qualified_name(i);
+		}
+	}
+
+	const char *change_kind_name(abi_change::kind k)
+	{
+		switch (k)
+		{
+			case abi_change::ADDED:               return "added";
+			case abi_change::REMOVED:             return "removed";
+			case abi_change::KIND_CHANGED:        return "kind changed";
+			case abi_change::SIZE_CHANGED:        return "size changed";
+			case abi_change::MEMBER_ADDED:        return "member added";
+			case abi_change::MEMBER_REMOVED:      return "member removed";
+			case abi_change::MEMBER_MOVED:        return "member moved";
+			case abi_change::MEMBER_TYPE_CHANGED: return "member type changed";
+			case abi_change::ENUMERATOR_CHANGED:  return "enumerator changed";
+			case abi_change::SIGNATURE_CHANGED:   return "signature changed";
+			case abi_change::TYPE_CHANGED:        return "type changed";
+			default:                              return "(unknown change)";
+		}
+	}
+
+	std::ostream& operator<<(std::ostream& s, const abi_change& c)
+	{
+		s << change_kind_name(c.k) << ": " << c.where;
+		if (!c.detail.empty()) s << ": " << c.detail;
+		return s;
+	}
+
+	vector<abi_change> diff_interfaces(const set<iterator_base>& old_slice, const set<iterator_base>& new_slice)
+	{
+		std::unordered_map<string, vector<iterator_base> > old_by_key, new_by_key;
+		for (auto i = old_slice.begin(); i != old_slice.end(); ++i)
+		{
+			if (i->name_here()) old_by_key[match_key(*i)].push_back(*i);
+		}
+		for (auto i = new_slice.begin(); i != new_slice.end(); ++i)
+		{
+			if (i->name_here()) new_by_key[match_key(*i)].push_back(*i);
+		}
+
+		vector<abi_change> changes;
+		differ d(changes);
+		/* Go in DIE order, so that the output is stable. */
+		for (auto i = new_slice.begin(); i != new_slice.end(); ++i)
+		{
+			if (!i->name_here()) continue;
+			auto found_new = new_by_key.find(match_key(*i));
+			if (found_new == new_by_key.end()) continue; // done already
+			vector<iterator_base> news = std::move(found_new->second);
+			new_by_key.erase(found_new);
+			auto found_old = old_by_key.find(match_key(*i));
+			vector<iterator_base> olds;
+			if (found_old != old_by_key.end())
+			{
+				olds = std::move(found_old->second);
+				old_by_key.erase(found_old);
+			}
+
+			/* Several DIEs can share a name, e.g. one per CU. Set aside the
+			 * ones that are unchanged, then pair off the rest in order. */
+			vector<iterator_base> changed_news;
+			for (auto i_n = news.begin(); i_n != news.end(); ++i_n)
+			{
+				auto i_o = olds.begin();
+				while (i_o != olds.end() && !element_unchanged(*i_o, *i_n)) ++i_o;
+				if (i_o != olds.end()) olds.erase(i_o);
+				else changed_news.push_back(*i_n);
+			}
+			unsigned k = 0;
+			for (; k < changed_news.size() && k < olds.size(); ++k) d.elements(olds[k], changed_news[k]);
+			for (unsigned k_n = k; k_n < changed_news.size(); ++k_n) d.added(changed_news[k_n]);
+			for (unsigned k_o = k; k_o < olds.size(); ++k_o) d.removed(olds[k_o]);
+		}
+		for (auto i = old_slice.begin(); i != old_slice.end(); ++i)
+		{
+			if (!i->name_here()) continue;
+			auto found_old = old_by_key.find(match_key(*i));
+			if (found_old == old_by_key.end()) continue;
+			for (auto i_o = found_old->second.begin(); i_o != found_old->second.end(); ++i_o) d.removed(*i_o);
+			old_by_key.erase(found_old);
+		}
+		return changes;
+	}
+
+	void write_dwarfidl_patch(std::ostream& out, const vector<abi_change>& changes)
+	{
+		/* Changes come grouped by element already; start a new group
+		 * whenever the element changes. A type that changed is reported
+		 * only under the first element reaching it, so that group also
+		 * gets the type's new definition. */
+		set<iterator_base> printed;
+		auto i_c = changes.begin();
+		while (i_c != changes.end())
+		{
+			auto i_end = i_c;
+			while (i_end != changes.end() && i_end->old_element == i_c->old_element
+				&& i_end->new_element == i_c->new_element) ++i_end;
+			for (auto i = i_c; i != i_end; ++i) out << "// " << *i << std::endl;
+			if (i_c->new_element)
+			{
+				set<iterator_base> to_print;
+				if (printed.insert(i_c->new_element).second) to_print.insert(i_c->new_element);
+				for (auto i = i_c; i != i_end; ++i)
+				{
+					if (!i->new_die) continue;
+					iterator_base t = defining_type(i->new_die);
+					if (t && printed.insert(t).second) to_print.insert(t);
+				}
+				if (!to_print.empty()) print_dies(out, to_print);
+			}
+			out << std::endl;
+			i_c = i_end;
+		}
+	}
+}
@@ -0,0 +1,552 @@
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <dwarfpp/lib.hpp>
+#include "dwarfidl/arena_root.hpp"
+
+using namespace dwarf;
+using namespace dwarf::core;
+using namespace dwarf::lib;
+using dwarf::spec::DEFAULT_DWARF_SPEC;
+using encap::attribute_value;
+using encap::loc_expr;
+using std::string;
+
+namespace dwarfidl
+{
+	using namespace binslice;
+
+	void *arena::allocate(size_t size, size_t align)
+	{
+		size_t pad = (align - reinterpret_cast<uintptr_t>(m_next) % align) % align;
+		if (!m_next || pad + size > m_left)
+		{
+			/* Big things get a chunk of their own, so as not to waste
+			 * what is left of the current one. */
+			if (size + align > m_chunk_size / 4)
+			{
+				m_chunks.emplace_back(new char[size + align]);
+				m_reserved += size + align;
+				m_used += size;
+				char *p = m_chunks.back().get();
+				return p + (align - reinterpret_cast<uintptr_t>(p) % align) % align;
+			}
+			m_chunks.emplace_back(new char[m_chunk_size]);
+			m_reserved += m_chunk_size;
+			m_next = m_chunks.back().get();
+			m_left = m_chunk_size;
+			pad = (align - reinterpret_cast<uintptr_t>(m_next) % align) % align;
+		}
+		char *p = m_next + pad;
+		m_next += pad + size;
+		m_left -= pad + size;
+		m_used += size;
+		return p;
+	}
+
+	const char *arena::copy_string(const string& s)
+	{
+		char *p = allocate_array<char>(s.size() + 1);
+		memcpy(p, s.c_str(), s.size() + 1);
+		return p;
+	}
+
+	void arena::take(arena& other)
+	{
+		for (auto i_c = other.m_chunks.begin(); i_c != other.m_chunks.end(); ++i_c)
+		{
+			m_chunks.push_back(std::move(*i_c));
+		}
+		m_used += other.m_used;
+		m_reserved += other.m_reserved;
+		other.m_chunks.clear();
+		other.m_next = nullptr;
+		other.m_left = other.m_used = other.m_reserved = 0;
+	}
+
+	size_t string_interner::cstr_hash::operator()(const char *s) const
+	{
+		/* FNV-1a */
+		uint64_t h = 14695981039346656037ull;
+		for (; *s; ++s) { h ^= static_cast<unsigned char>(*s); h *= 1099511628211ull; }
+		return h;
+	}
+
+	const char *string_interner::intern(const string& s)
+	{
+		auto found = m_strings.find(s.c_str());
+		if (found != m_strings.end()) return *found;
+		const char *copy = m_arena.copy_string(s);
+		m_strings.insert(copy);
+		return copy;
+	}
+
+	const char *string_interner::find(const string& s) const
+	{
+		auto found = m_strings.find(s.c_str());
+		return found == m_strings.end() ? nullptr : *found;
+	}
+
+	const char *string_interner::adopt(const char *s)
+	{
+		return *m_strings.insert(s).first;
+	}
+
+	arena_root_die::arena_root_die()
+	 : root_die(), m_strings(m_arena), m_first_toplevel(no_index), m_last_toplevel(no_index),
+	   m_resolution(*this), m_structure(*this)
+	{}
+
+	iterator_base arena_root_die::make_new(const iterator_base& parent, Dwarf_Half tag)
+	{
+		auto parent_idx = index_of_offset(parent.offset_here());
+		assert(parent_idx || parent.offset_here() == 0);
+		uint32_t idx = m_dies.size();
+		die_node *n = new (m_arena.allocate(sizeof (die_node), alignof(die_node))) die_node;
+		n->name = nullptr;
+		n->first_attr = n->last_attr = nullptr;
+		n->parent = parent_idx ? *parent_idx : no_index;
+		n->first_child = n->last_child = n->next_sibling = no_index;
+		n->depth = parent_idx ? m_dies[*parent_idx]->depth + 1 : 1;
+		n->tag = tag;
+		m_dies.push_back(n);
+
+		uint32_t& first = parent_idx ? m_dies[*parent_idx]->first_child : m_first_toplevel;
+		uint32_t& last = parent_idx ? m_dies[*parent_idx]->last_child : m_last_toplevel;
+		if (last == no_index) first = idx;
+		else m_dies[last]->next_sibling = idx;
+		last = idx;
+		return pos(offset_of_index(idx), n->depth);
+	}
+
+	/* Record a name, or say whether d still wants an attr_node for attr. */
+	bool arena_root_die::wants_attr(die_node& d, Dwarf_Half attr, const attribute_value& v)
+	{
+		if (attr == DW_AT_name && v.get_form() == attribute_value::STRING)
+		{
+			if (!d.name) d.name = m_strings.intern(v.get_string());
+			return false;
+		}
+		for (attr_node *a = d.first_attr; a; a = a->next) if (a->attr == attr) return false;
+		return true;
+	}
+
+	void arena_root_die::set_attr(const iterator_base& it, Dwarf_Half attr, const attribute_value& v)
+	{
+		auto idx = index_of_offset(it.offset_here());
+		assert(idx);
+		die_node& d = *m_dies[*idx];
+		if (!wants_attr(d, attr, v)) return;
+		attr_node *a = new (m_arena.allocate(sizeof (attr_node), alignof(attr_node))) attr_node;
+		append_attr(d, a, attr, v);
+	}
+
+	void arena_root_die::set_attrs(const iterator_base& it, const attribute_list& attrs)
+	{
+		auto idx = index_of_offset(it.offset_here());
+		assert(idx);
+		die_node& d = *m_dies[*idx];
+		/* One allocation for the lot; any we skip are simply unused. */
+		attr_node *nodes = m_arena.allocate_array<attr_node>(attrs.size());
+		unsigned n = 0;
+		for (auto i_a = attrs.begin(); i_a != attrs.end(); ++i_a)
+		{
+			if (!wants_attr(d, i_a->first, i_a->second)) continue;
+			append_attr(d, new (&nodes[n++]) attr_node, i_a->first, i_a->second);
+		}
+	}
+
+	void arena_root_die::set_ref(const iterator_base& it, Dwarf_Half attr, Dwarf_Off target)
+	{
+		auto idx = index_of_offset(it.offset_here());
+		assert(idx);
+		for (attr_node *a = m_dies[*idx]->first_attr; a; a = a->next)
+		{
+			if (a->attr != attr) continue;
+			assert(a->form == REF_EXTERNAL);
+			a->value = target;
+			a->flags |= REF_ABS | REF_LOCAL;
+			return;
+		}
+		assert(false && "no such reference attribute");
+	}
+
+	void arena_root_die::mark_local_ref(const iterator_base& it, Dwarf_Half attr)
+	{
+		auto idx = index_of_offset(it.offset_here());
+		assert(idx);
+		for (attr_node *a = m_dies[*idx]->first_attr; a; a = a->next)
+		{
+			if (a->attr != attr) continue;
+			if (a->form == REF_EXTERNAL) a->flags |= REF_LOCAL;
+			return;
+		}
+	}
+
+	Dwarf_Off arena_root_die::adopt(arena_root_die& from, const iterator_base& from_parent,
+		const iterator_base& to_parent)
+	{
+		assert(&from != this);
+		const uint32_t base = m_dies.size();
+		auto from_idx = from.index_of_offset(from_parent.offset_here());
+		auto to_idx = index_of_offset(to_parent.offset_here());
+		const uint32_t from_depth = from_idx ? from.m_dies[*from_idx]->depth : 0;
+		const uint32_t to_depth = to_idx ? m_dies[*to_idx]->depth : 0;
+		const uint32_t from_parent_index = from_idx ? *from_idx : no_index;
+		const uint32_t to_parent_index = to_idx ? *to_idx : no_index;
+		/* from_parent's record is dropped, so those after it close up. */
+		auto renumber = [base, from_parent_index](uint32_t i) {
+			return i == no_index ? no_index
+				: (from_parent_index != no_index && i > from_parent_index) ? i + base - 1 : i + base;
+		};
+		const uint32_t first = renumber(from_idx ? from.m_dies[*from_idx]->first_child : from.m_first_toplevel);
+		const uint32_t last = renumber(from_idx ? from.m_dies[*from_idx]->last_child : from.m_last_toplevel);
+		const Dwarf_Off from_parent_off = from_parent.offset_here();
+
+		m_arena.take(from.m_arena);
+		for (uint32_t i = 0; i < from.m_dies.size(); ++i)
+		{
+			if (i == from_parent_index) continue;
+			die_node& d = *from.m_dies[i];
+			d.parent = (d.parent == from_parent_index) ? to_parent_index : renumber(d.parent);
+			d.first_child = renumber(d.first_child);
+			d.last_child = renumber(d.last_child);
+			d.next_sibling = renumber(d.next_sibling);
+			d.depth = d.depth - from_depth + to_depth;
+			if (d.name) d.name = m_strings.adopt(d.name);
+			for (attr_node *a = d.first_attr; a; a = a->next)
+			{
+				if (a->form == STRING)
+				{
+					a->value = reinterpret_cast<uintptr_t>(
+						m_strings.adopt(reinterpret_cast<const char *>(a->value)));
+				}
+				else if (a->form == REF_EXTERNAL && (a->flags & REF_LOCAL) && a->value != pending_ref)
+				{
+					if (a->value == from_parent_off) a->value = to_parent.offset_here();
+					else if (a->value != 0) a->value = adopted_offset(a->value, base, from_parent_off);
+				}
+			}
+			m_dies.push_back(&d);
+		}
+
+		/* Splice from_parent's children onto the end of to_parent's. */
+		if (first != no_index)
+		{
+			uint32_t& to_first = to_idx ? m_dies[*to_idx]->first_child : m_first_toplevel;
+			uint32_t& to_last = to_idx ? m_dies[*to_idx]->last_child : m_last_toplevel;
+			if (to_last == no_index) to_first = first;
+			else m_dies[to_last]->next_sibling = first;
+			to_last = last;
+		}
+
+		from.m_dies.clear();
+		from.m_first_toplevel = from.m_last_toplevel = no_index;
+		m_resolution.forget(to_parent);
+		m_structure.forget(to_parent.enclosing_cu());
+		return base;
+	}
+
+	std::vector<Dwarf_Off> arena_root_die::replace_dies(const std::map<Dwarf_Off, Dwarf_Off>& replacements)
+	{
+		/* Where each record goes, or no_index if it is dropped. */
+		std::vector<uint32_t> to(m_dies.size());
+		uint32_t kept = 0;
+		for (uint32_t i = 0; i < m_dies.size(); ++i)
+		{
+			to[i] = replacements.count(offset_of_index(i)) ? no_index : kept++;
+		}
+		std::vector<Dwarf_Off> moved(m_dies.size() + 1);
+		for (uint32_t i = 0; i < m_dies.size(); ++i)
+		{
+			Dwarf_Off off = offset_of_index(i);
+			for (size_t n = 0; to[*index_of_offset(off)] == no_index; ++n)
+			{
+				assert(n < replacements.size() && "replacements go round in a circle");
+				off = replacements.find(off)->second;
+				assert(index_of_offset(off));
+			}
+			moved[i + 1] = offset_of_index(to[*index_of_offset(off)]);
+		}
+
+		/* Relink each list of children without the dropped ones. Each
+		 * link is read before it is rewritten. */
+		auto relink = [this, &to](uint32_t& first, uint32_t& last) {
+			uint32_t prev = no_index;
+			for (uint32_t c = first; c != no_index; c = m_dies[c]->next_sibling)
+			{
+				if (to[c] == no_index) continue;
+				if (prev == no_index) first = c;
+				else m_dies[prev]->next_sibling = c;
+				prev = c;
+			}
+			if (prev == no_index) first = no_index;
+			else m_dies[prev]->next_sibling = no_index;
+			last = prev;
+		};
+		relink(m_first_toplevel, m_last_toplevel);
+		for (uint32_t i = 0; i < m_dies.size(); ++i)
+		{
+			if (to[i] != no_index) relink(m_dies[i]->first_child, m_dies[i]->last_child);
+		}
+
+		/* Now renumber. */
+		auto renumber = [&to](uint32_t i) { return i == no_index ? no_index : to[i]; };
+		std::vector<die_node *> dies(kept);
+		for (uint32_t i = 0; i < m_dies.size(); ++i)
+		{
+			if (to[i] == no_index) continue;
+			die_node& d = *m_dies[i];
+			assert(d.parent == no_index || to[d.parent] != no_index);
+			d.parent = renumber(d.parent);
+			d.first_child = renumber(d.first_child);
+			d.last_child = renumber(d.last_child);
+			d.next_sibling = renumber(d.next_sibling);
+			for (attr_node *a = d.first_attr; a; a = a->next)
+			{
+				if (a->form == REF_EXTERNAL && a->value != pending_ref && a->value < moved.size())
+				{
+					a->value = moved[a->value];
+				}
+			}
+			dies[to[i]] = &d;
+		}
+		m_first_toplevel = renumber(m_first_toplevel);
+		m_last_toplevel = renumber(m_last_toplevel);
+		m_dies.swap(dies);
+		m_resolution.clear();
+		m_structure.clear();
+		return moved;
+	}
+
+	void arena_root_die::replace_attr(const iterator_base& it, Dwarf_Half attr, const attribute_value& v)
+	{
+		auto idx = index_of_offset(it.offset_here());
+		assert(idx);
+		die_node& d = *m_dies[*idx];
+		if (attr == DW_AT_name && v.get_form() == attribute_value::STRING)
+		{
+			d.name = m_strings.intern(v.get_string());
+			return;
+		}
+		for (attr_node *a = d.first_attr; a; a = a->next)
+		{
+			if (a->attr == attr) { encode_attr(a, attr, v); return; }
+		}
+		set_attr(it, attr, v);
+	}
+
+	void arena_root_die::append_attr(die_node& d, attr_node *a, Dwarf_Half attr, const attribute_value& v)
+	{
+		a->next = nullptr;
+		encode_attr(a, attr, v);
+		if (d.last_attr) d.last_attr->next = a;
+		else d.first_attr = a;
+		d.last_attr = a;
+	}
+
+	void arena_root_die::encode_attr(attr_node *a, Dwarf_Half attr, const attribute_value& v)
+	{
+		a->attr = attr;
+		a->flags = 0;
+		a->count = 0;
+		switch (v.get_form())
+		{
+			case attribute_value::STRING:
+				a->form = STRING;
+				a->value = reinterpret_cast<uintptr_t>(m_strings.intern(v.get_string()));
+				break;
+			case attribute_value::FLAG:
+				a->form = FLAG;
+				a->value = v.get_flag() ? 1 : 0;
+				break;
+			case attribute_value::UNSIGNED:
+				a->form = UNSIGNED;
+				a->value = v.get_unsigned();
+				break;
+			case attribute_value::SIGNED:
+				a->form = SIGNED;
+				a->value = static_cast<uint64_t>(v.get_signed());
+				break;
+			case attribute_value::ADDR:
+				a->form = ADDR;
+				a->value = v.get_address().addr;
+				break;
+			case attribute_value::REF: {
+				auto ref = v.get_ref();
+				a->form = REF_EXTERNAL;
+				a->flags = ref.abs ? REF_ABS : 0;
+				a->value = ref.off;
+			} break;
+			case attribute_value::LOCLIST: {
+				auto ll = v.get_loclist();
+				loc_node *locs = m_arena.allocate_array<loc_node>(ll.size());
+				for (unsigned k = 0; k < ll.size(); ++k)
+				{
+					op_record *ops = m_arena.allocate_array<op_record>(ll[k].size());
+					for (unsigned o = 0; o < ll[k].size(); ++o)
+					{
+						ops[o].atom = ll[k][o].lr_atom;
+						ops[o].number = ll[k][o].lr_number;
+						ops[o].number2 = ll[k][o].lr_number2;
+						ops[o].offset = ll[k][o].lr_offset;
+						ops[o].reserved = 0;
+					}
+					locs[k].lopc = ll[k].lopc;
+					locs[k].hipc = ll[k].hipc;
+					locs[k].nops = ll[k].size();
+					locs[k].ops = ops;
+				}
+				a->form = LOCLIST;
+				a->count = ll.size();
+				a->value = reinterpret_cast<uintptr_t>(locs);
+			} break;
+			default:
+				/* create_dies makes nothing else. */
+				assert(false && "unsupported attribute form in arena root"); abort();
+		}
+	}
+
+	attribute_value arena_root_die::decode_attr(const attr_node& a, Dwarf_Off context_off) const
+	{
+		root_die& r = const_cast<arena_root_die&>(*this);
+		switch (a.form)
+		{
+			case STRING:
+				return attribute_value(string(reinterpret_cast<const char *>(a.value)));
+			case FLAG:
+				return attribute_value(static_cast<Dwarf_Bool>(a.value));
+			case UNSIGNED:
+				return attribute_value(static_cast<Dwarf_Unsigned>(a.value));
+			case SIGNED:
+				return attribute_value(static_cast<Dwarf_Signed>(a.value));
+			case ADDR:
+				return attribute_value(attribute_value::address{a.value});
+			case REF_EXTERNAL:
+				return attribute_value(attribute_value::weak_ref(r,
+					a.value, a.flags & REF_ABS, context_off, a.attr));
+			case LOCLIST: {
+				const loc_node *locs = reinterpret_cast<const loc_node *>(a.value);
+				encap::loclist ll;
+				for (uint32_t k = 0; k < a.count; ++k)
+				{
+					loc_expr expr;
+					expr.lopc = locs[k].lopc;
+					expr.hipc = locs[k].hipc;
+					for (uint32_t o = 0; o < locs[k].nops; ++o)
+					{
+						Dwarf_Loc loc;
+						loc.lr_atom = locs[k].ops[o].atom;
+						loc.lr_number = locs[k].ops[o].number;
+						loc.lr_number2 = locs[k].ops[o].number2;
+						loc.lr_offset = locs[k].ops[o].offset;
+						expr.push_back(loc);
+					}
+					ll.push_back(expr);
+				}
+				return attribute_value(ll);
+			}
+			default:
+				assert(false); abort();
+		}
+	}
+
+	bool arena_root_die::move_to_first_child(iterator_base& it)
+	{
+		Dwarf_Off off = it.offset_here();
+		uint32_t child;
+		if (off == 0) child = m_first_toplevel;
+		else
+		{
+			auto idx = index_of_offset(off);
+			assert(idx);
+			child = m_dies[*idx]->first_child;
+		}
+		if (child == no_index) return false;
+		it = pos(offset_of_index(child), it.depth() + 1);
+		return true;
+	}
+
+	bool arena_root_die::move_to_next_sibling(iterator_base& it)
+	{
+		auto idx = index_of_offset(it.offset_here());
+		if (!idx) return false; // the root has no siblings
+		uint32_t next = m_dies[*idx]->next_sibling;
+		if (next == no_index) return false;
+		it = pos(offset_of_index(next), it.depth());
+		return true;
+	}
+
+	bool arena_root_die::move_to_parent(iterator_base& it)
+	{
+		auto idx = index_of_offset(it.offset_here());
+		if (!idx) return false;
+		uint32_t parent = m_dies[*idx]->parent;
+		it = (parent == no_index) ? begin() : pos(offset_of_index(parent), it.depth() - 1);
+		return true;
+	}
+
+	iterator_base arena_root_die::find_downwards(Dwarf_Off off)
+	{
+		if (off == 0) return begin();
+		auto idx = index_of_offset(off);
+		if (!idx) return iterator_base::END;
+		return pos(off, m_dies[*idx]->depth);
+	}
+
+	basic_die *arena_root_die::make_payload(const iterator_base& it)
+	{
+		auto idx = index_of_offset(it.offset_here());
+		assert(idx);
+		return factory::for_spec(DEFAULT_DWARF_SPEC).make_payload(arena_die(*this, *idx), *this);
+	}
+
+	Dwarf_Off arena_die::get_offset() const
+	{
+		return p_root->offset_of_index(idx);
+	}
+
+	Dwarf_Half arena_die::get_tag() const
+	{
+		return p_root->node(idx).tag;
+	}
+
+	opt<string> arena_die::get_name() const
+	{
+		const char *name = p_root->node(idx).name;
+		return name ? opt<string>(string(name)) : opt<string>();
+	}
+
+	Dwarf_Off arena_die::get_enclosing_cu_offset() const
+	{
+		uint32_t i = idx;
+		while (p_root->node(i).parent != no_index) i = p_root->node(i).parent;
+		return p_root->offset_of_index(i);
+	}
+
+	bool arena_die::has_attr(Dwarf_Half attr) const
+	{
+		const arena_root_die::die_node& d = p_root->node(idx);
+		if (attr == DW_AT_name) return d.name != nullptr;
+		for (auto a = d.first_attr; a; a = a->next) if (a->attr == attr) return true;
+		return false;
+	}
+
+	encap::attribute_map arena_die::copy_attrs() const
+	{
+		encap::attribute_map out;
+		const arena_root_die::die_node& d = p_root->node(idx);
+		if (d.name) out.insert(std::make_pair(DW_AT_name, attribute_value(string(d.name))));
+		for (auto a = d.first_attr; a; a = a->next)
+		{
+			out.insert(std::make_pair(a->attr, p_root->decode_attr(*a, get_offset())));
+		}
+		return out;
+	}
+
+	spec::abstract_def& arena_die::get_spec(root_die& r) const
+	{
+		return DEFAULT_DWARF_SPEC;
+	}
+}
@@ -0,0 +1,512 @@
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dwarfpp/lib.hpp>
+#include "dwarfidl/binary_slice.hpp"
+#include "dwarfidl/keywords.hpp"
+
+using namespace dwarf;
+using namespace dwarf::core;
+using namespace dwarf::lib;
+using encap::attribute_value;
+using encap::loc_expr;
+using dwarf::spec::opt;
+
+using std::string;
+using std::vector;
+using std::set;
+using std::unordered_map;
+using std::make_pair;
+using std::runtime_error;
+using boost::optional;
+
+namespace dwarfidl
+{
+	using namespace binslice;
+
+	namespace
+	{
+		/* These mirror the choices made by print_type_die, so that a binary
+		 * slice and a textual one carry the same information. */
+		bool child_is_printed(const iterator_base& i)
+		{
+			if (i.tag_here() > 0x4000) return false; // user tags
+			switch (i.tag_here())
+			{
+				case DW_TAG_inlined_subroutine:
+				case DW_TAG_lexical_block:
+				case DW_TAG_variable:
+					return false;
+				default:
+					return true;
+			}
+		}
+		bool attr_is_printed(Dwarf_Half attr)
+		{
+			switch (attr)
+			{
+				case DW_AT_decl_file:
+				case DW_AT_decl_line:
+				case DW_AT_prototyped:
+				case DW_AT_external:
+				case DW_AT_sibling:
+					return false;
+				default:
+					return keyword_for_attr(attr) != nullptr;
+			}
+		}
+		iterator_df<type_die> type_of(iterator_df<> die_iter)
+		{
+			auto with_type_iter = die_iter.as_a<with_type_describing_layout_die>();
+			auto returning_type_iter = die_iter.as_a<type_describing_subprogram_die>();
+			auto type_chain_iter = die_iter.as_a<type_chain_die>();
+			if (with_type_iter) return with_type_iter->get_type();
+			else if (returning_type_iter) return returning_type_iter->get_type();
+			else if (type_chain_iter) return type_chain_iter->get_type();
+			return iterator_base::END;
+		}
+
+		struct slice_writer
+		{
+			optional<type_set&> types;
+			vector<die_record> dies;
+			vector<attr_record> attrs;
+			vector<loclist_record> loclists;
+			vector<op_record> ops;
+			string strtab;
+			unordered_map<string, uint32_t> strings;
+			vector<iterator_base> order;
+			unordered_map<Dwarf_Off, uint32_t> index_of;
+
+			slice_writer(optional<type_set&> types) : types(types) {}
+
+			uint32_t intern(const string& str)
+			{
+				auto found = strings.find(str);
+				if (found != strings.end()) return found->second;
+				uint32_t off = strtab.size();
+				strtab.append(str);
+				strtab.push_back('\0');
+				strings.insert(make_pair(str, off));
+				return off;
+			}
+
+			/* First pass: number the DIEs in preorder and link up the tree. */
+			uint32_t add_subtree(const iterator_base& i, uint32_t parent)
+			{
+				uint32_t idx = dies.size();
+				die_record rec;
+				rec.orig_offset = i.offset_here();
+				rec.parent = parent;
+				rec.first_child = no_index;
+				rec.next_sibling = no_index;
+				rec.first_attr = 0;
+				rec.nattrs = 0;
+				rec.tag = i.tag_here();
+				rec.name = i.name_here() ? intern(*i.name_here()) : no_index;
+				dies.push_back(rec);
+				order.push_back(i);
+				index_of[i.offset_here()] = idx;
+
+				uint32_t prev_child = no_index;
+				auto children = i.children_here();
+				for (auto i_child = children.first; i_child != children.second; ++i_child)
+				{
+					if (!child_is_printed(i_child)) continue;
+					uint32_t child_idx = add_subtree(i_child, idx);
+					if (prev_child == no_index) dies[idx].first_child = child_idx;
+					else dies[prev_child].next_sibling = child_idx;
+					prev_child = child_idx;
+				}
+				return idx;
+			}
+
+			/* Second pass: now every DIE has an index, encode attributes. */
+			void add_attrs(uint32_t idx)
+			{
+				iterator_df<> i = order[idx];
+				dies[idx].first_attr = attrs.size();
+				/* Type references go to the deduplicated type, if we have one. */
+				opt<Dwarf_Off> type_target;
+				if (types)
+				{
+					auto t = type_of(i);
+					if (t)
+					{
+						auto found = types->find(t);
+						if (found != types->end()) type_target = found->offset_here();
+					}
+				}
+				auto attr_map = i.copy_attrs();
+				for (auto i_a = attr_map.begin(); i_a != attr_map.end(); ++i_a)
+				{
+					if (!attr_is_printed(i_a->first)) continue;
+					attr_record rec;
+					rec.attr = i_a->first;
+					rec.flags = 0;
+					rec.reserved = 0;
+					const attribute_value& v = i_a->second;
+					switch (v.get_form())
+					{
+						case attribute_value::STRING:
+							rec.form = STRING;
+							rec.value = intern(v.get_string());
+							break;
+						case attribute_value::FLAG:
+							rec.form = FLAG;
+							rec.value = v.get_flag() ? 1 : 0;
+							break;
+						case attribute_value::UNSIGNED:
+							rec.form = UNSIGNED;
+							rec.value = v.get_unsigned();
+							break;
+						case attribute_value::SIGNED:
+							rec.form = SIGNED;
+							rec.value = static_cast<uint64_t>(v.get_signed());
+							break;
+						case attribute_value::ADDR:
+							rec.form = ADDR;
+							rec.value = v.get_address().addr;
+							break;
+						case attribute_value::REF: {
+							auto ref = v.get_ref();
+							Dwarf_Off target = ref.off;
+							bool abs = ref.abs;
+							if (i_a->first == DW_AT_type && type_target)
+							{
+								target = *type_target;
+								abs = true;
+							}
+							auto found = abs ? index_of.find(target) : index_of.end();
+							if (found != index_of.end())
+							{
+								rec.form = REF_INTERNAL;
+								rec.value = found->second;
+							}
+							else
+							{
+								rec.form = REF_EXTERNAL;
+								rec.flags = abs ? REF_ABS : 0;
+								rec.value = target;
+							}
+						} break;
+						case attribute_value::LOCLIST: {
+							auto ll = v.get_loclist();
+							rec.form = LOCLIST;
+							rec.value = (static_cast<uint64_t>(loclists.size()) << 32) | ll.size();
+							for (auto i_e = ll.begin(); i_e != ll.end(); ++i_e)
+							{
+								loclist_record ent;
+								ent.lopc = i_e->lopc;
+								ent.hipc = i_e->hipc;
+								ent.first_op = ops.size();
+								ent.nops = i_e->size();
+								for (auto i_op = i_e->begin(); i_op != i_e->end(); ++i_op)
+								{
+									op_record op;
+									op.atom = i_op->lr_atom;
+									op.number = i_op->lr_number;
+									op.number2 = i_op->lr_number2;
+									op.offset = i_op->lr_offset;
+									op.reserved = 0;
+									ops.push_back(op);
+								}
+								loclists.push_back(ent);
+							}
+						} break;
+						default:
+							/* The textual printer can't round-trip these either. */
+							continue;
+					}
+					attrs.push_back(rec);
+				}
+				dies[idx].nattrs = attrs.size() - dies[idx].first_attr;
+			}
+		};
+
+		uint64_t align8(uint64_t off) { return (off + 7) & ~(uint64_t)7; }
+
+		template <typename T>
+		void write_array(std::ostream& s, uint64_t& pos, uint64_t target, const vector<T>& v)
+		{
+			static const char zeroes[8] = { 0 };
+			assert(target >= pos && target - pos < 8);
+			s.write(zeroes, target - pos);
+			s.write(reinterpret_cast<const char *>(v.data()), v.size() * sizeof (T));
+			pos = target + v.size() * sizeof (T);
+		}
+	}
+
+	void write_binary_slice(std::ostream& s, const set<iterator_base>& dies,
+		optional<type_set&> types)
+	{
+		slice_writer w(types);
+		uint32_t prev_toplevel = no_index;
+		for (auto i_d = dies.begin(); i_d != dies.end(); ++i_d)
+		{
+			/* Ancestors sort before descendants, so if we've already seen this
+			 * DIE, it was written as part of an earlier subtree. */
+			if (w.index_of.find(i_d->offset_here()) != w.index_of.end()) continue;
+			vector<iterator_base> toplevels;
+			if (i_d->tag_here() == 0)
+			{
+				/* Like print_type_die, treat the root as its children. */
+				auto children = i_d->children_here();
+				for (auto i_c = children.first; i_c != children.second; ++i_c)
+				{ toplevels.push_back(i_c); }
+			} else toplevels.push_back(*i_d);
+			for (auto i_t = toplevels.begin(); i_t != toplevels.end(); ++i_t)
+			{
+				uint32_t idx = w.add_subtree(*i_t, no_index);
+				if (prev_toplevel != no_index) w.dies[prev_toplevel].next_sibling = idx;
+				prev_toplevel = idx;
+			}
+		}
+		for (uint32_t idx = 0; idx < w.dies.size(); ++idx) w.add_attrs(idx);
+
+		header h;
+		memcpy(h.magic, binslice::magic, sizeof h.magic);
+		h.version = binslice::version;
+		h.ndies = w.dies.size();
+		h.nattrs = w.attrs.size();
+		h.nloclists = w.loclists.size();
+		h.nops = w.ops.size();
+		h.strtab_size = w.strtab.size();
+		h.dies_off = align8(sizeof h);
+		h.attrs_off = align8(h.dies_off + w.dies.size() * sizeof (die_record));
+		h.loclists_off = align8(h.attrs_off + w.attrs.size() * sizeof (attr_record));
+		h.ops_off = align8(h.loclists_off + w.loclists.size() * sizeof (loclist_record));
+		h.strtab_off = align8(h.ops_off + w.ops.size() * sizeof (op_record));
+
+		s.write(reinterpret_cast<const char *>(&h), sizeof h);
+		uint64_t pos = sizeof h;
+		write_array(s, pos, h.dies_off, w.dies);
+		write_array(s, pos, h.attrs_off, w.attrs);
+		write_array(s, pos, h.loclists_off, w.loclists);
+		write_array(s, pos, h.ops_off, w.ops);
+		write_array(s, pos, h.strtab_off, vector<char>(w.strtab.begin(), w.strtab.end()));
+	}
+
+	/* Everything the records point at must be in the file, and the links
+	 * must go the way preorder says, so that walking them terminates. */
+	static bool records_are_consistent(const mapped_binary_slice& slice)
+	{
+		const header& h = slice.hdr();
+		auto in_strtab = [&h](uint64_t off) { return off < h.strtab_size; };
+		for (uint32_t n = 0; n < h.ndies; ++n)
+		{
+			const die_record& d = slice.dies()[n];
+			if ((d.parent != no_index && d.parent >= n)
+				|| (d.first_child != no_index && (d.first_child <= n || d.first_child >= h.ndies))
+				|| (d.next_sibling != no_index && (d.next_sibling <= n || d.next_sibling >= h.ndies))
+				|| (d.name != no_index && !in_strtab(d.name))
+				|| d.first_attr > h.nattrs || d.nattrs > h.nattrs - d.first_attr)
+			{
+				return false;
+			}
+		}
+		for (uint32_t n = 0; n < h.nattrs; ++n)
+		{
+			const attr_record& a = slice.attrs()[n];
+			switch (a.form)
+			{
+				case STRING:
+					if (!in_strtab(a.value)) return false;
+					break;
+				case REF_INTERNAL:
+					if (a.value >= h.ndies) return false;
+					break;
+				case LOCLIST: {
+					uint32_t first = a.value >> 32;
+					uint32_t count = a.value & 0xffffffffu;
+					if (first > h.nloclists || count > h.nloclists - first) return false;
+				} break;
+				case FLAG: case UNSIGNED: case SIGNED: case ADDR: case REF_EXTERNAL:
+					break;
+				default:
+					return false;
+			}
+		}
+		for (uint32_t n = 0; n < h.nloclists; ++n)
+		{
+			const loclist_record& ent = slice.loclists()[n];
+			if (ent.first_op > h.nops || ent.nops > h.nops - ent.first_op) return false;
+		}
+		return true;
+	}
+
+	mapped_binary_slice::mapped_binary_slice(const string& path)
+	 : m_base(MAP_FAILED), m_length(0), m_fd(-1)
+	{
+		m_fd = open(path.c_str(), O_RDONLY);
+		if (m_fd == -1) throw runtime_error("could not open binary slice " + path);
+		struct stat st;
+		if (fstat(m_fd, &st) == -1 || st.st_size < (off_t) sizeof (header))
+		{
+			close(m_fd);
+			throw runtime_error("binary slice " + path + " is truncated");
+		}
+		m_length = st.st_size;
+		m_base = mmap(nullptr, m_length, PROT_READ, MAP_SHARED, m_fd, 0);
+		if (m_base == MAP_FAILED)
+		{
+			close(m_fd);
+			throw runtime_error("could not map binary slice " + path);
+		}
+		const header& h = hdr();
+		auto fits = [this](uint64_t off, uint64_t n, size_t sz) {
+			return off <= m_length && n <= (m_length - off) / sz;
+		};
+		if (0 != memcmp(h.magic, binslice::magic, sizeof h.magic)
+			|| h.version != binslice::version
+			|| !fits(h.dies_off, h.ndies, sizeof (die_record))
+			|| !fits(h.attrs_off, h.nattrs, sizeof (attr_record))
+			|| !fits(h.loclists_off, h.nloclists, sizeof (loclist_record))
+			|| !fits(h.ops_off, h.nops, sizeof (op_record))
+			|| !fits(h.strtab_off, h.strtab_size, 1)
+			|| (h.strtab_size > 0 && string_at(h.strtab_size - 1)[0] != '\0')
+			|| !records_are_consistent(*this))
+		{
+			munmap(m_base, m_length);
+			close(m_fd);
+			throw runtime_error("bad binary slice " + path);
+		}
+	}
+
+	mapped_binary_slice::~mapped_binary_slice()
+	{
+		munmap(m_base, m_length);
+		close(m_fd);
+	}
+
+	/* Internal references are mapped to offsets by 'offset_of', which
+	 * differs between a loaded copy and a view of the mapping. */
+	template <typename OffsetOf>
+	static attribute_value decode_attr(const mapped_binary_slice& slice,
+		const attr_record& a, root_die& r, Dwarf_Off context_off,
+		const OffsetOf& offset_of)
+	{
+		switch (a.form)
+		{
+			case STRING:
+				return attribute_value(string(slice.string_at(a.value)));
+			case FLAG:
+				return attribute_value(static_cast<Dwarf_Bool>(a.value));
+			case UNSIGNED:
+				return attribute_value(static_cast<Dwarf_Unsigned>(a.value));
+			case SIGNED:
+				return attribute_value(static_cast<Dwarf_Signed>(a.value));
+			case ADDR:
+				return attribute_value(attribute_value::address{a.value});
+			case REF_INTERNAL:
+				assert(a.value < slice.hdr().ndies);
+				return attribute_value(attribute_value::weak_ref(r,
+					offset_of(a.value), true, context_off, a.attr));
+			case REF_EXTERNAL:
+				return attribute_value(attribute_value::weak_ref(r,
+					a.value, a.flags & REF_ABS, context_off, a.attr));
+			case LOCLIST: {
+				uint32_t first = a.value >> 32;
+				uint32_t count = a.value & 0xffffffffu;
+				if (first > slice.hdr().nloclists || count > slice.hdr().nloclists - first)
+				{ throw runtime_error("bad location list in binary slice"); }
+				encap::loclist ll;
+				for (uint32_t n = first; n < first + count; ++n)
+				{
+					const loclist_record& ent = slice.loclists()[n];
+					if (ent.first_op > slice.hdr().nops || ent.nops > slice.hdr().nops - ent.first_op)
+					{ throw runtime_error("bad location expression in binary slice"); }
+					loc_expr expr;
+					expr.lopc = ent.lopc;
+					expr.hipc = ent.hipc;
+					for (uint32_t o = ent.first_op; o < ent.first_op + ent.nops; ++o)
+					{
+						const op_record& op = slice.ops()[o];
+						Dwarf_Loc loc;
+						loc.lr_atom = op.atom;
+						loc.lr_number = op.number;
+						loc.lr_number2 = op.number2;
+						loc.lr_offset = op.offset;
+						expr.push_back(loc);
+					}
+					ll.push_back(expr);
+				}
+				return attribute_value(ll);
+			}
+			default:
+				throw runtime_error("bad attribute form in binary slice");
+		}
+	}
+
+	attribute_value decode_binary_slice_attr(const mapped_binary_slice& slice,
+		const attr_record& a, root_die& r, Dwarf_Off context_off,
+		Dwarf_Off internal_base)
+	{
+		return decode_attr(slice, a, r, context_off,
+			[internal_base](uint32_t idx) { return internal_base + idx; });
+	}
+
+	iterator_base load_binary_slice(const iterator_base& parent, const mapped_binary_slice& slice)
+	{
+		const header& h = slice.hdr();
+		const die_record *dies = slice.dies();
+		iterator_base first_created;
+		iterator_base real_parent;
+		root_die& root = parent.get_root();
+
+		/* Are we creating a compilation unit? */
+		if ((h.ndies == 0 || dies[0].tag != DW_TAG_compile_unit)
+			&& parent.enclosing_cu() == iterator_base::END)
+		{
+			/* Not under a compilation unit; add one and continue. */
+			auto dummy_cu = root.make_new(root.begin(), DW_TAG_compile_unit);
+			first_created = dummy_cu;
+			real_parent = dummy_cu;
+		} else real_parent = parent;
+
+		/* Records are in preorder, so parents are created before children
+		 * and offsets come out in the same order as indices. */
+		vector<iterator_base> created;
+		created.reserve(h.ndies);
+		for (uint32_t idx = 0; idx < h.ndies; ++idx)
+		{
+			const die_record& d = dies[idx];
+			if (d.parent != no_index && d.parent >= idx)
+			{ throw runtime_error("binary slice is not in preorder"); }
+			created.push_back(root.make_new(
+				(d.parent == no_index) ? real_parent : created[d.parent], d.tag));
+			if (!first_created) first_created = created.back();
+		}
+		/* Now every DIE exists, references can be filled in. */
+		for (uint32_t idx = 0; idx < h.ndies; ++idx)
+		{
+			const die_record& d = dies[idx];
+			if (d.first_attr > h.nattrs || d.nattrs > h.nattrs - d.first_attr)
+			{ throw runtime_error("bad attribute range in binary slice"); }
+			auto& attrs = dynamic_cast<core::in_memory_abstract_die&>(
+				created[idx].dereference()).attrs();
+			for (uint32_t n = d.first_attr; n < d.first_attr + d.nattrs; ++n)
+			{
+				const attr_record& a = slice.attrs()[n];
+				attrs.insert(make_pair(a.attr, decode_attr(slice, a, root,
+					created[idx].offset_here(),
+					[&created](uint32_t i) { return created[i].offset_here(); })));
+			}
+		}
+		return first_created;
+	}
+
+	iterator_base load_binary_slice(const iterator_base& parent, const string& path)
+	{
+		mapped_binary_slice slice(path);
+		return load_binary_slice(parent, slice);
+	}
+}
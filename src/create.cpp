@@ -8,18 +8,26 @@
 #define PARSER_INCLUDE "dwarfidlNewCParser.h"
 #endif
 #include "dwarfidl/create.hpp"
+#include "dwarfidl/arena_root.hpp"
 #include "dwarfprint.hpp"
+#include "dwarfidl/keywords.hpp"
+#include "dwarfidl/metrics.hpp"
+#include "dwarfidl/log.hpp"
 #include <boost/algorithm/string/case_conv.hpp>
 #include <string>
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <cstring>
 #include <exception>
+#include <stdexcept>
+#include <memory>
+#include <thread>
 
 using namespace dwarf;
 using namespace dwarf::core;
 using encap::attribute_value;
 using encap::loc_expr;
-using dwarf::spec::DEFAULT_DWARF_SPEC;
 
 using std::cerr;
 using std::string;
@@ -60,10 +68,33 @@ template <typename T> inline T node_text_to(Tree *node) {
 
 namespace dwarfidl
 {
+	/* The index that state asks for, else the root's own, if any. */
+	static resolution_index *index_for(const iterator_base& context, creation_state *state)
+	{
+		if (state && state->index) return state->index;
+		arena_root_die *arena_root = dynamic_cast<arena_root_die *>(&context.get_root());
+		return arena_root ? &arena_root->resolution() : nullptr;
+	}
+
+	/* Resolve a single name as seen from context. In an arena root, a name
+	 * that was never interned can't be any DIE's. */
+	static iterator_base resolve_ident(const iterator_base& context, const string& ident,
+		creation_state *state)
+	{
+		metrics::count(metrics::SCOPED_RESOLVE_CALLS);
+		arena_root_die *arena_root = dynamic_cast<arena_root_die *>(&context.get_root());
+		if (arena_root && !arena_root->strings().find(ident)) return iterator_base::END;
+		resolution_index *index = index_for(context, state);
+		if (index) return index->resolve(context, ident);
+		std::vector<string> name(1, ident);
+		return context.root().scoped_resolve(context, name.begin(), name.end());
+	}
+
 	attribute_value make_attribute_value(Tree *d, 
 		const iterator_base& context, 
 		Dwarf_Half attr,
-		const std::map<Tree *, iterator_base>& nested)
+		const std::map<Tree *, iterator_base>& nested,
+		creation_state *state /* = nullptr */)
 	{
 		switch (GET_TYPE(d))
 		{
@@ -89,10 +120,19 @@ namespace dwarfidl
 
 				if (attr != DW_AT_name) 
 				{
-					/* unless we're naming something, resolve this ident */
-					std::vector<string> name(1, unescape_ident(identifier));
-					auto found = context.root().scoped_resolve(context,
-						name.begin(), name.end());
+					/* unless we're naming something, resolve this ident,
+					 * if create_one_die_with_children hasn't already */
+					auto already = nested.find(d);
+					auto found = (already != nested.end()) ? already->second
+						: resolve_ident(context, unescape_ident(identifier), state);
+					if ((!found || found.tag_here() == 0 || found.offset_here() == 0)
+						&& state && state->deferred && dynamic_cast<arena_root_die *>(&context.get_root()))
+					{
+						deferred_ref ref = { context.offset_here(), attr, unescape_ident(identifier) };
+						state->deferred->push_back(ref);
+						return attribute_value(attribute_value::weak_ref(context.get_root(),
+							arena_root_die::pending_ref, true, context.offset_here(), attr));
+					}
 					if (!found || found.tag_here() == 0 || found.offset_here() == 0) 
 					{
 						throw ident_not_found(identifier);
@@ -128,7 +168,7 @@ namespace dwarfidl
 				return attribute_value(static_cast<Dwarf_Bool>(0));
 			} break;
 			case TOKEN(OPCODE_LIST): {
-				loc_expr *expr = new loc_expr;
+				loc_expr expr;
 				FOR_ALL_CHILDREN(d)
 				{
 					assert(GET_TYPE(n) == TOKEN(OPCODE));
@@ -139,8 +179,7 @@ namespace dwarfidl
 					if (child_count >= 1)
 					{
 						BIND2(n, opcode);
-						auto opcode_str = string("DW_OP_") + string(CCP(GET_TEXT(opcode)));
-						op.lr_atom = DEFAULT_DWARF_SPEC.op_for_name(opcode_str.c_str());
+						op.lr_atom = op_for_keyword(CCP(GET_TEXT(opcode)));
 						if (child_count >= 2)
 						{
 							BIND2(n, arg1);
@@ -152,18 +191,39 @@ namespace dwarfidl
 							}
 						}
 					}
-					expr->push_back(op);
+					expr.push_back(op);
 				}
-				return attribute_value(expr);
+				encap::loclist ll;
+				ll.push_back(expr);
+				return attribute_value(ll);
 			} break;
 			default:  // FIXME: support more
 				assert(false);
 		}
 	}
 	
+	/* Install a DIE's attributes in one go. Arena roots keep their own
+	 * attribute lists. As before, the first of any repeated attribute wins. */
+	static void add_attributes(const iterator_base& created, attribute_list& attrs)
+	{
+		arena_root_die *arena_root = dynamic_cast<arena_root_die *>(&created.get_root());
+		if (arena_root) { arena_root->set_attrs(created, attrs); return; }
+		std::stable_sort(attrs.begin(), attrs.end(),
+			[](const pair<Dwarf_Half, attribute_value>& a, const pair<Dwarf_Half, attribute_value>& b) {
+				return a.first < b.first;
+			});
+		auto& m = dynamic_cast<core::in_memory_abstract_die&>(created.dereference()).attrs();
+		for (auto i_a = attrs.begin(); i_a != attrs.end(); ++i_a)
+		{
+			/* Sorted, so the end is the right hint unless m had some already. */
+			if (m.find(i_a->first) == m.end()) m.insert(m.end(), *i_a);
+		}
+	}
+
 	iterator_base create_one_die(const iterator_base& parent, Tree *d,
 								  vector<pair<const iterator_base&, Tree*> > &postpone,
-								  const std::map<Tree *, iterator_base>& nested /* = ... */)
+								  const std::map<Tree *, iterator_base>& nested /* = ... */,
+								  creation_state *state /* = nullptr */)
 	{
 		INIT;
 		BIND2(d, tag_keyword);
@@ -172,18 +232,24 @@ namespace dwarfidl
 		
 		const char *tagstr = CCP(GET_TEXT(tag_keyword));
 		
-		Dwarf_Half tag = DEFAULT_DWARF_SPEC.tag_for_name((string("DW_TAG_") + tagstr).c_str());
+		Dwarf_Half tag = tag_for_keyword(tagstr);
 		
 		auto created = parent.get_root().make_new(parent, tag);
 		
 		/* create attributes */
+		attribute_list values;
+		values.reserve(GET_CHILD_COUNT(attrs));
+		/* References to our own DIEs, as opposed to "@offset" ones. */
+		vector<Dwarf_Half> local_refs;
 		FOR_ALL_CHILDREN(attrs)
 		{
 			INIT;
 			BIND2(n, attr);
 			BIND2(n, value);
+			/* Footprints aren't DWARF; see footprint.hpp. */
+			if (GET_TYPE(attr) == TOKEN(FOOTPRINT)) continue;
 			
-			string attrstr = CCP(TO_STRING(attr));
+			const char *attrstr = CCP(TO_STRING(attr));
 			/*
 			 * HACK HACK HACK: 
 			 * 
@@ -198,38 +264,42 @@ namespace dwarfidl
 			 * 
 			 * My workaround for now is to define imaginary tokens NAME and TYPE, 
 			 * which means instead of "160" we get "NAME" etc., 
-			 * and then to_lower() on the string.
+			 * and then look the string up ignoring case.
 			 */
 			
-			Dwarf_Half attrnum = created.spec_here().attr_for_name(("DW_AT_" + to_lower_copy(attrstr)).c_str());
+			Dwarf_Half attrnum = attr_for_keyword(attrstr);
 			try {
-				encap::attribute_value v = make_attribute_value(value, created, attrnum, nested);
-				// FIXME HACK
-				if (attrnum == DW_AT_type) 
+				values.push_back(make_pair(attrnum,
+					make_attribute_value(value, created, attrnum, nested, state)));
+				if (values.back().second.is_ref() && GET_TYPE(value) != TOKEN(ABSOLUTE_OFFSET))
 				{
-					if (v.is_address()) 
-					{
-						cerr << "checking addr != 0..." << endl;
-						assert(v.get_address().addr != 0);
-					}
-					if (v.is_ref())
-					{
-						cerr << "checking ref != 0..." << endl;
-						assert(v.get_ref().off != 0);
-					}
+					local_refs.push_back(attrnum);
 				}
-
-				dynamic_cast<core::in_memory_abstract_die&>(created.dereference())
-					.attrs()
-					.insert(make_pair(attrnum, v));
+				// FIXME HACK
+				assert(attrnum != DW_AT_type
+					|| (!values.back().second.is_address() || values.back().second.get_address().addr != 0));
+				assert(attrnum != DW_AT_type
+					|| (!values.back().second.is_ref() || values.back().second.get_ref().off != 0));
 			} catch (ident_not_found const &e) {
-				cerr << "Ident not found: '" << e.what() << "', postponing to next pass" << endl;
+				DWARFIDL_LOG(1, "Ident not found: '" << e.what() << "', postponing to next pass" << endl);
 				postpone.push_back(pair<const iterator_base&, Tree*>(parent, d));
 				return parent.root().end();
 			}
 		}
+		add_attributes(created, values);
+		arena_root_die *arena_root = dynamic_cast<arena_root_die *>(&created.get_root());
+		if (arena_root)
+		{
+			for (auto i_a = local_refs.begin(); i_a != local_refs.end(); ++i_a)
+			{
+				arena_root->mark_local_ref(created, *i_a);
+			}
+		}
+
+		resolution_index *index = index_for(created, state);
+		if (index) index->add(created);
 
-		if (getenv("DEBUG_CC")) {
+		if (DWARFIDL_LOG_ENABLED(3)) {
 			cerr << "Created DIE: ";
 			created.print_with_attrs(cerr);
 			//print_type_die(cerr, created);
@@ -238,90 +308,230 @@ namespace dwarfidl
 		return created;
 	}
 	
-	iterator_base create_one_die_with_children(const iterator_base& parent,
-												Tree *d,
-												vector<pair<const iterator_base&, Tree*> > &postpone)
+	static string idents_text(Tree *idents)
 	{
-		cerr << "Creating a DIE from " << CCP(TO_STRING_TREE(d)) << endl;
+		ostringstream os;
+		bool first = true;
+		FOR_ALL_CHILDREN(idents)
+		{
+			if (first) first = false;
+			else os << " ";
+			os << CCP(GET_TEXT(n));
+		}
+		return os.str();
+	}
 
+	/* Find or create the inline DIEs in d's attributes, and resolve the
+	 * names it refers to, so that create_one_die needn't. False, having
+	 * postponed d, if a name won't resolve yet. */
+	static bool resolve_nested(const iterator_base& parent, Tree *d,
+		vector<pair<const iterator_base&, Tree*> > &postpone,
+		std::map<Tree *, iterator_base>& nested, creation_state *state)
+	{
 		INIT;
 		BIND2(d, tag_keyword);
 		BIND3(d, attrs, ATTRS);
-		BIND3(d, children, CHILDREN);
-		map<Tree *, iterator_base> nested;
-		/* scan for nested non-child DIEs */
+		FOR_ALL_CHILDREN(attrs)
 		{
-			FOR_ALL_CHILDREN(attrs)
+			INIT;
+			BIND2(n, attr);
+			BIND2(n, value);
+			if (GET_TYPE(attr) == TOKEN(FOOTPRINT)) continue;
+			switch (GET_TYPE(value))
 			{
-				INIT;
-				BIND2(n, attr);
-				BIND2(n, value);
+				case TOKEN(DIE): {
+					/* It's an inline DIE: we need to find a matching DIE or create it.
+					 * If we create it, create it as a sibling */
+					iterator_base sub_die = find_or_create_die(parent, value, postpone, state);
+					nested[value] = sub_die;
+				} break;
+				case TOKEN(IDENTS): {
+					/* If we're an ident, then either we're giving a new name to a thing, 
+					 * or we're referencing an existing thing by name . We only care about 
+					 * the latter case. */
+					if (attr_for_keyword(CCP(TO_STRING(attr))) == DW_AT_name) break;
 				
-				switch (GET_TYPE(value))
-				{
-					case TOKEN(DIE): {
-						/* It's an inline DIE: we need to find a matching DIE or create it.
-						 * If we create it, create it as a sibling */
-						iterator_base sub_die = find_or_create_die(parent, value, postpone);
-						nested[value] = sub_die;
-					} break;
-					case TOKEN(IDENT): {
-						/* If we're an ident, then either we're giving a new name to a thing, 
-						 * or we're referencing an existing thing by name . We only care about 
-						 * the latter case. */
-						if (to_lower_copy(string(CCP(GET_TEXT(attr)))) == "name") break;
-					
-						vector<string> name(1, string(unescape_ident(CCP(GET_TEXT(value)))));
-						iterator_base found = parent.root().scoped_resolve(parent, 
-							name.begin(), name.end());
-						if (!found) {
-							 cerr << "Could not resolve name " << CCP(TO_STRING_TREE(value)) << ", postponing to next pass" << endl;
-							 postpone.push_back(pair<const iterator_base&, Tree*>(parent, d));
-							 return parent.root().end();
-						}
-						nested[value] = found;
-						break;
+					iterator_base found = resolve_ident(parent, unescape_ident(idents_text(value)), state);
+					if (!found && state && state->deferred
+						&& dynamic_cast<arena_root_die *>(&parent.get_root())) break;
+					if (!found) {
+						 DWARFIDL_LOG(1, "Could not resolve name " << CCP(TO_STRING_TREE(value)) << ", postponing to next pass" << endl);
+						 postpone.push_back(pair<const iterator_base&, Tree*>(parent, d));
+						 return false;
 					}
-					default:
-						cerr << "Subtree " << CCP(TO_STRING_TREE(value)) 
-							<< " is not a nested DIE" << endl;
-						break;
+					nested[value] = found;
+					break;
 				}
+				default:
+					DWARFIDL_LOG(2, "Subtree " << CCP(TO_STRING_TREE(value)) 
+						<< " is not a nested DIE" << endl);
+					break;
 			}
 		}
+		return true;
+	}
 
-		auto created = create_one_die(parent, d, postpone, nested);
+	static iterator_base create_with_nested(const iterator_base& parent, Tree *d,
+		vector<pair<const iterator_base&, Tree*> > &postpone,
+		const std::map<Tree *, iterator_base>& nested, creation_state *state)
+	{
+		INIT;
+		BIND2(d, tag_keyword);
+		BIND3(d, attrs, ATTRS);
+		BIND3(d, children, CHILDREN);
+		auto created = create_one_die(parent, d, postpone, nested, state);
 		
 		FOR_ALL_CHILDREN(children)
 		{
-			create_one_die_with_children(created, n, postpone);
+			create_one_die_with_children(created, n, postpone, state);
 		}
 		
 		return created;
 	}
 
-	iterator_base find_or_create_die(const iterator_base& parent, Tree *ast, std::vector<std::pair<const iterator_base&, antlr::tree::Tree*> > &postpone)
+	iterator_base create_one_die_with_children(const iterator_base& parent,
+												Tree *d,
+												vector<pair<const iterator_base&, Tree*> > &postpone,
+												creation_state *state /* = nullptr */)
+	{
+		DWARFIDL_LOG(2, "Creating a DIE from " << CCP(TO_STRING_TREE(d)) << endl);
+		map<Tree *, iterator_base> nested;
+		/* scan for nested non-child DIEs */
+		if (!resolve_nested(parent, d, postpone, nested, state)) return parent.root().end();
+		return create_with_nested(parent, d, postpone, nested, state);
+	}
+
+	/* Where to look for inline DIEs to share. */
+	static structural_index *structure_for(const iterator_base& context, creation_state& state)
 	{
-		/* Sometimes we can search for an existing DIE. But currently we blindly
-		 * re-create DIEs that might already be existing. */
-		// auto found = parent.root().scoped_resolve(
-		return create_one_die_with_children(parent, ast, postpone);
+		if (state.structure) return state.structure;
+		arena_root_die *arena_root = dynamic_cast<arena_root_die *>(&context.get_root());
+		if (arena_root) return &arena_root->structure();
+		if (!state.own_structure) state.own_structure.reset(new structural_index(context.get_root()));
+		return state.own_structure.get();
 	}
 
-	iterator_base create_dies(Tree *ast) {
-		in_memory_root_die *root = new in_memory_root_die;
-		auto iter = root->begin();
-		create_dies(iter, ast);
-		return iter;
+	/* Write the structural_index key for the DIE that d would create under
+	 * parent; false if some name in it doesn't resolve yet. The inline DIEs
+	 * and names of d itself are in nested, as resolve_nested left them;
+	 * without it, as for children, inline DIEs go in by their own keys and
+	 * names are resolved from parent. */
+	static bool write_structural_key(std::ostream& s, const iterator_base& parent, Tree *d,
+		const std::map<Tree *, iterator_base> *nested, creation_state *state)
+	{
+		INIT;
+		BIND2(d, tag_keyword);
+		BIND3(d, attrs, ATTRS);
+		BIND3(d, children, CHILDREN);
+		/* In attribute order, and the first of any repeat, as the DIE
+		 * will have them. */
+		vector<pair<Dwarf_Half, string> > keyed;
+		FOR_ALL_CHILDREN(attrs)
+		{
+			INIT;
+			BIND2(n, attr);
+			BIND2(n, value);
+			if (GET_TYPE(attr) == TOKEN(FOOTPRINT)) continue;
+			Dwarf_Half attrnum = attr_for_keyword(CCP(TO_STRING(attr)));
+			ostringstream a;
+			auto found = nested ? nested->find(value) : std::map<Tree *, iterator_base>::const_iterator();
+			if (nested && found != nested->end())
+			{
+				if (!found->second) return false;
+				structural_index::write_ref(a, attrnum, found->second.offset_here());
+			}
+			else if (GET_TYPE(value) == TOKEN(DIE))
+			{
+				if (nested) return false;
+				a << attrnum << "=<";
+				if (!write_structural_key(a, parent, value, nullptr, state)) return false;
+				a << ">;";
+			}
+			else if (GET_TYPE(value) == TOKEN(IDENTS) && attrnum != DW_AT_name)
+			{
+				/* With nested, it would be there if it resolved. */
+				if (nested) return false;
+				iterator_base target = resolve_ident(parent, unescape_ident(idents_text(value)), state);
+				if (!target) return false;
+				structural_index::write_ref(a, attrnum, target.offset_here());
+			}
+			else
+			{
+				structural_index::write_attr(a, attrnum,
+					make_attribute_value(value, parent, attrnum, std::map<Tree *, iterator_base>(), state));
+			}
+			keyed.push_back(make_pair(attrnum, a.str()));
+		}
+		std::stable_sort(keyed.begin(), keyed.end(),
+			[](const pair<Dwarf_Half, string>& x, const pair<Dwarf_Half, string>& y) {
+				return x.first < y.first;
+			});
+		s << tag_for_keyword(CCP(GET_TEXT(tag_keyword))) << "[";
+		for (auto i_k = keyed.begin(); i_k != keyed.end(); ++i_k)
+		{
+			if (i_k == keyed.begin() || (i_k - 1)->first != i_k->first) s << i_k->second;
+		}
+		s << "]{";
+		FOR_ALL_CHILDREN(children)
+		{
+			s << "(";
+			if (!write_structural_key(s, parent, n, nullptr, state)) return false;
+			s << ")";
+		}
+		s << "}";
+		return true;
+	}
+
+	iterator_base find_or_create_die(const iterator_base& parent, Tree *ast,
+		std::vector<std::pair<const iterator_base&, antlr::tree::Tree*> > &postpone,
+		creation_state *state /* = nullptr */)
+	{
+		if (!state) return create_one_die_with_children(parent, ast, postpone);
+		DWARFIDL_LOG(2, "Finding or creating a DIE from " << CCP(TO_STRING_TREE(ast)) << endl);
+		map<Tree *, iterator_base> nested;
+		if (!resolve_nested(parent, ast, postpone, nested, state)) return parent.root().end();
+
+		ostringstream key;
+		bool keyed = write_structural_key(key, parent, ast, &nested, state);
+		structural_index *structure = structure_for(parent, *state);
+		iterator_base cu = parent.enclosing_cu();
+		if (keyed)
+		{
+			INIT;
+			BIND2(ast, tag_keyword);
+			iterator_base found = structure->find(cu, tag_for_keyword(CCP(GET_TEXT(tag_keyword))), key.str());
+			if (found)
+			{
+				metrics::count(metrics::INLINE_DIES_SHARED);
+				return found;
+			}
+		}
+		auto created = create_with_nested(parent, ast, postpone, nested, state);
+		if (keyed && created != parent.root().end()) structure->add(cu, key.str(), created);
+		if (state->inlined && created != parent.root().end()) state->inlined->push_back(created.offset_here());
+		return created;
+	}
+
+	std::unique_ptr<arena_root_die> create_dies(Tree *ast) {
+		std::unique_ptr<arena_root_die> root(new arena_root_die);
+		create_dies(root->begin(), ast);
+		return root;
 	}
 
 
 	iterator_base create_dies(const iterator_base& parent, Tree *ast)
 	{
+		creation_state state;
+		return create_dies(parent, ast, state);
+	}
+
+	iterator_base create_dies(const iterator_base& parent, Tree *ast, creation_state& state)
+	{
+		metrics::phase_timer timer(metrics::CREATE);
 		/* Walk the tree. Create any DIE we see. We also have to
 		 * scan attrs and create any that are inlined and do not
 		 * already exist. */
-		cerr << "Got AST: " << CCP(TO_STRING_TREE(ast)) << endl;
+		DWARFIDL_LOG(2, "Got AST: " << CCP(TO_STRING_TREE(ast)) << endl);
 		iterator_base first_created;
 		iterator_df<> real_parent;
 
@@ -330,7 +540,7 @@ namespace dwarfidl
 			// pre-pass: grab the first DIE's tag keyword
 			FOR_ALL_CHILDREN(ast)
 			{
-				cerr << "Got a node: " << CCP(TO_STRING_TREE(n)) << endl;
+				DWARFIDL_LOG(2, "Got a node: " << CCP(TO_STRING_TREE(n)) << endl);
 				SELECT_ONLY(DIE);
 				INIT;
 				BIND2(n, tag_keyword);
@@ -354,15 +564,15 @@ namespace dwarfidl
 		// Initial pass: go straight from AST
 		FOR_ALL_CHILDREN(ast)
 		{
-			cerr << "Got a node: " << CCP(TO_STRING_TREE(n)) << endl;
+			DWARFIDL_LOG(2, "Got a node: " << CCP(TO_STRING_TREE(n)) << endl);
 			SELECT_ONLY(DIE);
 			INIT;
 			BIND2(n, tag_keyword);
 			
-			auto created = create_one_die_with_children(real_parent, n, postpone);
+			auto created = create_one_die_with_children(real_parent, n, postpone, &state);
 			if (!first_created) first_created = created;
 
-			if (getenv("DEBUG_CC")) cerr << "Created one DIE and its children; we now have: " << endl << parent.root();
+			DWARFIDL_LOG(3, "Created one DIE and its children; we now have: " << endl << parent.root());
 		}
 
 		// postpone now contains pairs of (parent, parse tree) for
@@ -372,7 +582,9 @@ namespace dwarfidl
 		// or failed to do so
 		int postponed_pass_n = 0;
 		while (postpone.size() > 0) {
-			 cerr << "=== POSTPONED PASS " << ++postponed_pass_n << " ===" << endl;
+			 ++postponed_pass_n;
+			 DWARFIDL_LOG(1, "=== POSTPONED PASS " << postponed_pass_n << " ===" << endl);
+			 metrics::count(metrics::POSTPONED_PASSES);
 			 
 			 auto old_size = postpone.size();
 			 auto old_postpone = postpone;
@@ -380,7 +592,7 @@ namespace dwarfidl
 			 for (auto iter = old_postpone.begin(); iter != old_postpone.end(); iter++) {
 				  auto postponed_parent = iter->first;
 				  auto postponed_tree = iter->second;
-				  create_one_die_with_children(postponed_parent, postponed_tree, postpone);
+				  create_one_die_with_children(postponed_parent, postponed_tree, postpone, &state);
 			 }
 			 auto new_size = postpone.size();
 			 assert(old_size > new_size);
@@ -391,7 +603,12 @@ namespace dwarfidl
 	
 	iterator_base create_dies(const iterator_base& parent, const string& some_dwarfidl)
 	{
-		
+		creation_state state;
+		return create_dies(parent, some_dwarfidl, state);
+	}
+
+	iterator_base create_dies(const iterator_base& parent, const string& some_dwarfidl, creation_state& state)
+	{
 		/* Also open a dwarfidl file, read some DIE definitions from it. */
 		auto str = antlr3StringStreamNew(
 			const_cast<unsigned char *>(reinterpret_cast<const unsigned char *>(some_dwarfidl.c_str())), 
@@ -403,13 +620,240 @@ namespace dwarfidl
 		auto lexer = dwarfidlNewCLexerNew(str);
 		auto tokenStream = antlr3CommonTokenStreamSourceNew(ANTLR3_SIZE_HINT, TOKENSOURCE(lexer));
 		auto parser = dwarfidlNewCParserNew(tokenStream);
-		dwarfidlNewCParser_toplevel_return ret = parser->toplevel(parser);
-		Tree *tree = ret.tree;
+		Tree *tree;
+		{
+			metrics::phase_timer timer(metrics::PARSE);
+			dwarfidlNewCParser_toplevel_return ret = parser->toplevel(parser);
+			tree = ret.tree;
+		}
 
-		iterator_base first_created = create_dies(parent, tree);
+		iterator_base first_created = create_dies(parent, tree, state);
 
-		if (getenv("DEBUG_CC")) cerr << "Created some more stuff; whole tree is now: " << endl << parent.get_root();
+		DWARFIDL_LOG(3, "Created some more stuff; whole tree is now: " << endl << parent.get_root());
 		
 		return first_created;
 	}
+
+	iterator_base create_dies_cached(const iterator_base& parent, const string& some_dwarfidl, creation_state& state)
+	{
+		auto cu = parent.enclosing_cu();
+		ostringstream key;
+		key << (cu ? cu.offset_here() : 0) << ":" << some_dwarfidl;
+		auto found = state.snippets.find(key.str());
+		if (found != state.snippets.end())
+		{
+			metrics::count(metrics::SNIPPET_CACHE_HITS);
+			return found->second;
+		}
+		auto created = create_dies(parent, some_dwarfidl, state);
+		state.snippets.insert(make_pair(key.str(), created));
+		return created;
+	}
+
+	/* Split text into at most n pieces, each a run of whole top-level
+	 * DIEs (which end with a ';' outside any brackets), of roughly equal
+	 * size. Also say whether the first DIE is a compile_unit. */
+	static vector<string> split_toplevel(const string& text, unsigned n, bool *compile_units)
+	{
+		vector<size_t> ends;
+		int depth = 0;
+		for (size_t i = 0; i < text.size(); ++i)
+		{
+			char c = text[i];
+			if (c == '\\') ++i;
+			else if (c == '"')
+			{
+				for (++i; i < text.size() && text[i] != '"'; ++i) if (text[i] == '\\') ++i;
+			}
+			else if (c == '/' && i + 1 < text.size() && text[i + 1] == '/')
+			{
+				while (i < text.size() && text[i] != '\n') ++i;
+			}
+			else if (c == '/' && i + 1 < text.size() && text[i + 1] == '*')
+			{
+				i = text.find("*/", i + 2);
+				if (i == string::npos) break;
+				++i;
+			}
+			else if (c == '(' || c == '{' || c == '[') ++depth;
+			else if (c == ')' || c == '}' || c == ']') --depth;
+			else if (c == ';' && depth == 0) ends.push_back(i + 1);
+		}
+		size_t first_word = text.find_first_not_of(" \t\r\n");
+		*compile_units = first_word != string::npos
+			&& text.compare(first_word, sizeof "compile_unit" - 1, "compile_unit") == 0;
+
+		vector<string> pieces;
+		size_t start = 0;
+		for (auto i_e = ends.begin(); i_e != ends.end(); ++i_e)
+		{
+			size_t remaining = n - pieces.size();
+			if (remaining > 1 && *i_e - start >= (text.size() - start) / remaining)
+			{
+				pieces.push_back(text.substr(start, *i_e - start));
+				start = *i_e;
+			}
+		}
+		if (start < text.size())
+		{
+			/* Trailing blanks aren't worth a thread. */
+			if (!pieces.empty() && text.find_first_not_of(" \t\r\n", start) == string::npos)
+			{
+				pieces.back() += text.substr(start);
+			}
+			else pieces.push_back(text.substr(start));
+		}
+		return pieces;
+	}
+
+	/* Mark dup and its descendants as replaced by keep and its. */
+	static void replace_subtree(const iterator_base& dup, const iterator_base& keep,
+		std::map<Dwarf_Off, Dwarf_Off>& same)
+	{
+		same[dup.offset_here()] = keep.offset_here();
+		auto d = dup.children_here(), k = keep.children_here();
+		for (; d.first != d.second && k.first != k.second; ++d.first, ++k.first)
+		{
+			replace_subtree(d.first, k.first, same);
+		}
+	}
+
+	/* Hash-cons the inline DIEs each part created on its own, now that
+	 * their names are resolved: key each, in order, in the root's
+	 * structural_index, and where one is already there, point references
+	 * at that one instead. Sharing one can make others the same, so go
+	 * round until nothing changes, then drop the copies. Returns where
+	 * each offset went, or nothing if no DIE moved. */
+	static vector<Dwarf_Off> share_inline_dies(arena_root_die& root, Dwarf_Off first_adopted,
+		const vector<Dwarf_Off>& inlined)
+	{
+		std::map<Dwarf_Off, Dwarf_Off> same;
+		auto settled = [&same](Dwarf_Off off) {
+			for (auto found = same.find(off); found != same.end(); found = same.find(off)) off = found->second;
+			return off;
+		};
+		for (bool changed = true; changed; )
+		{
+			changed = false;
+			for (Dwarf_Off off = first_adopted; off <= root.ndies() && !same.empty(); ++off)
+			{
+				iterator_base die = root.find(off);
+				auto attrs = die.copy_attrs();
+				for (auto i_a = attrs.begin(); i_a != attrs.end(); ++i_a)
+				{
+					if (i_a->second.get_form() != encap::attribute_value::REF) continue;
+					Dwarf_Off target = settled(i_a->second.get_ref().off);
+					if (target != i_a->second.get_ref().off) root.set_ref(die, i_a->first, target);
+				}
+			}
+			/* Keys change as references do, so start afresh. */
+			root.structure().clear();
+			for (auto i_o = inlined.begin(); i_o != inlined.end(); ++i_o)
+			{
+				if (same.count(*i_o)) continue;
+				iterator_base die = root.find(*i_o);
+				iterator_base cu = die.enclosing_cu();
+				string key = structural_index::key_of(die);
+				iterator_base found = root.structure().find(cu, die.tag_here(), key);
+				if (!found) root.structure().add(cu, key, die);
+				else if (settled(found.offset_here()) < *i_o)
+				{
+					replace_subtree(die, root.find(settled(found.offset_here())), same);
+					metrics::count(metrics::INLINE_DIES_SHARED);
+					changed = true;
+				}
+			}
+		}
+		if (same.empty()) return vector<Dwarf_Off>();
+		return root.replace_dies(same);
+	}
+
+	iterator_base create_dies_concurrently(const iterator_base& parent, const string& some_dwarfidl,
+		unsigned nthreads /* = 0 */)
+	{
+		arena_root_die *root = dynamic_cast<arena_root_die *>(&parent.get_root());
+		if (!root) throw std::invalid_argument("concurrent creation needs an arena_root_die");
+		if (nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+		bool compile_units;
+		vector<string> pieces = split_toplevel(some_dwarfidl, nthreads, &compile_units);
+		if (pieces.size() <= 1) return create_dies(parent, some_dwarfidl);
+
+		/* As create_dies would: non-CU DIEs need a CU to go in. Making it
+		 * here means every piece goes in the same one. */
+		iterator_base first_created;
+		iterator_base real_parent = parent;
+		if (!compile_units && parent.enclosing_cu() == iterator_base::END)
+		{
+			real_parent = first_created = root->make_new(root->begin(), DW_TAG_compile_unit);
+		}
+
+		struct piece_result
+		{
+			std::unique_ptr<arena_root_die> staging;
+			iterator_base staging_parent;
+			iterator_base first_created;
+			vector<deferred_ref> deferred;
+			vector<Dwarf_Off> inlined;
+			std::exception_ptr error;
+		};
+		vector<piece_result> results(pieces.size());
+		vector<std::thread> threads;
+		for (unsigned i = 0; i < pieces.size(); ++i)
+		{
+			threads.emplace_back([&pieces, &results, compile_units, i]() {
+				piece_result& r = results[i];
+				try
+				{
+					r.staging.reset(new arena_root_die);
+					r.staging_parent = compile_units ? r.staging->begin()
+						: r.staging->make_new(r.staging->begin(), DW_TAG_compile_unit);
+					creation_state state;
+					state.deferred = &r.deferred;
+					state.inlined = &r.inlined;
+					r.first_created = create_dies(r.staging_parent, pieces[i], state);
+				}
+				catch (...) { r.error = std::current_exception(); }
+			});
+		}
+		for (auto i_t = threads.begin(); i_t != threads.end(); ++i_t) i_t->join();
+		for (auto i_r = results.begin(); i_r != results.end(); ++i_r)
+		{
+			if (i_r->error) std::rethrow_exception(i_r->error);
+		}
+
+		/* The barrier: link the pieces in, in order, then patch. */
+		vector<deferred_ref> deferred;
+		vector<Dwarf_Off> inlined;
+		Dwarf_Off first_adopted = root->ndies() + 1;
+		for (auto i_r = results.begin(); i_r != results.end(); ++i_r)
+		{
+			Dwarf_Off from_parent = i_r->staging_parent.offset_here();
+			Dwarf_Off first = i_r->first_created.offset_here();
+			Dwarf_Off base = root->adopt(*i_r->staging, i_r->staging_parent, real_parent);
+			auto moved = [&](Dwarf_Off off) {
+				return off == from_parent ? real_parent.offset_here()
+					: arena_root_die::adopted_offset(off, base, from_parent);
+			};
+			if (!first_created && first != 0) first_created = root->find(moved(first));
+			for (auto i_d = i_r->deferred.begin(); i_d != i_r->deferred.end(); ++i_d)
+			{
+				deferred.push_back(*i_d);
+				deferred.back().die = moved(i_d->die);
+			}
+			for (auto i_o = i_r->inlined.begin(); i_o != i_r->inlined.end(); ++i_o)
+			{
+				inlined.push_back(moved(*i_o));
+			}
+		}
+		for (auto i_d = deferred.begin(); i_d != deferred.end(); ++i_d)
+		{
+			iterator_base die = root->find(i_d->die);
+			iterator_base found = resolve_ident(die, i_d->ident, nullptr);
+			if (!found) throw std::runtime_error("could not resolve identifier " + i_d->ident);
+			root->set_ref(die, i_d->attr, found.offset_here());
+		}
+		auto moved = share_inline_dies(*root, first_adopted, inlined);
+		if (!moved.empty() && first_created) first_created = root->find(moved[first_created.offset_here()]);
+		return first_created;
+	}
 }
@@ -12,6 +12,8 @@
 #include "dwarfidl/cxx_model.hpp"
 #include "dwarfidl/dependency_ordering_cxx_target.hpp"
 #include "dwarfidl/dwarf_interface_walk.hpp"
+#include "dwarfidl/metrics.hpp"
+#include "dwarfidl/log.hpp"
 #include <srk31/algorithm.hpp>
 
 using namespace srk31;
@@ -41,15 +43,6 @@ using dwarf::core::member_die;
 using dwarf::core::program_element_die;
 using dwarf::spec::opt;
 
-static std::ostream& debug(int msg_level = 1)
-{
-	static std::ofstream dummy;
-	char *level_str = getenv("DWARFIDL_DEBUG_LEVEL");
-	int level = (level_str ? atoi(level_str) : 0);
-	if (level >= msg_level) return cerr;
-	return dummy;
-}
-
 namespace dwarf { namespace tool {
 
 /* FIXME: this mixes together the task of generating snippets of code
@@ -76,21 +69,21 @@ namespace dwarf { namespace tool {
 void dependency_ordering_cxx_target::maybe_add_to_worklist(std::pair<emit_kind, iterator_base> const& el)
 {
 	// only add something if it's new
-	debug() << "Maybe adding to worklist: " << el.first << " of " << el.second.summary()
-		<< std::endl;
+	DWARFIDL_LOG(1, "Maybe adding to worklist: " << el.first << " of " << el.second.summary()
+		<< std::endl);
 	bool must_not_insert = false;
 	auto found = output_expanded.find(el);
 	auto inserted = output_expanded.insert(el);
 	if (!inserted.second)
 	{
-		debug() << "Actually didn't insert because it's already in output_expanded ("
-			<< inserted.first->second.summary() << ")" << endl;
+		DWARFIDL_LOG(1, "Actually didn't insert because it's already in output_expanded ("
+			<< inserted.first->second.summary() << ")" << endl);
 		return; // nothing was inserted, i.e. it was already present
 	}
 	if (must_not_insert)
 	{
 		// if we got here, it means we really did insert
-		debug() << "Did not expect to insert but did: " << el.first << " of " << el.second << endl;
+		DWARFIDL_LOG(1, "Did not expect to insert but did: " << el.first << " of " << el.second << endl);
 		assert(!inserted.second); // always fails
 	}
 	worklist.push_back(el);
@@ -167,6 +160,7 @@ dependency_ordering_cxx_target::maybe_get_name(iterator_base i, enum ref_kind k)
 
 void dependency_ordering_cxx_target::transitively_close()
 {
+	dwarfidl::metrics::phase_timer timer(dwarfidl::metrics::CLOSE);
 	// 1. pre-populate -- this is something the client tool does
 	// by giving us a set<pair<emit_kind, iterator_base> >,
 	// but we turn it into a vector so that we can use it as a worklist (add to the back)
@@ -250,6 +244,7 @@ void dependency_ordering_cxx_target::transitively_close()
 				this->current_pair_transitively_closing_from.second.summary()
 				<< std::endl;
 			m_output_fragments[this->current_pair_transitively_closing_from] = frag;
+			dwarfidl::metrics::count(dwarfidl::metrics::FRAGMENTS_GENERATED);
 			// we've just processed one worklist item
 			i_pair = worklist.erase(i_pair);
 		} // end while worklist
@@ -271,9 +266,11 @@ std::ostream& operator<<(std::ostream& s, const dependency_ordering_cxx_target::
 	}
 	return s;
 }
-void dependency_ordering_cxx_target::write_ordered_output()
+void dependency_ordering_cxx_target::write_ordered_output(std::ostream& out)
 {
-	std::ostream& out = std::cout; /* FIXME: take as arg */
+	dwarfidl::metrics::phase_timer timer(dwarfidl::metrics::ORDER);
+	uint64_t nscanned = 0;
+	uint64_t nbytes = 0;
 	set <pair<emit_kind, iterator_base>, compare_with_type_equality > emitted;
 
 	multimap< pair<emit_kind, iterator_base>, pair<emit_kind, iterator_base>, compare_with_type_equality >
@@ -308,16 +305,17 @@ void dependency_ordering_cxx_target::write_ordered_output()
 			bool all_sat = true;
 			for (auto i_dep = deps_seq.first; i_dep != deps_seq.second; ++i_dep)
 			{
+				++nscanned;
 				auto& dep = i_dep->second;
 				bool already_emitted = (emitted.find(dep) != emitted.end());
 				all_sat &= already_emitted;
 				if (!already_emitted)
 				{
-					debug() << "Can't emit " << el.first << " of " << el.second << " yet"
+					DWARFIDL_LOG(1, "Can't emit " << el.first << " of " << el.second << " yet"
 						<< " because not yet emitted (maybe among others) "
 						<< dep.first << " of " << dep.second
 						<< "; continuing (total " << m_output_fragments.size()
-						<< " fragments remaining of which we are number " << i << ")" << endl;
+						<< " fragments remaining of which we are number " << i << ")" << endl);
 					assert(!all_sat);
 					break;
 				}
@@ -335,6 +333,7 @@ void dependency_ordering_cxx_target::write_ordered_output()
 				if (!already_emitted_compatible_type)
 				{
 					out << frag;
+					nbytes += frag.length();
 					if (is_a_named_type_die)
 					{
 						opt<uint32_t> maybe_our_summary_code = d.as_a<type_die>()->summary_code();
@@ -355,11 +354,11 @@ void dependency_ordering_cxx_target::write_ordered_output()
 					assert(maybe_our_summary_code);
 					if (found->second.first != *maybe_our_summary_code)
 					{
-						debug(0) << "Trying to emit incompatible type definition "
+						DWARFIDL_LOG(0, "Trying to emit incompatible type definition "
 							<< "for a name already used: "
 							<< *d.name_here()
 							<< ", " << d.summary()
-							<< ", emitted frag was " << found->second.second << endl;
+							<< ", emitted frag was " << found->second.second << endl);
 					}
 				}
 				// add to the emitted set
@@ -391,20 +390,22 @@ void dependency_ordering_cxx_target::write_ordered_output()
 		}
 		if (!removed_one)
 		{
-			debug(0) << "digraph stuck_with_order_constraints {" << endl;
+			cerr << "digraph stuck_with_order_constraints {" << endl;
 			for (auto pair : m_order_constraints)
 			{
-				debug() << pair.first.first << "_of_" << std::hex;
-				if (pair.first.second) debug(0) << pair.first.second.offset_here(); else debug(0) << "void";
-				debug(0) << " -> "
+				cerr << pair.first.first << "_of_" << std::hex;
+				if (pair.first.second) cerr << pair.first.second.offset_here(); else cerr << "void";
+				cerr << " -> "
 				     << pair.second.first << "_of_" << std::hex;
-				if (pair.second.second) debug(0) << pair.second.second.offset_here(); else debug(0) << "void";
-				debug(0) << "; //" << pair.first.second << " -> " << pair.second.second << endl;
+				if (pair.second.second) cerr << pair.second.second.offset_here(); else cerr << "void";
+				cerr << "; //" << pair.first.second << " -> " << pair.second.second << endl;
 			}
-			debug(0) << "}" << endl;
+			cerr << "}" << endl;
 			assert(false); abort();
 		} /* lack of progress */
 	}
+	dwarfidl::metrics::count(dwarfidl::metrics::CONSTRAINT_SCAN_ITERATIONS, nscanned);
+	dwarfidl::metrics::count(dwarfidl::metrics::BYTES_EMITTED, nbytes);
 }
 
 } } // end namespace dwarf::tool
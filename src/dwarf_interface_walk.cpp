@@ -15,8 +15,15 @@
 #include <cxxgen/tokens.hpp>
 #include <dwarfpp/lib.hpp>
 #include <fileno.hpp>
+#include <cstring>
+#include <gelf.h>
 
 #include "dwarfidl/dwarf_interface_walk.hpp"
+#include "dwarfidl/print.hpp"
+#include "dwarfidl/metrics.hpp"
+#include "dwarfidl/log.hpp"
+#include "dwarfidl/arena_root.hpp"
+#include "dwarfidl/mapped_slice_root.hpp"
 
 using std::cin;
 using std::cout;
@@ -133,79 +140,149 @@ void my_walk_type(iterator_df<type_die> t, iterator_df<program_element_die> reas
 	if (post_f) post_f(t, reason);
 }
 
-void 
-gather_interface_dies(root_die& root, 
-	set<iterator_base>& out, type_set& dedup_types_out, 
-	std::function<bool(const iterator_base&)> pred)
+static bool is_scope(const iterator_base& i)
 {
-	/* We want to deduplicate the types that we output, as we go. 
-	 * CARE: what about anonymous types? We might want to generate names for them 
-	 * based on their offset, in which case deduplication isn't transparent. 
-	 * For this reason we output dedup_types_out separately from the DIEs.
-	 * However, everything in dedup_types_out is also in out (FIXME: is this a good idea?) */
-	auto toplevel_seq = root.grandchildren();
-	type_set& types = dedup_types_out;
-	/* FIXME: it needn't be just grandchildren. */
-	for (auto i_d = std::move(toplevel_seq.first); i_d != toplevel_seq.second; ++i_d)
-	{
-		std::cerr << "\r" << i_d.summary(); // for debugging
-		if (pred(i_d))
-		{
-			std::cerr << std::endl;
-			// looks like a goer -- add it to the objs
-			out.insert(i_d);
-			
-			/* utility that will come in handy */
-			auto add_all_types = [&types, &root](iterator_df<type_die> outer_t) {
-				if (outer_t) {
-					cerr << "add_all_types processing offset 0x" << std::hex <<  outer_t.offset_here() << std::dec << ": " << outer_t.summary() << endl;
-				}
-				my_walk_type(outer_t, iterator_base::END, 
-					[&types, &root](iterator_df<type_die> t, iterator_df<program_element_die> reason) -> bool {
-						if (!t) return false; // void case
-						auto memb = reason.as_a<member_die>();
-						if (memb && memb->get_declaration() && *memb->get_declaration()
-							&& memb->get_external() && *memb->get_external())
-						{
-							// static member vars don't get added nor recursed on
-							return false;
-						}
-						// apart from that, insert all nonvoids....
-						auto inserted = types.insert(t);
-						if (!inserted.second)
-						{
-							cerr << "Type was already present: " << *t 
-								<< " (or something equal to it: " << *inserted.first
-								<< ")" << endl;
-							// cerr << "Attributes: " << t->copy_attrs(root) << endl;
-							return false; // was already present
-						}
-						else
-						{
-							cerr << "Inserted new type: " << *t << endl;
-							// cerr << "Attributes: " << t->copy_attrs(root) << endl;
-							return true;
-						}
-					}
-				);
-			};
-			
-			/* Also output everything that this depends on. We have to case-split
-			 * for now. */
-			if (i_d.is_a<variable_die>())
-			{
-				add_all_types(i_d.as_a<variable_die>()->get_type());
-			}
-			else if (i_d.is_a<type_die>())
-			{
-				/* Just walk it. */
-				add_all_types(i_d.as_a<type_die>());
+	switch (i.tag_here())
+	{
+		case DW_TAG_namespace:
+		case DW_TAG_class_type:
+		case DW_TAG_structure_type:
+		case DW_TAG_union_type:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static string join_name_parts(const vector<string>& parts)
+{
+	string s;
+	for (auto i_p = parts.begin(); i_p != parts.end(); ++i_p)
+	{
+		if (i_p != parts.begin()) s += "::";
+		s += *i_p;
+	}
+	return s;
+}
+
+static void walk_scope_children(const iterator_base& scope, vector<string>& parts,
+	const std::function<void(const iterator_base&, const vector<string>&)>& f)
+{
+	auto children = scope.children_here();
+	for (auto i = children.first; i != children.second; ++i)
+	{
+		vector<string> local = local_name_parts_for(i);
+		parts.insert(parts.end(), local.begin(), local.end());
+		f(i, parts);
+		if (is_scope(i)) walk_scope_children(i, parts, f);
+		parts.resize(parts.size() - local.size());
+	}
+}
+
+void
+walk_scopes(root_die& root,
+	std::function<void(const iterator_base&, const vector<string>&)> f)
+{
+	auto cus = root.begin().children_here();
+	for (auto i_cu = cus.first; i_cu != cus.second; ++i_cu)
+	{
+		vector<string> parts;
+		walk_scope_children(i_cu, parts, f);
+	}
+}
+
+scope_index::scope_index(root_die& root)
+{
+	walk_scopes(root, [this](const iterator_base& i, const vector<string>& parts) {
+		string name = join_name_parts(parts);
+		m_by_name[name].push_back(i);
+		m_name_of.insert(make_pair(i.offset_here(), std::move(name)));
+	});
+}
+
+const vector<iterator_base>& scope_index::find(const string& fq_name) const
+{
+	static const vector<iterator_base> none;
+	auto found = m_by_name.find(fq_name);
+	return (found == m_by_name.end()) ? none : found->second;
+}
+
+string scope_index::fq_name_of(const iterator_base& i) const
+{
+	auto found = m_name_of.find(i.offset_here());
+	if (found != m_name_of.end()) return found->second;
+	return join_name_parts(fq_name_parts_for(i));
+}
+
+/* Consider one DIE for the slice: if pred likes it, add it to out, and
+ * add every type it reaches to types. parts are its qualified name. */
+static void
+gather_from_die(const iterator_base& i_d, const vector<string>& parts,
+	set<iterator_base>& out, type_set& types,
+	const scoped_predicate& pred, uint64_t& nvisited)
+{
+	DWARFIDL_LOG(2, "\r" << i_d.summary());
+	++nvisited;
+	if (pred(i_d, parts))
+	{
+		DWARFIDL_LOG(2, std::endl);
+		// looks like a goer -- add it to the objs
+		out.insert(i_d);
+		
+		/* utility that will come in handy */
+		auto add_all_types = [&types, &nvisited](iterator_df<type_die> outer_t) {
+			if (outer_t) {
+				DWARFIDL_LOG(2, "add_all_types processing offset 0x" << std::hex <<  outer_t.offset_here() << std::dec << ": " << outer_t.summary() << endl);
 			}
-		} // end if pred
-	} // end for
-	
-	/* Now we've gathered everything. Make sure everything in "types" is in 
-	 * "out". */
+			my_walk_type(outer_t, iterator_base::END, 
+				[&types, &nvisited](iterator_df<type_die> t, iterator_df<program_element_die> reason) -> bool {
+					if (!t) return false; // void case
+					++nvisited;
+					auto memb = reason.as_a<member_die>();
+					if (memb && memb->get_declaration() && *memb->get_declaration()
+						&& memb->get_external() && *memb->get_external())
+					{
+						// static member vars don't get added nor recursed on
+						return false;
+					}
+					// apart from that, insert all nonvoids....
+					auto inserted = types.insert(t);
+					if (!inserted.second)
+					{
+						DWARFIDL_LOG(2, "Type was already present: " << *t 
+							<< " (or something equal to it: " << *inserted.first
+							<< ")" << endl);
+						// cerr << "Attributes: " << t->copy_attrs(root) << endl;
+						return false; // was already present
+					}
+					else
+					{
+						DWARFIDL_LOG(2, "Inserted new type: " << *t << endl);
+						// cerr << "Attributes: " << t->copy_attrs(root) << endl;
+						return true;
+					}
+				}
+			);
+		};
+		
+		/* Also output everything that this depends on. We have to case-split
+		 * for now. */
+		if (i_d.is_a<variable_die>())
+		{
+			add_all_types(i_d.as_a<variable_die>()->get_type());
+		}
+		else if (i_d.is_a<type_die>())
+		{
+			/* Just walk it. */
+			add_all_types(i_d.as_a<type_die>());
+		}
+	} // end if pred
+}
+
+/* Now we've gathered everything. Make sure everything in "types" is in 
+ * "out". */
+static void finish_gather(set<iterator_base>& out, type_set& types)
+{
 	for (auto i_d = types.begin(); i_d != types.end(); ++i_d)
 	{
 		out.insert(*i_d);
@@ -225,4 +302,453 @@ gather_interface_dies(root_die& root,
 	}
 }
 
+/* Gather from one CU's children, or everything in its scopes. The parts
+ * are only worked out if want_parts, since plain predicates ignore them. */
+static void gather_from_cu(const iterator_base& i_cu, set<iterator_base>& out, type_set& types,
+	const scoped_predicate& pred, bool want_parts, bool walk_nested_scopes, uint64_t& nvisited)
+{
+	vector<string> parts;
+	if (walk_nested_scopes)
+	{
+		walk_scope_children(i_cu, parts, [&](const iterator_base& i, const vector<string>& i_parts) {
+			gather_from_die(i, i_parts, out, types, pred, nvisited);
+		});
+		return;
+	}
+	auto children = i_cu.children_here();
+	for (auto i_d = children.first; i_d != children.second; ++i_d)
+	{
+		if (want_parts) parts = local_name_parts_for(i_d);
+		gather_from_die(i_d, parts, out, types, pred, nvisited);
+	}
+}
+
+static scoped_predicate ignoring_parts(std::function<bool(const iterator_base&)> pred)
+{
+	return [pred](const iterator_base& i, const vector<string>&) { return pred(i); };
+}
+
+static void
+gather(root_die& root, set<iterator_base>& out, type_set& dedup_types_out,
+	const scoped_predicate& pred, bool want_parts, bool walk_nested_scopes)
+{
+	/* We want to deduplicate the types that we output, as we go. 
+	 * CARE: what about anonymous types? We might want to generate names for them 
+	 * based on their offset, in which case deduplication isn't transparent. 
+	 * For this reason we output dedup_types_out separately from the DIEs.
+	 * However, everything in dedup_types_out is also in out (FIXME: is this a good idea?) */
+	dwarfidl::metrics::phase_timer timer(dwarfidl::metrics::GATHER);
+	uint64_t nvisited = 0;
+	type_set& types = dedup_types_out;
+	auto cus = root.begin().children_here();
+	for (auto i_cu = cus.first; i_cu != cus.second; ++i_cu)
+	{
+		gather_from_cu(i_cu, out, types, pred, want_parts, walk_nested_scopes, nvisited);
+	}
+	finish_gather(out, types);
+	dwarfidl::metrics::count(dwarfidl::metrics::DIES_VISITED, nvisited);
+}
+
+void 
+gather_interface_dies(root_die& root, 
+	set<iterator_base>& out, type_set& dedup_types_out, 
+	std::function<bool(const iterator_base&)> pred,
+	bool walk_nested_scopes /* = false */)
+{
+	gather(root, out, dedup_types_out, ignoring_parts(pred), false, walk_nested_scopes);
+}
+
+void
+gather_scoped_interface_dies(root_die& root,
+	set<iterator_base>& out, type_set& dedup_types_out,
+	scoped_predicate pred,
+	bool walk_nested_scopes /* = false */)
+{
+	gather(root, out, dedup_types_out, pred, true, walk_nested_scopes);
+}
+
+/* FNV-1a, so that hashes mean the same thing from one run to the next. */
+static void hash_bytes(uint64_t& h, const void *p, size_t len)
+{
+	const unsigned char *c = static_cast<const unsigned char *>(p);
+	for (size_t i = 0; i < len; ++i)
+	{
+		h ^= c[i];
+		h *= 0x100000001b3ull;
+	}
+}
+template <typename T>
+static void hash_value(uint64_t& h, const T& v) { hash_bytes(h, &v, sizeof v); }
+static void hash_string(uint64_t& h, const string& s)
+{
+	hash_value(h, s.size());
+	hash_bytes(h, s.data(), s.size());
+}
+
+/* A cheap encoding of a DIE's attributes, relative to the CU at base. */
+static void hash_attrs(uint64_t& h, const iterator_base& i, Dwarf_Off base)
+{
+	auto attrs = i.copy_attrs();
+	for (auto i_a = attrs.begin(); i_a != attrs.end(); ++i_a)
+	{
+		/* This points into .debug_line, so moves when other CUs change. */
+		if (i_a->first == DW_AT_stmt_list) continue;
+		hash_value(h, i_a->first);
+		const encap::attribute_value& v = i_a->second;
+		hash_value(h, v.get_form());
+		switch (v.get_form())
+		{
+			case encap::attribute_value::STRING: hash_string(h, v.get_string()); break;
+			case encap::attribute_value::FLAG: hash_value(h, v.get_flag()); break;
+			case encap::attribute_value::UNSIGNED: hash_value(h, v.get_unsigned()); break;
+			case encap::attribute_value::SIGNED: hash_value(h, v.get_signed()); break;
+			case encap::attribute_value::ADDR: hash_value(h, v.get_address().addr); break;
+			case encap::attribute_value::REF: {
+				auto ref = v.get_ref();
+				hash_value(h, ref.abs ? ref.off - base : ref.off);
+			} break;
+			case encap::attribute_value::LOCLIST: {
+				auto ll = v.get_loclist();
+				for (auto i_e = ll.begin(); i_e != ll.end(); ++i_e)
+				{
+					hash_value(h, i_e->lopc);
+					hash_value(h, i_e->hipc);
+					for (auto i_op = i_e->begin(); i_op != i_e->end(); ++i_op)
+					{
+						hash_value(h, i_op->lr_atom);
+						hash_value(h, i_op->lr_number);
+						hash_value(h, i_op->lr_number2);
+					}
+				}
+			} break;
+			/* Rarer forms go by form alone; a CU differing only in those
+			 * would be replayed wrongly, but they don't affect the slice. */
+			default: break;
+		}
+	}
+}
+
+/* The .debug_info and .debug_abbrev bytes of a root read from an ELF
+ * file, if we can have them. Only little-endian, uncompressed sections;
+ * data is null unless both are there. */
+struct debug_info_bytes
+{
+	const unsigned char *data = nullptr;
+	size_t size = 0;
+	const unsigned char *abbrev = nullptr;
+	size_t abbrev_size = 0;
+	explicit debug_info_bytes(root_die& root);
+};
+
+debug_info_bytes::debug_info_bytes(root_die& root)
+{
+	/* Roots we build ourselves have no file behind them. */
+	if (dynamic_cast<in_memory_root_die *>(&root)
+		|| dynamic_cast<dwarfidl::arena_root_die *>(&root)
+		|| dynamic_cast<dwarfidl::mapped_slice_root_die *>(&root)) return;
+	Elf *e = root.get_elf();
+	size_t shstrndx;
+	if (!e || elf_getshdrstrndx(e, &shstrndx) != 0) return;
+	const char *ident = elf_getident(e, nullptr);
+	if (!ident || ident[EI_DATA] != ELFDATA2LSB) return;
+	const unsigned char *info = nullptr;
+	size_t info_size = 0;
+	for (Elf_Scn *scn = elf_nextscn(e, nullptr); scn; scn = elf_nextscn(e, scn))
+	{
+		GElf_Shdr shdr;
+		if (!gelf_getshdr(scn, &shdr)) return;
+		const char *name = elf_strptr(e, shstrndx, shdr.sh_name);
+		bool is_info = name && strcmp(name, ".debug_info") == 0;
+		if (!is_info && !(name && strcmp(name, ".debug_abbrev") == 0)) continue;
+		if (shdr.sh_flags & SHF_COMPRESSED) return;
+		Elf_Data *d = elf_rawdata(scn, nullptr);
+		if (!d || !d->d_buf) return;
+		if (is_info)
+		{
+			info = static_cast<const unsigned char *>(d->d_buf);
+			info_size = d->d_size;
+		}
+		else
+		{
+			abbrev = static_cast<const unsigned char *>(d->d_buf);
+			abbrev_size = d->d_size;
+		}
+	}
+	if (abbrev) { data = info; size = info_size; }
+}
+
+/* What a compile unit header says about how to read the CU's bytes. */
+struct cu_header
+{
+	Dwarf_Off end = 0;
+	unsigned version = 0;
+	unsigned unit_type = 0;
+	unsigned address_size = 0;
+	uint64_t abbrev_offset = 0;
+};
+
+/* The header of the CU whose DIE is at cu_off; end is 0 if it is not a
+ * 32-bit DWARF 2--5 compile unit header. */
+static cu_header read_cu_header(const debug_info_bytes& info, Dwarf_Off cu_off)
+{
+	auto u16 = [&info](Dwarf_Off o) -> unsigned { return info.data[o] | (info.data[o + 1] << 8); };
+	auto u32 = [&info, &u16](Dwarf_Off o) -> uint64_t { return u16(o) | ((uint64_t) u16(o + 2) << 16); };
+	cu_header h;
+	if (cu_off < 11 || cu_off > info.size) return h;
+	Dwarf_Off header;
+	/* DW_UT_compile and DW_UT_partial */
+	if (cu_off >= 12 && u16(cu_off - 8) == 5 && (info.data[cu_off - 6] == 0x01
+		|| info.data[cu_off - 6] == 0x03))
+	{
+		header = cu_off - 12;
+		h.unit_type = info.data[header + 6];
+		h.address_size = info.data[header + 7];
+		h.abbrev_offset = u32(header + 8);
+	}
+	else if (u16(cu_off - 7) >= 2 && u16(cu_off - 7) <= 4)
+	{
+		header = cu_off - 11;
+		h.abbrev_offset = u32(header + 6);
+		h.address_size = info.data[header + 10];
+	}
+	else return h;
+	h.version = u16(header + 4);
+	uint64_t length = u32(header);
+	if (length >= 0xfffffff0u || header + 4 + length > info.size) return h;
+	h.end = header + 4 + length;
+	return h;
+}
+
+/* Where the abbreviation table at off ends, just past its terminating 0
+ * code, or 0 if it runs off the end of the section. */
+static uint64_t abbrev_table_end(const debug_info_bytes& info, uint64_t off)
+{
+	uint64_t pos = off;
+	auto leb = [&info, &pos]() -> uint64_t {
+		uint64_t v = 0;
+		for (unsigned shift = 0; pos < info.abbrev_size; shift += 7)
+		{
+			unsigned char b = info.abbrev[pos++];
+			if (shift < 64) v |= (uint64_t) (b & 0x7f) << shift;
+			if (!(b & 0x80)) return v;
+		}
+		pos = info.abbrev_size + 1; // ran off the end
+		return 0;
+	};
+	while (pos < info.abbrev_size)
+	{
+		if (leb() == 0) return (pos <= info.abbrev_size) ? pos : 0; // the code
+		leb(); // the tag
+		++pos; // DW_CHILDREN_*
+		for (;;)
+		{
+			uint64_t attr = leb(), form = leb();
+			if (pos > info.abbrev_size) return 0;
+			if (attr == 0 && form == 0) break;
+			/* DW_FORM_implicit_const keeps its value here. */
+			if (form == 0x21) leb();
+		}
+	}
+	return 0;
+}
+
+static uint64_t cu_content_hash(const iterator_base& cu, const debug_info_bytes& info)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+	Dwarf_Off base = cu.offset_here();
+	/* The CU DIE itself holds offsets into other sections, so goes
+	 * attribute by attribute. */
+	hash_value(h, cu.tag_here());
+	hash_attrs(h, cu, base);
+	auto children = cu.children_here();
+	cu_header header = info.data ? read_cu_header(info, base) : cu_header();
+	Dwarf_Off end = header.end;
+	uint64_t abbrev_end = end ? abbrev_table_end(info, header.abbrev_offset) : 0;
+	if (end != 0 && abbrev_end != 0)
+	{
+		/* Below the CU DIE, the bytes themselves will do, together with
+		 * what decodes them: the header and the CU's abbreviation table,
+		 * which holds DW_FORM_implicit_const values too. References are
+		 * CU-relative, so a CU that merely moved hashes the same. Offsets
+		 * into .debug_str can move when other CUs change, which costs us
+		 * a walk, not a wrong answer. */
+		Dwarf_Off first = (children.first != children.second) ? children.first.offset_here() : end;
+		if (first >= base && first <= end)
+		{
+			hash_value(h, header.version);
+			hash_value(h, header.unit_type);
+			hash_value(h, header.address_size);
+			hash_value(h, abbrev_end - header.abbrev_offset);
+			hash_bytes(h, info.abbrev + header.abbrev_offset, abbrev_end - header.abbrev_offset);
+			hash_value(h, end - first);
+			hash_bytes(h, info.data + first, end - first);
+			return h;
+		}
+	}
+	/* No bytes to hand, so walk the DIEs. Everything is relative to the
+	 * CU, for the same reason. */
+	unsigned cu_depth = cu.depth();
+	iterator_df<> i = cu;
+	for (++i; i && i.depth() > cu_depth; ++i)
+	{
+		hash_value(h, i.offset_here() - base);
+		hash_value(h, i.depth() - cu_depth);
+		hash_value(h, i.tag_here());
+		hash_attrs(h, i, base);
+	}
+	return h;
+}
+
+uint64_t cu_content_hash(const iterator_base& cu)
+{
+	return cu_content_hash(cu, debug_info_bytes(cu.root()));
+}
+
+const gather_cache::cu_slice *gather_cache::find(uint64_t cu_hash) const
+{
+	auto found = m_slices.find(cu_hash);
+	return (found == m_slices.end()) ? nullptr : &found->second;
+}
+
+void gather_cache::save(std::ostream& s) const
+{
+	s << "dwarfidl-gather-cache 3 " << m_walk_nested_scopes << " "
+		<< m_pred_key.size() << " " << m_pred_key << "\n";
+	for (auto i_s = m_slices.begin(); i_s != m_slices.end(); ++i_s)
+	{
+		s << std::hex << i_s->first << std::dec
+			<< " " << i_s->second.elements.size() << " " << i_s->second.types.size();
+		for (auto off : i_s->second.elements) s << " " << off;
+		for (auto off : i_s->second.types) s << " " << off;
+		s << "\n";
+	}
+}
+
+bool gather_cache::load(std::istream& s)
+{
+	m_slices.clear();
+	string magic;
+	unsigned version;
+	bool nested;
+	size_t key_len;
+	if (!(s >> magic >> version) || magic != "dwarfidl-gather-cache" || version != 3
+		|| !(s >> nested >> key_len))
+	{
+		return false;
+	}
+	s.get();
+	string key(key_len, '\0');
+	if (key_len > 0 && !s.read(&key[0], key_len)) return false;
+	/* A cache made with a different predicate is no use to us. */
+	if (key != m_pred_key) return false;
+	m_walk_nested_scopes = nested;
+	uint64_t h;
+	size_t nelements, ntypes;
+	while (s >> std::hex >> h >> std::dec >> nelements >> ntypes)
+	{
+		cu_slice slice;
+		Dwarf_Off off;
+		for (size_t i = 0; i < nelements && s >> off; ++i) slice.elements.push_back(off);
+		for (size_t i = 0; i < ntypes && s >> off; ++i) slice.types.push_back(off);
+		if (slice.elements.size() != nelements || slice.types.size() != ntypes)
+		{
+			m_slices.clear();
+			return false;
+		}
+		m_slices.insert(make_pair(h, std::move(slice)));
+	}
+	return true;
+}
+
+void
+detail::gather_cached(root_die& root, set<iterator_base>& out, type_set& dedup_types_out,
+	const scoped_predicate& pred, bool want_parts, gather_cache& cache,
+	bool walk_nested_scopes)
+{
+	dwarfidl::metrics::phase_timer timer(dwarfidl::metrics::GATHER);
+	uint64_t nvisited = 0;
+	std::unordered_map<uint64_t, gather_cache::cu_slice> next_slices;
+	cache.m_cus_reused = cache.m_cus_walked = 0;
+	/* Slices of the CU's children are no use for a walk of its scopes. */
+	if (cache.m_walk_nested_scopes != walk_nested_scopes) cache.m_slices.clear();
+	cache.m_walk_nested_scopes = walk_nested_scopes;
+	debug_info_bytes info(root);
+	auto cus = root.begin().children_here();
+	for (auto i_cu = cus.first; i_cu != cus.second; ++i_cu)
+	{
+		uint64_t h = cu_content_hash(i_cu, info);
+		Dwarf_Off base = i_cu.offset_here();
+		const gather_cache::cu_slice *found = cache.find(h);
+		if (found)
+		{
+			/* Replay the slice. Types go through the dedup set again, since
+			 * the CU that supplied the representative of some type may be
+			 * one that has changed. */
+			for (auto off : found->elements) out.insert(root.find(base + off));
+			for (auto off : found->types)
+			{
+				dedup_types_out.insert(root.find(base + off).as_a<type_die>());
+			}
+			next_slices.insert(make_pair(h, *found));
+			++cache.m_cus_reused;
+			continue;
+		}
+
+		/* Walk this CU with its own type set, so that its slice includes
+		 * every type it reaches, not just those no earlier CU reached. */
+		set<iterator_base> cu_out;
+		type_set cu_types;
+		gather_from_cu(i_cu, cu_out, cu_types, pred, want_parts, walk_nested_scopes, nvisited);
+		++cache.m_cus_walked;
+
+		/* Only record slices that stay within the CU, since we
+		 * find things again by their offset within it. */
+		gather_cache::cu_slice slice;
+		bool local = true;
+		for (auto i_d = cu_out.begin(); local && i_d != cu_out.end(); ++i_d)
+		{
+			local = (i_d->enclosing_cu().offset_here() == base);
+			slice.elements.push_back(i_d->offset_here() - base);
+		}
+		for (auto i_t = cu_types.begin(); local && i_t != cu_types.end(); ++i_t)
+		{
+			local = (i_t->enclosing_cu().offset_here() == base);
+			slice.types.push_back(i_t->offset_here() - base);
+		}
+		if (local) next_slices.insert(make_pair(h, std::move(slice)));
+
+		out.insert(cu_out.begin(), cu_out.end());
+		for (auto i_t = cu_types.begin(); i_t != cu_types.end(); ++i_t)
+		{
+			dedup_types_out.insert(*i_t);
+		}
+	}
+	/* CUs that have gone away drop out of the cache. */
+	cache.m_slices = std::move(next_slices);
+
+	finish_gather(out, dedup_types_out);
+	dwarfidl::metrics::count(dwarfidl::metrics::DIES_VISITED, nvisited);
+}
+
+void 
+gather_interface_dies(root_die& root, 
+	set<iterator_base>& out, type_set& dedup_types_out, 
+	std::function<bool(const iterator_base&)> pred,
+	gather_cache& cache,
+	bool walk_nested_scopes /* = false */)
+{
+	detail::gather_cached(root, out, dedup_types_out, ignoring_parts(pred), false, cache,
+		walk_nested_scopes);
+}
+
+void
+gather_scoped_interface_dies(root_die& root,
+	set<iterator_base>& out, type_set& dedup_types_out,
+	scoped_predicate pred,
+	gather_cache& cache,
+	bool walk_nested_scopes /* = false */)
+{
+	detail::gather_cached(root, out, dedup_types_out, pred, true, cache, walk_nested_scopes);
+}
+
 } }
@@ -1,4 +1,8 @@
+#include <cstring>
 #include "dwarfprint.hpp"
+#include "dwarfidl/metrics.hpp"
+#include "dwarfidl/keywords.hpp"
+#include "dwarfidl/log.hpp"
 
 using boost::format_all;
 using boost::match_default;
@@ -79,13 +83,9 @@ string opcode_to_string(Dwarf_Loc expr) {
 	std::ostringstream ss;
 	ss.clear();
 	
-	auto opcode = string(DEFAULT_DWARF_SPEC.op_lookup(expr.lr_atom));
-	if (opcode.compare("(unknown opcode)") == 0) {
-		/* Leave unknown opcodes as hex */
-		opcode = to_hex(expr.lr_atom);
-	} else {
-		opcode = opcode.substr(6, string::npos); // remove DW_OP_
-	}
+	const char *keyword = dwarfidl::keyword_for_op(expr.lr_atom);
+	/* Leave unknown opcodes as hex */
+	auto opcode = keyword ? string(keyword) : to_hex(expr.lr_atom);
 
 	auto arg0 = to_dec(expr.lr_number);
 	auto arg1 = to_dec(expr.lr_number2);
@@ -188,13 +188,9 @@ void print_type_die(std::ostream &_s, iterator_df<dwarf::core::basic_die> die_it
 	srk31::indenting_newline_ostream s(_s);
 	//	auto &die = *die_iter;
 	auto name_ptr = die_iter.name_here();
-	auto tag = string(DEFAULT_DWARF_SPEC.tag_lookup(die_iter.tag_here())); 
-	if (tag.compare("(unknown tag)") == 0) {
-		// Leave unknown tags as hex
-		tag = to_hex(die_iter.tag_here());
-	} else {
-		tag = tag.substr(7, string::npos); // remove DW_TAG_
-	}
+	const char *tag_keyword = dwarfidl::keyword_for_tag(die_iter.tag_here());
+	// Leave unknown tags as hex
+	auto tag = tag_keyword ? string(tag_keyword) : to_hex(die_iter.tag_here());
 	auto offset = die_iter.offset_here();
 
 	/* Offset, tag, name, type */
@@ -239,7 +235,7 @@ void print_type_die(std::ostream &_s, iterator_df<dwarf::core::basic_die> die_it
 			  auto dedup_type_iter = types->find(type_die);
 			  //assert(dedup_type_iter != types->end());
 			  if (dedup_type_iter != types->end()) {
-				   _debug_print_dedup(type_die, *dedup_type_iter);
+				   if (DWARFIDL_LOG_ENABLED(2)) _debug_print_dedup(type_die, *dedup_type_iter);
 				   type_die = *dedup_type_iter;
 			  }
 		 }
@@ -251,14 +247,14 @@ void print_type_die(std::ostream &_s, iterator_df<dwarf::core::basic_die> die_it
 			  auto concrete_die_iter = types->find(concrete_die);
 			  //assert(concrete_die_iter != types->end());
 			  if (concrete_die_iter != types->end()) {
-				   _debug_print_dedup(concrete_die, *concrete_die_iter);
+				   if (DWARFIDL_LOG_ENABLED(2)) _debug_print_dedup(concrete_die, *concrete_die_iter);
 				   concrete_die = *concrete_die_iter;
 			  }
 		 }
 		 auto concrete_name = concrete_die.name_here();
 		 auto type_name = (concrete_name ? concrete_name : abstract_name);
 		 if (type_name) {
-			  _debug_print_print(name_ptr, offset, type_die, concrete_die);
+			  if (DWARFIDL_LOG_ENABLED(2)) _debug_print_print(name_ptr, offset, type_die, concrete_die);
 			  s << " : " << escape_ident(*type_name);
 		 } else {
 			  auto type_offset = (concrete_die ? concrete_die.offset_here() : type_die.offset_here());
@@ -294,16 +290,10 @@ void print_type_die(std::ostream &_s, iterator_df<dwarf::core::basic_die> die_it
 		s.inc_level();
 		unsigned int attrs_printed = 0;
 		for (auto iter = attrs.begin(); iter != attrs.end(); iter++) {
-			auto pair = *iter;
-			auto k = string(DEFAULT_DWARF_SPEC.attr_lookup(pair.first));
-			if (k.compare("(unknown attribute)") == 0) {
-				// FIXME FIXME FIXME
-				continue;
-				/* Leave unknown attributes as hex */
-				k = to_hex(pair.first);
-			} else {
-				k = k.substr(6, string::npos); // remove DW_AT_
-			}
+			const auto& pair = *iter;
+			const char *k = dwarfidl::keyword_for_attr(pair.first);
+			// FIXME FIXME FIXME: leave unknown attributes as hex
+			if (!k) continue;
 
 			const char *drop_attrs[] = {
 				 "decl_file",
@@ -316,14 +306,14 @@ void print_type_die(std::ostream &_s, iterator_df<dwarf::core::basic_die> die_it
 
 			bool skip_this = false;
 			for (unsigned int i = 0; drop_attrs[i] != nullptr; i++) {
-				 if (k.compare(drop_attrs[i]) == 0) {
+				 if (strcmp(k, drop_attrs[i]) == 0) {
 					skip_this = true;
 					break;
 				 }
 			}
 			if (skip_this) continue;
 			
-			auto v = pair.second;
+			const auto& v = pair.second;
 			if (attrs_printed++ != 0) {
 				s << "," << endl;
 			}
@@ -434,20 +424,31 @@ void print_type_die(std::ostream &_s, iterator_df<dwarf::core::basic_die> die_it
 }
 
 string dies_to_idl(set<iterator_base> dies, optional<type_set&> types) {
+	dwarfidl::metrics::phase_timer timer(dwarfidl::metrics::PRINT);
 	ostringstream ss;
 	ss.clear();
 	for (auto iter = dies.begin(); iter != dies.end(); iter++) {
 		 print_type_die(ss, *iter, types);
 		ss << endl << endl;
 	}
-	return ss.str();
+	string out = ss.str();
+	dwarfidl::metrics::count(dwarfidl::metrics::BYTES_EMITTED, out.length());
+	return out;
 }
 
 void print_dies(std::ostream &s, set<iterator_base> dies, optional<type_set&> types) {
+	dwarfidl::metrics::phase_timer timer(dwarfidl::metrics::PRINT);
+	/* Not every stream can tell us its position (e.g. a terminal). */
+	auto start = s.tellp();
 	for (auto iter = dies.begin(); iter != dies.end(); iter++) {
 		 print_type_die(s, *iter, types);
 		 s << endl << endl;
 	}
+	auto end = s.tellp();
+	if (start != decltype(start)(-1) && end != decltype(end)(-1))
+	{
+		dwarfidl::metrics::count(dwarfidl::metrics::BYTES_EMITTED, end - start);
+	}
 }
 
 
@@ -0,0 +1,1074 @@
+/* Because we're in-tree, when we're built we haven't yet copied
+ * the generated header files into the include directory. So the
+ * include path is a bit different. */
+#ifndef LEXER_INCLUDE
+#define LEXER_INCLUDE "dwarfidlNewCLexer.h"
+#endif
+#ifndef PARSER_INCLUDE
+#define PARSER_INCLUDE "dwarfidlNewCParser.h"
+#endif
+#include <cassert>
+#include <cstring>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <dwarfpp/lib.hpp>
+#include "dwarfidl/footprint.hpp"
+
+using namespace dwarf;
+using namespace dwarf::core;
+using antlr::tree::Tree;
+using std::string;
+using std::vector;
+using std::ostringstream;
+
+namespace dwarfidl
+{
+namespace footprint
+{
+	std::ostream& operator<<(std::ostream& s, direction d)
+	{
+		switch (d)
+		{
+			case READ:       s << "r"; break;
+			case WRITE:      s << "w"; break;
+			case READ_WRITE: s << "rw"; break;
+			default: s << "(bad direction " << (int) d << ")"; break;
+		}
+		return s;
+	}
+
+	const char *opcode_name(opcode op)
+	{
+		switch (op)
+		{
+#define CASE(o) case OP_ ## o: return #o;
+			CASE(HALT) CASE(LOADI) CASE(ARG) CASE(MOV)
+			CASE(ADD) CASE(SUB) CASE(MUL) CASE(DIV) CASE(MOD)
+			CASE(SHL) CASE(SHR) CASE(BITAND) CASE(BITOR) CASE(BITXOR)
+			CASE(EQ) CASE(NE) CASE(LT) CASE(GT) CASE(LTE) CASE(GTE)
+			CASE(ADDI) CASE(MULI) CASE(NEG) CASE(BITNOT) CASE(LNOT) CASE(BOOL)
+			CASE(LOAD) CASE(JMP) CASE(JZ) CASE(EMIT) CASE(EMITI)
+#undef CASE
+			default: return "(bad opcode)";
+		}
+	}
+
+	std::ostream& operator<<(std::ostream& s, const program& p)
+	{
+		s << "footprint " << p.name << "(";
+		for (auto i_a = p.arg_names.begin(); i_a != p.arg_names.end(); ++i_a)
+		{
+			s << (i_a == p.arg_names.begin() ? "" : ", ") << *i_a;
+		}
+		s << "), " << p.nregs << " registers" << std::endl;
+		for (unsigned pc = 0; pc < p.code.size(); ++pc)
+		{
+			const insn& i = p.code[pc];
+			s << pc << "\t" << opcode_name(static_cast<opcode>(i.op)) << "\tr" << (int) i.a
+				<< ", r" << (int) i.b << ", " << (int) i.c << ", #" << i.imm;
+			if (i.op == OP_EMIT || i.op == OP_EMITI) s << " (" << static_cast<direction>(i.flags) << ")";
+			else if (i.flags & SIGNED) s << " (signed)";
+			s << std::endl;
+		}
+		return s;
+	}
+
+	namespace
+	{
+		/* What compiling an expression gives us. Constants and member offsets
+		 * are carried along symbolically for as long as possible, so that
+		 * they fold into the instructions that eventually use them.
+		 *
+		 * While we try to compile a loop in closed form, its variable is an
+		 * INDEX, i.e. 'stride * i + k' for the loop's counter i, and objects
+		 * addressed by it are LVALUEs with a nonzero stride. Anything that
+		 * would need the counter's actual value throws not_affine. */
+		struct cvalue
+		{
+			enum kind_t { CONST, REG, LVALUE, OBJECTS, FUNCTION, INDEX } kind;
+			int64_t k;
+			int reg;       // REG: holds the value. LVALUE, OBJECTS: base address, or -1 if none
+			int64_t offset; // LVALUE, OBJECTS: added to the base address
+			iterator_df<type_die> type; // REG: the value's type, if known; otherwise the object's
+			uint64_t size; // LVALUE, OBJECTS: size of the (element) object, 0 if unknown
+			std::shared_ptr<cvalue> lo, hi; // OBJECTS: index bounds
+			Tree *fun;     // FUNCTION: its FP_FUN node
+			int loop;      // INDEX, strided LVALUE: which loop's counter
+			int64_t stride; // INDEX: coefficient of the counter. LVALUE: bytes per iteration
+
+			cvalue(kind_t kind) : kind(kind), k(0), reg(-1), offset(0), size(0), fun(nullptr),
+				loop(-1), stride(0) {}
+			static cvalue constant(int64_t k) { cvalue v(CONST); v.k = k; return v; }
+			static cvalue in_reg(unsigned reg, iterator_df<type_die> t = iterator_base::END)
+			{ cvalue v(REG); v.reg = reg; v.type = t; return v; }
+			static cvalue index(int loop, int64_t stride, int64_t k)
+			{ cvalue v(INDEX); v.loop = loop; v.stride = stride; v.k = k; return v; }
+		};
+		struct not_affine {};
+		typedef std::map<string, cvalue> environment;
+
+		Tree *child(Tree *t, unsigned i) { return static_cast<Tree *>(t->getChild(t, i)); }
+		unsigned nchildren(Tree *t) { return GET_CHILD_COUNT(t); }
+		string text_of(Tree *t) { return CCP(GET_TEXT(t)); }
+		string ident_of(Tree *t)
+		{
+			if (GET_TYPE(t) != TOKEN(IDENTS)) return unescape_ident(text_of(t));
+			ostringstream s;
+			for (unsigned i = 0; i < nchildren(t); ++i) s << (i == 0 ? "" : " ") << text_of(child(t, i));
+			return unescape_ident(s.str());
+		}
+
+		iterator_df<type_die> concrete(iterator_df<type_die> t)
+		{ return t ? t->get_concrete_type() : t; }
+		uint64_t size_of(iterator_df<type_die> t)
+		{
+			if (!t) return 0;
+			auto s = t->calculate_byte_size();
+			return s ? *s : 0;
+		}
+		bool is_signed(iterator_df<type_die> t)
+		{
+			auto c = concrete(t);
+			if (c && c.is_a<base_type_die>())
+			{
+				auto enc = c.as_a<base_type_die>()->get_encoding();
+				return enc == DW_ATE_signed || enc == DW_ATE_signed_char;
+			}
+			return c && c.is_a<enumeration_type_die>();
+		}
+		bool is_pointer(iterator_df<type_die> t)
+		{ auto c = concrete(t); return c && c.is_a<address_holding_type_die>(); }
+		bool is_array(iterator_df<type_die> t)
+		{ auto c = concrete(t); return c && c.is_a<array_type_die>(); }
+		bool is_aggregate(iterator_df<type_die> t)
+		{ auto c = concrete(t); return c && c.is_a<with_data_members_die>(); }
+
+		/* Find a member by name, looking inside anonymous structs and unions. */
+		bool find_member(iterator_df<type_die> t, const string& name,
+			int64_t *off, iterator_df<type_die> *member_type)
+		{
+			auto c = concrete(t);
+			if (!c || !c.is_a<with_data_members_die>()) return false;
+			auto ms = c.as_a<with_data_members_die>().children().subseq_of<member_die>();
+			for (auto i_m = ms.first; i_m != ms.second; ++i_m)
+			{
+				int64_t member_off = 0; // e.g. union members have no location
+				auto loc = i_m->get_data_member_location();
+				if (loc && loc->size() > 0)
+				{
+					member_off = dwarf::expr::evaluator(loc->at(0), i_m.spec_here(), { 0 }).tos();
+				}
+				if (i_m.name_here() && *i_m.name_here() == name)
+				{
+					*off = member_off;
+					*member_type = i_m->find_type();
+					return true;
+				}
+				int64_t inner_off;
+				if (!i_m.name_here() && find_member(i_m->find_type(), name, &inner_off, member_type))
+				{
+					*off = member_off + inner_off;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool fold_binary(unsigned tok, int64_t x, int64_t y, int64_t *out)
+		{
+			uint64_t ux = x, uy = y;
+			if      (tok == TOKEN(FP_ADD))    *out = (int64_t)(ux + uy);
+			else if (tok == TOKEN(FP_SUB))    *out = (int64_t)(ux - uy);
+			else if (tok == TOKEN(FP_MUL))    *out = (int64_t)(ux * uy);
+			else if (tok == TOKEN(FP_DIV))    { if (y == 0) return false; *out = (y == -1) ? (int64_t)(0 - ux) : x / y; }
+			else if (tok == TOKEN(FP_MOD))    { if (y == 0) return false; *out = (y == -1) ? 0 : x % y; }
+			else if (tok == TOKEN(FP_SHL))    *out = (int64_t)(ux << (uy & 63));
+			else if (tok == TOKEN(FP_SHR))    *out = x >> (uy & 63);
+			else if (tok == TOKEN(FP_BITAND)) *out = x & y;
+			else if (tok == TOKEN(FP_BITOR))  *out = x | y;
+			else if (tok == TOKEN(FP_BITXOR)) *out = x ^ y;
+			else if (tok == TOKEN(FP_EQ))     *out = x == y;
+			else if (tok == TOKEN(FP_NE))     *out = x != y;
+			else if (tok == TOKEN(FP_LT))     *out = x < y;
+			else if (tok == TOKEN(FP_GT))     *out = x > y;
+			else if (tok == TOKEN(FP_LTE))    *out = x <= y;
+			else if (tok == TOKEN(FP_GTE))    *out = x >= y;
+			else if (tok == TOKEN(FP_AND))    *out = x && y;
+			else if (tok == TOKEN(FP_OR))     *out = x || y;
+			else return false;
+			return true;
+		}
+		opcode binary_opcode(unsigned tok)
+		{
+			if (tok == TOKEN(FP_ADD))    return OP_ADD;
+			if (tok == TOKEN(FP_SUB))    return OP_SUB;
+			if (tok == TOKEN(FP_MUL))    return OP_MUL;
+			if (tok == TOKEN(FP_DIV))    return OP_DIV;
+			if (tok == TOKEN(FP_MOD))    return OP_MOD;
+			if (tok == TOKEN(FP_SHL))    return OP_SHL;
+			if (tok == TOKEN(FP_SHR))    return OP_SHR;
+			if (tok == TOKEN(FP_BITAND)) return OP_BITAND;
+			if (tok == TOKEN(FP_BITOR))  return OP_BITOR;
+			if (tok == TOKEN(FP_BITXOR)) return OP_BITXOR;
+			if (tok == TOKEN(FP_EQ))     return OP_EQ;
+			if (tok == TOKEN(FP_NE))     return OP_NE;
+			if (tok == TOKEN(FP_LT))     return OP_LT;
+			if (tok == TOKEN(FP_GT))     return OP_GT;
+			if (tok == TOKEN(FP_LTE))    return OP_LTE;
+			if (tok == TOKEN(FP_GTE))    return OP_GTE;
+			return OP_HALT;
+		}
+
+		class codegen
+		{
+			const compiler& m_compiler;
+			program& m_p;
+			unsigned m_next_reg;
+			unsigned m_inline_depth;
+			int m_next_loop;
+
+			size_t emit(opcode op, unsigned a = 0, unsigned b = 0, unsigned c = 0,
+				int64_t imm = 0, uint8_t flags = 0)
+			{
+				insn i = { op, (uint8_t) a, (uint8_t) b, (uint8_t) c, flags, { 0, 0, 0 }, imm };
+				m_p.code.push_back(i);
+				return m_p.code.size() - 1;
+			}
+			unsigned fresh()
+			{
+				if (m_next_reg > 255) throw compile_error("footprint needs more than 256 registers");
+				unsigned r = m_next_reg++;
+				m_p.nregs = std::max(m_p.nregs, m_next_reg);
+				return r;
+			}
+			unsigned address(int base, int64_t offset)
+			{
+				unsigned r;
+				if (base < 0) { r = fresh(); emit(OP_LOADI, r, 0, 0, offset); }
+				else if (offset != 0) { r = fresh(); emit(OP_ADDI, r, base, 0, offset); }
+				else r = base;
+				return r;
+			}
+
+			unsigned to_reg(const cvalue& v)
+			{
+				switch (v.kind)
+				{
+					case cvalue::CONST: {
+						unsigned r = fresh();
+						emit(OP_LOADI, r, 0, 0, v.k);
+						return r;
+					}
+					case cvalue::REG:
+						return v.reg;
+					case cvalue::INDEX:
+						throw not_affine();
+					case cvalue::LVALUE: {
+						if (v.stride != 0) throw not_affine();
+						/* Arrays decay to their address, as in C. */
+						if (is_array(v.type)) return address(v.reg, v.offset);
+						if (is_aggregate(v.type)) throw compile_error("cannot use a struct or union as a value");
+						if (v.size == 0 || v.size > 8) throw compile_error("cannot load an object of unknown or oversized type");
+						unsigned base = (v.reg < 0) ? address(-1, 0) : v.reg;
+						unsigned r = fresh();
+						emit(OP_LOAD, r, base, v.size, v.offset, is_signed(v.type) ? SIGNED : 0);
+						return r;
+					}
+					default:
+						throw compile_error("a footprint or function is not a value");
+				}
+			}
+			cvalue loaded(const cvalue& v)
+			{
+				if (v.kind == cvalue::CONST || v.kind == cvalue::REG || v.kind == cvalue::INDEX) return v;
+				return cvalue::in_reg(to_reg(v), v.type);
+			}
+
+			/* For anything we might index or dereference: where its elements
+			 * start, and what they are. */
+			void pointer_target(const cvalue& v, int *base, int64_t *offset,
+				iterator_df<type_die> *elem, uint64_t *elem_size)
+			{
+				if (v.kind == cvalue::INDEX || v.stride != 0) throw not_affine();
+				if (v.kind == cvalue::LVALUE && is_array(v.type))
+				{
+					*base = v.reg;
+					*offset = v.offset;
+					*elem = concrete(v.type).as_a<array_type_die>()->find_type();
+				}
+				else
+				{
+					cvalue ptr = loaded(v);
+					*elem = is_pointer(ptr.type)
+						? concrete(ptr.type).as_a<address_holding_type_die>()->find_type()
+						: iterator_df<type_die>(iterator_base::END);
+					if (ptr.kind == cvalue::CONST) { *base = -1; *offset = ptr.k; }
+					else { *base = ptr.reg; *offset = 0; }
+				}
+				*elem_size = size_of(*elem);
+				if (*elem_size == 0) *elem_size = 1; // void, as in GNU C
+			}
+
+			/* The object at 'base + offset + index * size'. */
+			cvalue element(int base, int64_t offset, const cvalue& index,
+				iterator_df<type_die> type, uint64_t size)
+			{
+				cvalue out(cvalue::LVALUE);
+				out.type = type;
+				out.size = size;
+				if (index.kind == cvalue::CONST)
+				{
+					out.reg = base;
+					out.offset = offset + index.k * (int64_t) size;
+					return out;
+				}
+				if (index.kind == cvalue::INDEX)
+				{
+					out.reg = base;
+					out.offset = offset + index.k * (int64_t) size;
+					out.loop = index.loop;
+					out.stride = index.stride * (int64_t) size;
+					return out;
+				}
+				unsigned r = fresh();
+				emit(OP_MULI, r, to_reg(index), 0, size);
+				if (base >= 0) emit(OP_ADD, r, r, base);
+				out.reg = r;
+				out.offset = offset;
+				return out;
+			}
+
+			cvalue compile_subscript(Tree *t, const environment& env)
+			{
+				unsigned kind = GET_TYPE(child(t, 0));
+				cvalue base_v = compile_value(child(t, 1), env);
+				if (kind == TOKEN(FP_DEREFBYTES)) base_v = deref(base_v);
+				int base;
+				int64_t offset;
+				iterator_df<type_die> elem;
+				uint64_t elem_size;
+				pointer_target(base_v, &base, &offset, &elem, &elem_size);
+				if (kind != TOKEN(FP_DEREFSIZES))
+				{
+					elem = iterator_base::END;
+					elem_size = 1;
+				}
+				cvalue lo = compile_value(child(t, 2), env);
+				if (nchildren(t) < 4) return element(base, offset, lo, elem, elem_size);
+				cvalue hi = compile_value(child(t, 3), env);
+				cvalue out(cvalue::OBJECTS);
+				out.reg = base;
+				out.offset = offset;
+				out.type = elem;
+				out.size = elem_size;
+				out.lo = std::make_shared<cvalue>(loaded(lo));
+				out.hi = std::make_shared<cvalue>(loaded(hi));
+				return out;
+			}
+
+			cvalue deref(const cvalue& v)
+			{
+				int base;
+				int64_t offset;
+				iterator_df<type_die> elem;
+				uint64_t elem_size;
+				pointer_target(v, &base, &offset, &elem, &elem_size);
+				return element(base, offset, cvalue::constant(0), elem, size_of(elem));
+			}
+
+			cvalue member(const cvalue& v, const string& name)
+			{
+				cvalue obj = (v.kind == cvalue::LVALUE && is_aggregate(v.type)) ? v : deref(v);
+				int64_t off;
+				iterator_df<type_die> member_type;
+				if (!find_member(obj.type, name, &off, &member_type))
+				{
+					throw compile_error("no member named `" + name + "'");
+				}
+				cvalue out(cvalue::LVALUE);
+				out.reg = obj.reg;
+				out.offset = obj.offset + off;
+				out.loop = obj.loop;
+				out.stride = obj.stride;
+				out.type = member_type;
+				out.size = size_of(member_type);
+				return out;
+			}
+
+			/* Bind a function's parameters and hand its body to 'f'. */
+			template <typename F>
+			void apply(Tree *t, const environment& env, F f)
+			{
+				cvalue head = compile_value(child(t, 0), env);
+				if (head.kind != cvalue::FUNCTION) throw compile_error("applying something that is not a function");
+				Tree *params = child(head.fun, 1);
+				Tree *args = child(t, 1);
+				if (nchildren(params) != nchildren(args))
+				{
+					throw compile_error("wrong number of arguments to " + ident_of(child(head.fun, 0)));
+				}
+				/* Functions see only their parameters (and other functions). */
+				environment inner;
+				for (unsigned i = 0; i < nchildren(params); ++i)
+				{
+					inner.insert(std::make_pair(ident_of(child(params, i)), compile_value(child(args, i), env)));
+				}
+				struct depth_guard { unsigned& depth; ~depth_guard() { --depth; } } guard = { ++m_inline_depth };
+				if (m_inline_depth > 64) throw compile_error("footprint functions recurse too deeply to inline");
+				f(child(head.fun, 2), inner);
+			}
+
+			void emit_range(int base, int64_t offset, const cvalue& len, direction dir)
+			{
+				if (len.kind == cvalue::CONST && len.k <= 0) return;
+				unsigned r = address(base, offset);
+				if (len.kind == cvalue::CONST) emit(OP_EMITI, r, 0, 0, len.k, dir);
+				else emit(OP_EMIT, r, to_reg(len), 0, 0, dir);
+			}
+
+			void emit_objects(const cvalue& v, direction dir)
+			{
+				if (v.kind == cvalue::LVALUE)
+				{
+					if (v.size == 0) throw compile_error("footprint of an object of unknown size");
+					emit_range(v.reg, v.offset, cvalue::constant(v.size), dir);
+				}
+				else if (v.kind == cvalue::OBJECTS)
+				{
+					cvalue first = element(v.reg, v.offset, *v.lo, v.type, v.size);
+					cvalue len(cvalue::CONST);
+					if (v.lo->kind == cvalue::CONST && v.hi->kind == cvalue::CONST)
+					{
+						len.k = (v.hi->k - v.lo->k) * (int64_t) v.size;
+					}
+					else
+					{
+						unsigned r = fresh();
+						emit(OP_SUB, r, to_reg(*v.hi), to_reg(*v.lo));
+						if (v.size != 1) emit(OP_MULI, r, r, 0, v.size);
+						len = cvalue::in_reg(r);
+					}
+					emit_range(first.reg, first.offset, len, dir);
+				}
+				else throw compile_error("expression is not a footprint");
+			}
+
+			cvalue affine(opcode op, const cvalue& x, const cvalue& y)
+			{
+				if ((x.kind != cvalue::CONST && x.kind != cvalue::INDEX)
+					|| (y.kind != cvalue::CONST && y.kind != cvalue::INDEX)
+					|| (x.kind == cvalue::INDEX && y.kind == cvalue::INDEX && x.loop != y.loop))
+				{
+					throw not_affine();
+				}
+				int loop = (x.kind == cvalue::INDEX) ? x.loop : y.loop;
+				int64_t xs = (x.kind == cvalue::INDEX) ? x.stride : 0;
+				int64_t ys = (y.kind == cvalue::INDEX) ? y.stride : 0;
+				switch (op)
+				{
+					case OP_ADD: return cvalue::index(loop, xs + ys, x.k + y.k);
+					case OP_SUB: return cvalue::index(loop, xs - ys, x.k - y.k);
+					case OP_MUL:
+						if (xs != 0 && ys != 0) throw not_affine();
+						return cvalue::index(loop, xs * y.k + ys * x.k, x.k * y.k);
+					default: throw not_affine();
+				}
+			}
+
+			cvalue loop_variable(const cvalue& in, const cvalue& counter)
+			{
+				if (in.kind == cvalue::OBJECTS) return element(in.reg, in.offset, counter, in.type, in.size);
+				return counter;
+			}
+
+			/* The union over the loop of the range in 'v', whose address moves
+			 * by a fixed stride each iteration, is one range if there are no
+			 * gaps between successive iterations. If so, emit that. */
+			void emit_span(const cvalue& v, int loop, const cvalue& lo, const cvalue& hi, direction dir)
+			{
+				int base;
+				int64_t offset, stride;
+				cvalue len(cvalue::CONST);
+				if (v.kind == cvalue::LVALUE)
+				{
+					if (v.size == 0) throw compile_error("footprint of an object of unknown size");
+					base = v.reg;
+					offset = v.offset;
+					stride = v.stride;
+					len.k = v.size;
+					if (v.loop != loop && v.stride != 0) throw not_affine();
+				}
+				else if (v.kind == cvalue::OBJECTS)
+				{
+					const cvalue& a = *v.lo, & b = *v.hi;
+					if ((a.kind == cvalue::INDEX && a.loop != loop) || (b.kind == cvalue::INDEX && b.loop != loop))
+					{
+						throw not_affine();
+					}
+					if (a.kind == cvalue::CONST && b.kind == cvalue::CONST) len.k = (b.k - a.k) * (int64_t) v.size;
+					else if (a.kind == cvalue::INDEX && b.kind == cvalue::INDEX && a.stride == b.stride)
+					{
+						len.k = (b.k - a.k) * (int64_t) v.size;
+					}
+					else if (a.kind != cvalue::INDEX && b.kind != cvalue::INDEX)
+					{
+						unsigned r = fresh();
+						emit(OP_SUB, r, to_reg(b), to_reg(a));
+						if (v.size != 1) emit(OP_MULI, r, r, 0, v.size);
+						len = cvalue::in_reg(r);
+					}
+					else throw not_affine();
+					cvalue first = element(v.reg, v.offset, a, v.type, v.size);
+					base = first.reg;
+					offset = first.offset;
+					stride = first.stride;
+				}
+				else throw compile_error("expression is not a footprint");
+
+				if (len.kind == cvalue::CONST && len.k <= 0) return;
+				uint64_t abs_stride = (stride < 0) ? -(uint64_t) stride : stride;
+				if (stride != 0 && (len.kind != cvalue::CONST || abs_stride > (uint64_t) len.k)) throw not_affine();
+
+				/* With a negative stride, the lowest address is the last iteration's. */
+				if (lo.kind == cvalue::CONST && hi.kind == cvalue::CONST)
+				{
+					int64_t n = hi.k - lo.k;
+					int64_t lowest = (stride < 0) ? hi.k - 1 : lo.k;
+					if (stride != 0) len.k += (n - 1) * (int64_t) abs_stride;
+					emit_range(base, offset + stride * lowest, len, dir);
+					return;
+				}
+				/* The caller has checked that lo < hi. */
+				unsigned r_lo = to_reg(lo), r_hi = to_reg(hi);
+				if (stride != 0)
+				{
+					unsigned r_last = fresh();
+					emit(OP_ADDI, r_last, r_hi, 0, -1);
+					unsigned r_start = fresh();
+					emit(OP_MULI, r_start, (stride < 0) ? r_last : r_lo, 0, stride);
+					if (base >= 0) emit(OP_ADD, r_start, r_start, base);
+					base = r_start;
+					unsigned r_len = fresh();
+					emit(OP_SUB, r_len, r_last, r_lo);
+					emit(OP_MULI, r_len, r_len, 0, abs_stride);
+					emit(OP_ADDI, r_len, r_len, 0, len.k);
+					len = cvalue::in_reg(r_len);
+				}
+				emit_range(base, offset, len, dir);
+			}
+
+			/* Try to compile the loop without iterating. Unions distribute over
+			 * loops, so each part of one gets its own chance. */
+			bool compile_closed_loop(Tree *body, const string& var, const cvalue& in,
+				const cvalue& lo, const cvalue& hi, const environment& env, direction dir)
+			{
+				unsigned tok = GET_TYPE(body);
+				if (tok == TOKEN(FP_VOID)) return true;
+				if (tok == TOKEN(FP_UNION) || tok == TOKEN(FP_ADJACENT))
+				{
+					for (unsigned i = 0; i < nchildren(body); ++i)
+					{
+						unsigned mark = m_next_reg;
+						compile_loop(child(body, i), var, in, lo, hi, env, dir);
+						m_next_reg = mark;
+					}
+					return true;
+				}
+				if (tok == TOKEN(FP_FOR) || tok == TOKEN(FP_IF) || tok == TOKEN(FP_APP)) return false;
+
+				size_t code_mark = m_p.code.size();
+				unsigned reg_mark = m_next_reg;
+				try
+				{
+					/* Test the bounds before anything the body loads, so that
+					 * a loop that doesn't run reads nothing. */
+					cvalue l = loaded(lo), h = loaded(hi);
+					size_t skip = 0;
+					bool tested = !(l.kind == cvalue::CONST && h.kind == cvalue::CONST);
+					if (tested)
+					{
+						unsigned r_test = fresh();
+						emit(OP_LT, r_test, to_reg(l), to_reg(h));
+						skip = emit(OP_JZ, r_test);
+					}
+					environment inner = env;
+					inner.erase(var);
+					inner.insert(std::make_pair(var, loop_variable(in, cvalue::index(m_next_loop++, 1, 0))));
+					emit_span(compile_value(body, inner), m_next_loop - 1, l, h, dir);
+					if (tested) m_p.code[skip].imm = m_p.code.size();
+					return true;
+				}
+				catch (not_affine&)
+				{
+					m_p.code.resize(code_mark);
+					m_next_reg = reg_mark;
+					return false;
+				}
+			}
+
+			void compile_loop(Tree *body, const string& var, const cvalue& in,
+				const cvalue& lo, const cvalue& hi, const environment& env, direction dir)
+			{
+				if (compile_closed_loop(body, var, in, lo, hi, env, dir)) return;
+
+				unsigned r_i = fresh();
+				if (lo.kind == cvalue::CONST) emit(OP_LOADI, r_i, 0, 0, lo.k);
+				else emit(OP_MOV, r_i, to_reg(lo));
+				unsigned r_hi = to_reg(hi);
+				size_t top = m_p.code.size();
+				unsigned r_test = fresh();
+				emit(OP_LT, r_test, r_i, r_hi);
+				size_t exit_jump = emit(OP_JZ, r_test);
+
+				environment inner = env;
+				inner.erase(var);
+				inner.insert(std::make_pair(var, loop_variable(in, cvalue::in_reg(r_i))));
+				unsigned mark = m_next_reg;
+				compile_footprint(body, inner, dir);
+				m_next_reg = mark;
+				emit(OP_ADDI, r_i, r_i, 0, 1);
+				emit(OP_JMP, 0, 0, 0, top);
+				m_p.code[exit_jump].imm = m_p.code.size();
+			}
+
+			void compile_for(Tree *t, const environment& env, direction dir)
+			{
+				Tree *body = child(t, 0);
+				string var = ident_of(child(t, 1));
+				cvalue in = compile_value(child(t, 2), env);
+				cvalue lo = cvalue::constant(0), hi = in;
+				if (in.kind == cvalue::OBJECTS) { lo = *in.lo; hi = *in.hi; }
+				else hi = loaded(in);
+				if (lo.kind == cvalue::CONST && hi.kind == cvalue::CONST && hi.k <= lo.k) return;
+				compile_loop(body, var, in, lo, hi, env, dir);
+			}
+
+		public:
+			codegen(const compiler& c, program& p)
+			 : m_compiler(c), m_p(p), m_next_reg(0), m_inline_depth(0), m_next_loop(0) {}
+
+			cvalue compile_value(Tree *t, const environment& env)
+			{
+				unsigned tok = GET_TYPE(t);
+				if (tok == TOKEN(INT)) return cvalue::constant(strtoll(text_of(t).c_str(), nullptr, 0));
+				if (tok == TOKEN(FP_TRUE)) return cvalue::constant(1);
+				if (tok == TOKEN(FP_FALSE)) return cvalue::constant(0);
+				if (tok == TOKEN(IDENTS) || tok == TOKEN(IDENT))
+				{
+					string name = ident_of(t);
+					auto found = env.find(name);
+					if (found != env.end()) return found->second;
+					auto found_fun = m_compiler.functions().find(name);
+					if (found_fun != m_compiler.functions().end())
+					{
+						cvalue f(cvalue::FUNCTION);
+						f.fun = found_fun->second;
+						return f;
+					}
+					throw compile_error("unknown identifier `" + name + "'");
+				}
+				if (tok == TOKEN(FP_FUN))
+				{
+					cvalue f(cvalue::FUNCTION);
+					f.fun = t;
+					return f;
+				}
+				if (tok == TOKEN(FP_AND) || tok == TOKEN(FP_OR))
+				{
+					cvalue x = compile_value(child(t, 0), env);
+					cvalue y = compile_value(child(t, 1), env);
+					int64_t k;
+					if (x.kind == cvalue::CONST && y.kind == cvalue::CONST && fold_binary(tok, x.k, y.k, &k))
+					{ return cvalue::constant(k); }
+					unsigned rx = fresh(), ry = fresh();
+					emit(OP_BOOL, rx, to_reg(x));
+					emit(OP_BOOL, ry, to_reg(y));
+					emit(tok == TOKEN(FP_AND) ? OP_BITAND : OP_BITOR, rx, rx, ry);
+					return cvalue::in_reg(rx);
+				}
+				opcode op = binary_opcode(tok);
+				if (op != OP_HALT)
+				{
+					cvalue x = compile_value(child(t, 0), env);
+					cvalue y = compile_value(child(t, 1), env);
+					int64_t k;
+					if (x.kind == cvalue::CONST && y.kind == cvalue::CONST && fold_binary(tok, x.k, y.k, &k))
+					{ return cvalue::constant(k); }
+					if (x.kind == cvalue::INDEX || y.kind == cvalue::INDEX) return affine(op, x, y);
+					/* Adding or multiplying by a constant needs no register for it. */
+					if ((op == OP_ADD || op == OP_MUL) && (x.kind == cvalue::CONST || y.kind == cvalue::CONST))
+					{
+						const cvalue& var = (x.kind == cvalue::CONST) ? y : x;
+						int64_t imm = (x.kind == cvalue::CONST) ? x.k : y.k;
+						unsigned r = fresh();
+						emit(op == OP_ADD ? OP_ADDI : OP_MULI, r, to_reg(var), 0, imm);
+						return cvalue::in_reg(r, op == OP_ADD ? var.type : iterator_df<type_die>(iterator_base::END));
+					}
+					unsigned rx = to_reg(x), ry = to_reg(y);
+					unsigned r = fresh();
+					emit(op, r, rx, ry);
+					return cvalue::in_reg(r);
+				}
+				if (tok == TOKEN(FP_NEG) || tok == TOKEN(FP_BITNOT) || tok == TOKEN(FP_NOT))
+				{
+					cvalue x = compile_value(child(t, 0), env);
+					if (x.kind == cvalue::INDEX && tok == TOKEN(FP_NEG)) return affine(OP_SUB, cvalue::constant(0), x);
+					if (x.kind == cvalue::CONST)
+					{
+						return cvalue::constant(tok == TOKEN(FP_NEG) ? (int64_t)(0 - (uint64_t) x.k)
+							: tok == TOKEN(FP_BITNOT) ? ~x.k : !x.k);
+					}
+					unsigned r = fresh();
+					emit(tok == TOKEN(FP_NEG) ? OP_NEG : tok == TOKEN(FP_BITNOT) ? OP_BITNOT : OP_LNOT,
+						r, to_reg(x));
+					return cvalue::in_reg(r);
+				}
+				if (tok == TOKEN(FP_IF))
+				{
+					cvalue c = compile_value(child(t, 0), env);
+					if (c.kind == cvalue::CONST) return compile_value(child(t, c.k ? 1 : 2), env);
+					unsigned r = fresh();
+					size_t else_jump = emit(OP_JZ, to_reg(c));
+					cvalue x = compile_value(child(t, 1), env);
+					emit(OP_MOV, r, to_reg(x));
+					size_t end_jump = emit(OP_JMP);
+					m_p.code[else_jump].imm = m_p.code.size();
+					cvalue y = compile_value(child(t, 2), env);
+					emit(OP_MOV, r, to_reg(y));
+					m_p.code[end_jump].imm = m_p.code.size();
+					return cvalue::in_reg(r, x.type);
+				}
+				if (tok == TOKEN(FP_DEREF)) return deref(compile_value(child(t, 0), env));
+				if (tok == TOKEN(FP_MEMBER)) return member(compile_value(child(t, 0), env), ident_of(child(t, 1)));
+				if (tok == TOKEN(FP_SUBSCRIPT)) return compile_subscript(t, env);
+				if (tok == TOKEN(FP_SIZEOF))
+				{
+					/* Only the type matters, so throw away any code. */
+					size_t code_mark = m_p.code.size();
+					unsigned reg_mark = m_next_reg;
+					cvalue x = compile_value(child(t, 0), env);
+					m_p.code.resize(code_mark);
+					m_next_reg = reg_mark;
+					uint64_t size = 0;
+					if (x.kind == cvalue::LVALUE) size = x.size;
+					else if (x.kind == cvalue::REG) size = size_of(x.type);
+					else if (x.kind == cvalue::OBJECTS && x.lo->kind == cvalue::CONST && x.hi->kind == cvalue::CONST)
+					{ size = (x.hi->k - x.lo->k) * x.size; }
+					else if (x.kind == cvalue::OBJECTS && (x.lo->kind == cvalue::INDEX || x.hi->kind == cvalue::INDEX))
+					{ throw not_affine(); }
+					if (size == 0) throw compile_error("cannot take sizeof an expression of unknown type");
+					return cvalue::constant(size);
+				}
+				if (tok == TOKEN(FP_APP))
+				{
+					cvalue result(cvalue::CONST);
+					apply(t, env, [this, &result](Tree *body, const environment& inner) {
+						result = this->compile_value(body, inner);
+					});
+					return result;
+				}
+				if (tok == TOKEN(FP_UNION) || tok == TOKEN(FP_ADJACENT) || tok == TOKEN(FP_FOR)
+					|| tok == TOKEN(FP_VOID))
+				{
+					throw compile_error("footprint used where a value is needed");
+				}
+				throw compile_error("unsupported footprint expression " + string(CCP(TO_STRING_TREE(t))));
+			}
+
+			void compile_footprint(Tree *t, const environment& env, direction dir)
+			{
+				unsigned tok = GET_TYPE(t);
+				if (tok == TOKEN(FP_VOID)) return;
+				if (tok == TOKEN(FP_UNION) || tok == TOKEN(FP_ADJACENT))
+				{
+					for (unsigned i = 0; i < nchildren(t); ++i)
+					{
+						unsigned mark = m_next_reg;
+						compile_footprint(child(t, i), env, dir);
+						m_next_reg = mark;
+					}
+					return;
+				}
+				if (tok == TOKEN(FP_FOR)) { compile_for(t, env, dir); return; }
+				if (tok == TOKEN(FP_IF))
+				{
+					cvalue c = compile_value(child(t, 0), env);
+					if (c.kind == cvalue::CONST) { compile_footprint(child(t, c.k ? 1 : 2), env, dir); return; }
+					size_t else_jump = emit(OP_JZ, to_reg(c));
+					unsigned mark = m_next_reg;
+					compile_footprint(child(t, 1), env, dir);
+					size_t end_jump = emit(OP_JMP);
+					m_p.code[else_jump].imm = m_p.code.size();
+					m_next_reg = mark;
+					compile_footprint(child(t, 2), env, dir);
+					m_p.code[end_jump].imm = m_p.code.size();
+					return;
+				}
+				if (tok == TOKEN(FP_APP))
+				{
+					apply(t, env, [this, dir](Tree *body, const environment& inner) {
+						this->compile_footprint(body, inner, dir);
+					});
+					return;
+				}
+				emit_objects(compile_value(t, env), dir);
+			}
+
+			void compile_clauses(Tree *clauses, iterator_df<subprogram_die> subprogram)
+			{
+				environment env;
+				auto fps = subprogram.children().subseq_of<formal_parameter_die>();
+				unsigned n = 0;
+				for (auto i_fp = fps.first; i_fp != fps.second; ++i_fp, ++n)
+				{
+					string name = i_fp.name_here() ? *i_fp.name_here() : "";
+					iterator_df<type_die> t = i_fp->find_type();
+					uint64_t size = size_of(t);
+					unsigned r = fresh();
+					emit(OP_ARG, r, 0, (size > 0 && size < 8) ? size : 0, n, is_signed(t) ? SIGNED : 0);
+					m_p.arg_names.push_back(name);
+					if (name != "") env.insert(std::make_pair(name, cvalue::in_reg(r, t)));
+				}
+				for (unsigned i = 0; i < nchildren(clauses); ++i)
+				{
+					Tree *clause = child(clauses, i);
+					unsigned dir_tok = GET_TYPE(child(clause, 0));
+					direction dir = (dir_tok == TOKEN(KEYWORD_R)) ? READ
+						: (dir_tok == TOKEN(KEYWORD_W)) ? WRITE : READ_WRITE;
+					unsigned mark = m_next_reg;
+					compile_footprint(child(clause, 1), env, dir);
+					m_next_reg = mark;
+				}
+				emit(OP_HALT);
+			}
+		};
+	}
+
+	void compiler::add_function(Tree *fp_fun)
+	{
+		assert(GET_TYPE(fp_fun) == TOKEN(FP_FUN));
+		m_functions[ident_of(child(fp_fun, 0))] = fp_fun;
+	}
+
+	void compiler::add_functions(Tree *toplevel)
+	{
+		for (unsigned i = 0; i < nchildren(toplevel); ++i)
+		{
+			if (GET_TYPE(child(toplevel, i)) == TOKEN(FP_FUN)) add_function(child(toplevel, i));
+		}
+	}
+
+	program compiler::compile(Tree *clauses, iterator_df<subprogram_die> subprogram) const
+	{
+		program p;
+		p.name = subprogram.name_here() ? *subprogram.name_here() : "";
+		p.nregs = 0;
+		codegen g(*this, p);
+		try
+		{
+			g.compile_clauses(clauses, subprogram);
+		}
+		catch (compile_error& e)
+		{
+			throw compile_error("in footprint of " + p.name + ": " + e.what());
+		}
+		return p;
+	}
+
+	static void compile_footprints_in(const compiler& c, Tree *dies, const iterator_base& scope,
+		std::map<string, program>& out)
+	{
+		for (unsigned i = 0; i < nchildren(dies); ++i)
+		{
+			Tree *d = child(dies, i);
+			if (GET_TYPE(d) != TOKEN(DIE)) continue;
+			Tree *attrs = child(d, 1);
+			Tree *clauses = nullptr;
+			string name;
+			for (unsigned j = 0; j < nchildren(attrs); ++j)
+			{
+				Tree *attr = child(attrs, j);
+				unsigned key = GET_TYPE(child(attr, 0));
+				if (key == TOKEN(FOOTPRINT)) clauses = child(attr, 1);
+				else if (key == TOKEN(NAME)) name = ident_of(child(attr, 1));
+			}
+			if (clauses)
+			{
+				vector<string> path(1, name);
+				iterator_base found = scope.root().scoped_resolve(scope, path.begin(), path.end());
+				if (!found || !found.is_a<subprogram_die>())
+				{
+					throw compile_error("footprint given for `" + name + "', which is not a known subprogram");
+				}
+				out[name] = c.compile(clauses, found.as_a<subprogram_die>());
+			}
+			compile_footprints_in(c, child(d, 2), scope, out);
+		}
+	}
+
+	std::map<string, program> compiler::compile_all(Tree *toplevel, const iterator_base& scope)
+	{
+		add_functions(toplevel);
+		std::map<string, program> out;
+		compile_footprints_in(*this, toplevel, scope, out);
+		return out;
+	}
+
+	const char *status_name(status s)
+	{
+		switch (s)
+		{
+			case OK:                  return "ok";
+			case READ_FAILED:         return "read failed";
+			case DIVIDE_BY_ZERO:      return "divide by zero";
+			case STEP_LIMIT_EXCEEDED: return "step limit exceeded";
+			default:                  return "(bad status)";
+		}
+	}
+
+	static inline int64_t extend(uint64_t v, unsigned size, bool sign)
+	{
+		if (size == 0 || size >= 8) return v;
+		unsigned shift = 64 - 8 * size;
+		return sign ? (int64_t)(v << shift) >> shift : (int64_t)((v << shift) >> shift);
+	}
+
+	/* The interpreter, parameterised by what to do with each access. */
+	template <typename Sink>
+	static status run(const program& p, const uint64_t *args, read_fn read, void *read_ctx,
+		Sink& sink, uint64_t step_limit)
+	{
+		int64_t r[256];
+		const insn *code = p.code.data();
+		uint64_t steps = 0;
+		for (size_t pc = 0; ; )
+		{
+			const insn& i = code[pc++];
+			switch (i.op)
+			{
+				case OP_HALT:   return OK;
+				case OP_LOADI:  r[i.a] = i.imm; break;
+				case OP_ARG:    r[i.a] = extend(args[i.imm], i.c, i.flags & SIGNED); break;
+				case OP_MOV:    r[i.a] = r[i.b]; break;
+				case OP_ADD:    r[i.a] = (int64_t)((uint64_t) r[i.b] + (uint64_t) r[i.c]); break;
+				case OP_SUB:    r[i.a] = (int64_t)((uint64_t) r[i.b] - (uint64_t) r[i.c]); break;
+				case OP_MUL:    r[i.a] = (int64_t)((uint64_t) r[i.b] * (uint64_t) r[i.c]); break;
+				case OP_DIV:
+					if (r[i.c] == 0) return DIVIDE_BY_ZERO;
+					r[i.a] = (r[i.c] == -1) ? (int64_t)(0 - (uint64_t) r[i.b]) : r[i.b] / r[i.c];
+					break;
+				case OP_MOD:
+					if (r[i.c] == 0) return DIVIDE_BY_ZERO;
+					r[i.a] = (r[i.c] == -1) ? 0 : r[i.b] % r[i.c];
+					break;
+				case OP_SHL:    r[i.a] = (int64_t)((uint64_t) r[i.b] << (r[i.c] & 63)); break;
+				case OP_SHR:    r[i.a] = r[i.b] >> (r[i.c] & 63); break;
+				case OP_BITAND: r[i.a] = r[i.b] & r[i.c]; break;
+				case OP_BITOR:  r[i.a] = r[i.b] | r[i.c]; break;
+				case OP_BITXOR: r[i.a] = r[i.b] ^ r[i.c]; break;
+				case OP_EQ:     r[i.a] = r[i.b] == r[i.c]; break;
+				case OP_NE:     r[i.a] = r[i.b] != r[i.c]; break;
+				case OP_LT:     r[i.a] = r[i.b] <  r[i.c]; break;
+				case OP_GT:     r[i.a] = r[i.b] >  r[i.c]; break;
+				case OP_LTE:    r[i.a] = r[i.b] <= r[i.c]; break;
+				case OP_GTE:    r[i.a] = r[i.b] >= r[i.c]; break;
+				case OP_ADDI:   r[i.a] = (int64_t)((uint64_t) r[i.b] + (uint64_t) i.imm); break;
+				case OP_MULI:   r[i.a] = (int64_t)((uint64_t) r[i.b] * (uint64_t) i.imm); break;
+				case OP_NEG:    r[i.a] = (int64_t)(0 - (uint64_t) r[i.b]); break;
+				case OP_BITNOT: r[i.a] = ~r[i.b]; break;
+				case OP_LNOT:   r[i.a] = !r[i.b]; break;
+				case OP_BOOL:   r[i.a] = !!r[i.b]; break;
+				case OP_LOAD: {
+					unsigned char buf[8];
+					if (!read(read_ctx, (uint64_t) r[i.b] + (uint64_t) i.imm, buf, i.c)) return READ_FAILED;
+					uint64_t v = 0;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+					for (unsigned k = 0; k < i.c; ++k) v = (v << 8) | buf[k];
+#else
+					memcpy(&v, buf, i.c);
+#endif
+					r[i.a] = extend(v, i.c, i.flags & SIGNED);
+				} break;
+				case OP_JMP:
+					if ((size_t) i.imm < pc && ++steps > step_limit) return STEP_LIMIT_EXCEEDED;
+					pc = i.imm;
+					break;
+				case OP_JZ:     if (r[i.a] == 0) pc = i.imm; break;
+				case OP_EMIT:
+					if (r[i.b] > 0) sink((uint64_t) r[i.a], (uint64_t) r[i.b], (direction) i.flags);
+					break;
+				case OP_EMITI:
+					sink((uint64_t) r[i.a], (uint64_t) i.imm, (direction) i.flags);
+					break;
+				default:
+					assert(false); abort();
+			}
+		}
+	}
+
+	struct set_sink
+	{
+		footprint_set& out;
+		void operator()(uint64_t base, uint64_t length, direction dir)
+		{
+			/* Clamp at the top of the address space. */
+			uint64_t end = (base + length < base) ? UINT64_MAX : base + length;
+			out += std::make_pair(boost::icl::interval<uint64_t>::right_open(base, end),
+				static_cast<uint8_t>(dir));
+		}
+	};
+
+	status evaluate(const program& p, const uint64_t *args, read_fn read, void *read_ctx,
+		vector<access>& out, uint64_t step_limit)
+	{
+		auto sink = [&out](uint64_t base, uint64_t length, direction dir) {
+			access a = { base, length, dir };
+			out.push_back(a);
+		};
+		return run(p, args, read, read_ctx, sink, step_limit);
+	}
+
+	status evaluate(const program& p, const uint64_t *args, read_fn read, void *read_ctx,
+		footprint_set& out, uint64_t step_limit)
+	{
+		set_sink sink = { out };
+		return run(p, args, read, read_ctx, sink, step_limit);
+	}
+
+	void evaluate_batch(const program& p, const uint64_t *const *columns, size_t ntuples,
+		read_fn read, void *read_ctx, vector<footprint_set>& out, vector<status>& statuses,
+		unsigned nthreads, uint64_t step_limit)
+	{
+		out.assign(ntuples, footprint_set());
+		statuses.assign(ntuples, OK);
+		const size_t nargs = p.arg_names.size();
+		/* Threads take chunks of tuples in turn, so that uneven costs
+		 * (e.g. long iovecs) even out. */
+		const size_t chunk = 256;
+		std::atomic<size_t> next(0);
+		auto worker = [&]() {
+			vector<uint64_t> args(nargs);
+			for (size_t begin; (begin = next.fetch_add(chunk)) < ntuples; )
+			{
+				size_t end = std::min(begin + chunk, ntuples);
+				for (size_t k = begin; k < end; ++k)
+				{
+					for (size_t j = 0; j < nargs; ++j) args[j] = columns[j][k];
+					set_sink sink = { out[k] };
+					statuses[k] = run(p, args.data(), read, read_ctx, sink, step_limit);
+				}
+			}
+		};
+		if (nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+		nthreads = std::min<size_t>(nthreads, (ntuples + chunk - 1) / chunk);
+		if (nthreads <= 1) { worker(); return; }
+		vector<std::thread> threads;
+		for (unsigned t = 0; t < nthreads; ++t) threads.push_back(std::thread(worker));
+		for (auto& t : threads) t.join();
+	}
+}
+}
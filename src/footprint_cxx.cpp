@@ -0,0 +1,207 @@
+#include <set>
+#include <sstream>
+#include <climits>
+#include "dwarfidl/footprint_cxx.hpp"
+
+using std::string;
+using std::ostringstream;
+using std::endl;
+
+namespace dwarfidl
+{
+namespace footprint
+{
+	namespace
+	{
+		string reg(unsigned r)
+		{
+			ostringstream s;
+			s << "r" << r;
+			return s.str();
+		}
+		string u(unsigned r) { return "(uint64_t) " + reg(r); }
+		string literal(int64_t k)
+		{
+			if (k == INT64_MIN) return "INT64_MIN";
+			ostringstream s;
+			s << k << "LL";
+			return s.str();
+		}
+		const char *binary_operator(uint8_t op)
+		{
+			switch (op)
+			{
+				case OP_BITAND: return "&";
+				case OP_BITOR:  return "|";
+				case OP_BITXOR: return "^";
+				case OP_EQ:     return "==";
+				case OP_NE:     return "!=";
+				case OP_LT:     return "<";
+				case OP_GT:     return ">";
+				case OP_LTE:    return "<=";
+				case OP_GTE:    return ">=";
+				default:        return nullptr;
+			}
+		}
+		const char *wrapping_operator(uint8_t op)
+		{
+			switch (op)
+			{
+				case OP_ADD: return "+";
+				case OP_SUB: return "-";
+				case OP_MUL: return "*";
+				default:     return nullptr;
+			}
+		}
+	}
+
+	void write_cxx_prelude(std::ostream& out)
+	{
+		out << "#include <cstdint>" << endl
+			<< "#include <cstring>" << endl
+			<< "#include <climits>" << endl
+			<< endl
+			<< "static inline int64_t footprint_extend(uint64_t v, unsigned size, bool is_signed)" << endl
+			<< "{" << endl
+			<< "\tif (size == 0 || size >= 8) return v;" << endl
+			<< "\tunsigned shift = 64 - 8 * size;" << endl
+			<< "\treturn is_signed ? (int64_t)(v << shift) >> shift : (int64_t)((v << shift) >> shift);" << endl
+			<< "}" << endl
+			<< "static inline uint64_t footprint_bytes(const unsigned char *buf, unsigned size)" << endl
+			<< "{" << endl
+			<< "\tuint64_t v = 0;" << endl
+			<< "#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__" << endl
+			<< "\tfor (unsigned k = 0; k < size; ++k) v = (v << 8) | buf[k];" << endl
+			<< "#else" << endl
+			<< "\tmemcpy(&v, buf, size);" << endl
+			<< "#endif" << endl
+			<< "\treturn v;" << endl
+			<< "}" << endl << endl;
+	}
+
+	void write_cxx(std::ostream& out, const program& p, const string& function_name)
+	{
+		std::set<size_t> targets;
+		for (auto i = p.code.begin(); i != p.code.end(); ++i)
+		{
+			if (i->op == OP_JMP || i->op == OP_JZ) targets.insert(i->imm);
+		}
+
+		out << "/* footprint of " << p.name << "(";
+		for (auto i_a = p.arg_names.begin(); i_a != p.arg_names.end(); ++i_a)
+		{
+			out << (i_a == p.arg_names.begin() ? "" : ", ") << *i_a;
+		}
+		out << ") */" << endl
+			<< "template <typename Read, typename Sink>" << endl
+			<< "int " << function_name << "(const uint64_t *args, Read read, Sink sink, "
+			<< "uint64_t step_limit = 1u << 24)" << endl
+			<< "{" << endl;
+		for (unsigned r = 0; r < p.nregs; ++r) out << "\tint64_t " << reg(r) << " = 0;" << endl;
+		out << "\tuint64_t steps = 0; (void) steps;" << endl;
+
+		for (size_t pc = 0; pc < p.code.size(); ++pc)
+		{
+			const insn& i = p.code[pc];
+			if (targets.find(pc) != targets.end()) out << "L" << pc << ":" << endl;
+			out << "\t";
+			const char *wrapping = wrapping_operator(i.op);
+			const char *binary = binary_operator(i.op);
+			if (wrapping)
+			{
+				out << reg(i.a) << " = (int64_t)(" << u(i.b) << " " << wrapping << " " << u(i.c) << ");";
+			}
+			else if (binary)
+			{
+				out << reg(i.a) << " = " << reg(i.b) << " " << binary << " " << reg(i.c) << ";";
+			}
+			else switch (i.op)
+			{
+				case OP_HALT:
+					out << "return " << OK << ";";
+					break;
+				case OP_LOADI:
+					out << reg(i.a) << " = " << literal(i.imm) << ";";
+					break;
+				case OP_ARG:
+					out << reg(i.a) << " = footprint_extend(args[" << i.imm << "], " << (int) i.c << ", "
+						<< ((i.flags & SIGNED) ? "true" : "false") << ");";
+					break;
+				case OP_MOV:
+					out << reg(i.a) << " = " << reg(i.b) << ";";
+					break;
+				case OP_DIV:
+				case OP_MOD:
+					out << "if (" << reg(i.c) << " == 0) return " << DIVIDE_BY_ZERO << ";" << endl << "\t"
+						<< reg(i.a) << " = (" << reg(i.c) << " == -1) ? "
+						<< ((i.op == OP_DIV) ? "(int64_t)(0 - " + u(i.b) + ")" : string("0")) << " : "
+						<< reg(i.b) << ((i.op == OP_DIV) ? " / " : " % ") << reg(i.c) << ";";
+					break;
+				case OP_SHL:
+					out << reg(i.a) << " = (int64_t)(" << u(i.b) << " << (" << reg(i.c) << " & 63));";
+					break;
+				case OP_SHR:
+					out << reg(i.a) << " = " << reg(i.b) << " >> (" << reg(i.c) << " & 63);";
+					break;
+				case OP_ADDI:
+					out << reg(i.a) << " = (int64_t)(" << u(i.b) << " + (uint64_t) " << literal(i.imm) << ");";
+					break;
+				case OP_MULI:
+					out << reg(i.a) << " = (int64_t)(" << u(i.b) << " * (uint64_t) " << literal(i.imm) << ");";
+					break;
+				case OP_NEG:
+					out << reg(i.a) << " = (int64_t)(0 - " << u(i.b) << ");";
+					break;
+				case OP_BITNOT:
+					out << reg(i.a) << " = ~" << reg(i.b) << ";";
+					break;
+				case OP_LNOT:
+					out << reg(i.a) << " = !" << reg(i.b) << ";";
+					break;
+				case OP_BOOL:
+					out << reg(i.a) << " = !!" << reg(i.b) << ";";
+					break;
+				case OP_LOAD:
+					out << "{ unsigned char buf[" << (int) i.c << "]; "
+						<< "if (!read(" << u(i.b) << " + (uint64_t) " << literal(i.imm) << ", buf, "
+						<< (int) i.c << ")) return " << READ_FAILED << "; "
+						<< reg(i.a) << " = footprint_extend(footprint_bytes(buf, " << (int) i.c << "), "
+						<< (int) i.c << ", " << ((i.flags & SIGNED) ? "true" : "false") << "); }";
+					break;
+				case OP_JMP:
+					if ((size_t) i.imm < pc + 1)
+					{
+						out << "if (++steps > step_limit) return " << STEP_LIMIT_EXCEEDED << ";" << endl << "\t";
+					}
+					out << "goto L" << i.imm << ";";
+					break;
+				case OP_JZ:
+					out << "if (" << reg(i.a) << " == 0) goto L" << i.imm << ";";
+					break;
+				case OP_EMIT:
+					out << "if (" << reg(i.b) << " > 0) sink(" << u(i.a) << ", " << u(i.b)
+						<< ", " << (int) i.flags << ");";
+					break;
+				case OP_EMITI:
+					out << "sink(" << u(i.a) << ", (uint64_t) " << literal(i.imm) << ", "
+						<< (int) i.flags << ");";
+					break;
+				default:
+					throw compile_error(string("cannot generate C++ for opcode ")
+						+ opcode_name(static_cast<opcode>(i.op)));
+			}
+			out << endl;
+		}
+		out << "}" << endl << endl;
+	}
+
+	void write_cxx(std::ostream& out, const std::map<string, program>& programs)
+	{
+		write_cxx_prelude(out);
+		for (auto i_p = programs.begin(); i_p != programs.end(); ++i_p)
+		{
+			write_cxx(out, i_p->second, "footprint_" + i_p->first);
+		}
+	}
+}
+}
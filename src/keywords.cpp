@@ -0,0 +1,190 @@
+#include <cstdint>
+#include <cstring>
+#include <strings.h>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <initializer_list>
+#include "dwarfidl/keywords.hpp"
+
+using namespace dwarf;
+using namespace dwarf::lib;
+using dwarf::spec::DEFAULT_DWARF_SPEC;
+
+namespace dwarfidl
+{
+	namespace
+	{
+		struct keyword
+		{
+			unsigned code;
+			const char *name;
+		};
+
+		/* The keywords dwarfidlNew's lexer knows, generated from the
+		 * grammar; see Makefile.am. */
+		const keyword tag_keywords[] = {
+#define DWARFIDL_KEYWORD(kw) { DW_TAG_ ## kw, #kw },
+#include "tag-keywords.def"
+#undef DWARFIDL_KEYWORD
+		};
+		const keyword attr_keywords[] = {
+#define DWARFIDL_KEYWORD(kw) { DW_AT_ ## kw, #kw },
+#include "attr-keywords.def"
+#undef DWARFIDL_KEYWORD
+		};
+
+		uint32_t hash(const char *s, uint32_t seed)
+		{
+			/* FNV-1a, folding ASCII case */
+			uint32_t h = 2166136261u ^ seed;
+			for (; *s; ++s)
+			{
+				unsigned char c = *s;
+				if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+				h ^= c;
+				h *= 16777619u;
+			}
+			return h;
+		}
+
+		/* Codes to names by binary search, and names to codes by a perfect
+		 * hash built with "hash and displace": keys are put into buckets
+		 * by one hash, and each bucket, biggest first, is given a seed for
+		 * a second hash that lands all its keys in free slots. A lookup is
+		 * then two hashes and one string comparison. */
+		class keyword_table
+		{
+			std::vector<keyword> m_by_code;
+			std::vector<uint32_t> m_seeds;   // per bucket
+			std::vector<uint16_t> m_slots;   // index into m_by_code, plus 1
+			uint32_t m_mask;
+
+			void build_hash();
+		public:
+			/* The parser's keywords, then whatever else the spec names with
+			 * 'prefix' among 'ranges', so that printing never meets a code
+			 * we can't name. */
+			keyword_table(const keyword *begin, const keyword *end,
+				const char *(*lookup)(unsigned), const char *prefix,
+				std::initializer_list<std::pair<unsigned, unsigned> > ranges);
+
+			const char *name(unsigned code) const
+			{
+				auto found = std::lower_bound(m_by_code.begin(), m_by_code.end(), code,
+					[](const keyword& k, unsigned c) { return k.code < c; });
+				return (found != m_by_code.end() && found->code == code) ? found->name : nullptr;
+			}
+			unsigned code(const char *name) const
+			{
+				if (m_seeds.empty()) return 0;
+				uint32_t bucket = hash(name, 0) % m_seeds.size();
+				uint16_t slot = m_slots[hash(name, m_seeds[bucket]) & m_mask];
+				if (slot == 0 || strcasecmp(m_by_code[slot - 1].name, name) != 0) return 0;
+				return m_by_code[slot - 1].code;
+			}
+		};
+
+		keyword_table::keyword_table(const keyword *begin, const keyword *end,
+			const char *(*lookup)(unsigned), const char *prefix,
+			std::initializer_list<std::pair<unsigned, unsigned> > ranges)
+		 : m_by_code(begin, end)
+		{
+			std::sort(m_by_code.begin(), m_by_code.end(),
+				[](const keyword& a, const keyword& b) { return a.code < b.code; });
+			size_t prefix_len = strlen(prefix);
+			std::vector<keyword> extra;
+			for (auto i_r = ranges.begin(); i_r != ranges.end(); ++i_r)
+			{
+				for (unsigned code = i_r->first; code < i_r->second; ++code)
+				{
+					if (name(code)) continue;
+					const char *spec_name = lookup(code);
+					if (!spec_name || strncmp(spec_name, prefix, prefix_len) != 0) continue;
+					keyword k = { code, spec_name + prefix_len };
+					/* The first code by any name wins, as the hash needs. */
+					auto same_name = [&k](const keyword& other) { return strcasecmp(other.name, k.name) == 0; };
+					if (std::any_of(m_by_code.begin(), m_by_code.end(), same_name)
+						|| std::any_of(extra.begin(), extra.end(), same_name)) continue;
+					extra.push_back(k);
+				}
+			}
+			m_by_code.insert(m_by_code.end(), extra.begin(), extra.end());
+			std::sort(m_by_code.begin(), m_by_code.end(),
+				[](const keyword& a, const keyword& b) { return a.code < b.code; });
+			build_hash();
+		}
+
+		void keyword_table::build_hash()
+		{
+			size_t nslots = 1;
+			while (nslots < 2 * m_by_code.size()) nslots <<= 1;
+			m_mask = nslots - 1;
+			std::vector<std::vector<uint16_t> > buckets((m_by_code.size() + 1) / 2);
+			m_seeds.assign(buckets.size(), 0);
+			for (unsigned i = 0; i < m_by_code.size(); ++i)
+			{
+				buckets[hash(m_by_code[i].name, 0) % buckets.size()].push_back(i);
+			}
+			std::vector<unsigned> order(buckets.size());
+			for (unsigned b = 0; b < order.size(); ++b) order[b] = b;
+			std::sort(order.begin(), order.end(), [&buckets](unsigned a, unsigned b) {
+				return buckets[a].size() > buckets[b].size();
+			});
+
+			m_slots.assign(nslots, 0);
+			for (auto i_b = order.begin(); i_b != order.end(); ++i_b)
+			{
+				const std::vector<uint16_t>& bucket = buckets[*i_b];
+				if (bucket.empty()) break;
+				for (uint32_t seed = 1; ; ++seed)
+				{
+					std::vector<uint32_t> taken;
+					for (auto i_k = bucket.begin(); i_k != bucket.end(); ++i_k)
+					{
+						uint32_t slot = hash(m_by_code[*i_k].name, seed) & m_mask;
+						if (m_slots[slot] != 0
+							|| std::find(taken.begin(), taken.end(), slot) != taken.end()) break;
+						taken.push_back(slot);
+					}
+					if (taken.size() != bucket.size()) continue;
+					for (unsigned k = 0; k < bucket.size(); ++k) m_slots[taken[k]] = bucket[k] + 1;
+					m_seeds[*i_b] = seed;
+					break;
+				}
+			}
+		}
+
+		/* Standard codes, then the vendor ones libdwarfpp knows. */
+		const keyword_table& tags()
+		{
+			static const keyword_table t(std::begin(tag_keywords), std::end(tag_keywords),
+				[](unsigned c) { return DEFAULT_DWARF_SPEC.tag_lookup(c); }, "DW_TAG_",
+				{ { 1, 0x100 }, { DW_TAG_lo_user, DW_TAG_lo_user + 0x200 } });
+			return t;
+		}
+		const keyword_table& attrs()
+		{
+			static const keyword_table t(std::begin(attr_keywords), std::end(attr_keywords),
+				[](unsigned c) { return DEFAULT_DWARF_SPEC.attr_lookup(c); }, "DW_AT_",
+				{ { 1, 0x100 }, { DW_AT_lo_user, DW_AT_lo_user + 0x200 } });
+			return t;
+		}
+		/* The parser takes any opcode name, so there is no list of them. */
+		const keyword_table& ops()
+		{
+			static const keyword_table t(nullptr, nullptr,
+				[](unsigned c) { return DEFAULT_DWARF_SPEC.op_lookup(c); }, "DW_OP_",
+				{ { 1, 0x100 } });
+			return t;
+		}
+	}
+
+	const char *keyword_for_tag(Dwarf_Half tag) { return tags().name(tag); }
+	const char *keyword_for_attr(Dwarf_Half attr) { return attrs().name(attr); }
+	const char *keyword_for_op(unsigned op) { return ops().name(op); }
+
+	Dwarf_Half tag_for_keyword(const char *keyword) { return tags().code(keyword); }
+	Dwarf_Half attr_for_keyword(const char *keyword) { return attrs().code(keyword); }
+	unsigned op_for_keyword(const char *keyword) { return ops().code(keyword); }
+}
@@ -0,0 +1,25 @@
+#include <cstdlib>
+#include "dwarfidl/log.hpp"
+
+namespace dwarfidl
+{
+	namespace detail
+	{
+		std::atomic<int> log_level(-1);
+
+		int init_log_level()
+		{
+			const char *level_str = getenv("DWARFIDL_DEBUG_LEVEL");
+			int level = level_str ? atoi(level_str) : 0;
+			level = (level < 0) ? 0 : level;
+			/* Racing threads all read the same value, so any store wins. */
+			log_level.store(level, std::memory_order_relaxed);
+			return level;
+		}
+	}
+
+	void set_log_level(int level)
+	{
+		detail::log_level.store((level < 0) ? 0 : level, std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,171 @@
+#include <cassert>
+#include <cstdlib>
+#include <dwarfpp/lib.hpp>
+#include "dwarfidl/mapped_slice_root.hpp"
+
+using namespace dwarf;
+using namespace dwarf::core;
+using namespace dwarf::lib;
+using dwarf::spec::DEFAULT_DWARF_SPEC;
+using std::string;
+
+namespace dwarfidl
+{
+	using namespace binslice;
+
+	mapped_slice_root_die::mapped_slice_root_die(std::shared_ptr<const mapped_binary_slice> slice)
+	 : root_die(), m_slice(slice)
+	{
+		const header& h = m_slice->hdr();
+		m_synthetic_cu = (h.ndies == 0 || m_slice->dies()[0].tag != DW_TAG_compile_unit);
+		m_index_base = m_synthetic_cu ? synthetic_cu_offset() + 1 : 1;
+	}
+
+	mapped_slice_root_die::mapped_slice_root_die(const string& path)
+	 : mapped_slice_root_die(std::make_shared<const mapped_binary_slice>(path))
+	{}
+
+	iterator_base mapped_slice_root_die::make_new(const iterator_base& parent, Dwarf_Half tag)
+	{
+		/* Use load_binary_slice to get something we can add to. */
+		assert(false && "mapped slices are read-only"); abort();
+	}
+
+	bool mapped_slice_root_die::move_to_first_child(iterator_base& it)
+	{
+		const header& h = m_slice->hdr();
+		Dwarf_Off off = it.offset_here();
+		Dwarf_Off target;
+		if (off == 0 && m_synthetic_cu) target = synthetic_cu_offset();
+		else if (off == 0 || (m_synthetic_cu && off == synthetic_cu_offset()))
+		{
+			if (h.ndies == 0) return false;
+			target = offset_of_index(0);
+		}
+		else
+		{
+			auto idx = index_of_offset(off);
+			assert(idx);
+			uint32_t child = m_slice->dies()[*idx].first_child;
+			if (child == no_index) return false;
+			target = offset_of_index(child);
+		}
+		it = pos(target, it.depth() + 1);
+		return true;
+	}
+
+	bool mapped_slice_root_die::move_to_next_sibling(iterator_base& it)
+	{
+		auto idx = index_of_offset(it.offset_here());
+		/* The root and the synthetic CU have no siblings. */
+		if (!idx) return false;
+		uint32_t next = m_slice->dies()[*idx].next_sibling;
+		if (next == no_index) return false;
+		it = pos(offset_of_index(next), it.depth());
+		return true;
+	}
+
+	bool mapped_slice_root_die::move_to_parent(iterator_base& it)
+	{
+		Dwarf_Off off = it.offset_here();
+		if (off == 0) return false;
+		auto idx = index_of_offset(off);
+		Dwarf_Off target;
+		if (!idx) target = 0; // the synthetic CU
+		else
+		{
+			uint32_t parent = m_slice->dies()[*idx].parent;
+			if (parent != no_index) target = offset_of_index(parent);
+			else target = m_synthetic_cu ? synthetic_cu_offset() : 0;
+		}
+		it = (target == 0) ? begin() : pos(target, it.depth() - 1);
+		return true;
+	}
+
+	iterator_base mapped_slice_root_die::find_downwards(Dwarf_Off off)
+	{
+		if (off == 0) return begin();
+		if (m_synthetic_cu && off == synthetic_cu_offset()) return pos(off, 1);
+		auto idx = index_of_offset(off);
+		if (!idx) return iterator_base::END;
+		/* Depth is one more than the number of record ancestors,
+		 * plus one if we made up a CU. */
+		unsigned depth = m_synthetic_cu ? 2 : 1;
+		for (uint32_t p = m_slice->dies()[*idx].parent; p != no_index;
+			p = m_slice->dies()[p].parent)
+		{ ++depth; }
+		return pos(off, depth);
+	}
+
+	basic_die *mapped_slice_root_die::make_payload(const iterator_base& it)
+	{
+		auto idx = index_of_offset(it.offset_here());
+		assert(idx || (m_synthetic_cu && it.offset_here() == synthetic_cu_offset()));
+		return factory::for_spec(DEFAULT_DWARF_SPEC).make_payload(
+			mapped_slice_die(*this, idx ? *idx : no_index), *this);
+	}
+
+	Dwarf_Off mapped_slice_die::get_offset() const
+	{
+		return (idx == no_index) ? p_root->synthetic_cu_offset()
+			: p_root->offset_of_index(idx);
+	}
+
+	Dwarf_Half mapped_slice_die::get_tag() const
+	{
+		return (idx == no_index) ? DW_TAG_compile_unit
+			: p_root->slice().dies()[idx].tag;
+	}
+
+	opt<string> mapped_slice_die::get_name() const
+	{
+		if (idx == no_index) return opt<string>();
+		uint32_t name = p_root->slice().dies()[idx].name;
+		if (name == no_index) return opt<string>();
+		return string(p_root->slice().string_at(name));
+	}
+
+	Dwarf_Off mapped_slice_die::get_enclosing_cu_offset() const
+	{
+		if (p_root->has_synthetic_cu()) return p_root->synthetic_cu_offset();
+		/* Otherwise the toplevel records are the CUs. */
+		uint32_t i = idx;
+		while (p_root->slice().dies()[i].parent != no_index) i = p_root->slice().dies()[i].parent;
+		return p_root->offset_of_index(i);
+	}
+
+	bool mapped_slice_die::has_attr(Dwarf_Half attr) const
+	{
+		if (idx == no_index) return false;
+		const die_record& d = p_root->slice().dies()[idx];
+		const attr_record *attrs = p_root->slice().attrs();
+		for (uint32_t n = d.first_attr; n < d.first_attr + d.nattrs; ++n)
+		{
+			if (attrs[n].attr == attr) return attrs[n].form != REF_EXTERNAL;
+		}
+		return false;
+	}
+
+	encap::attribute_map mapped_slice_die::copy_attrs() const
+	{
+		encap::attribute_map out;
+		if (idx == no_index) return out;
+		const die_record& d = p_root->slice().dies()[idx];
+		const attr_record *attrs = p_root->slice().attrs();
+		/* The attribute values refer to the root, but never modify it. */
+		root_die& r = const_cast<mapped_slice_root_die&>(*p_root);
+		for (uint32_t n = d.first_attr; n < d.first_attr + d.nattrs; ++n)
+		{
+			/* Its offset is in the original root, and would alias ours. */
+			if (attrs[n].form == REF_EXTERNAL) continue;
+			out.insert(std::make_pair(attrs[n].attr, decode_binary_slice_attr(
+				p_root->slice(), attrs[n], r, get_offset(), p_root->offset_of_index(0))));
+		}
+		return out;
+	}
+
+	spec::abstract_def& mapped_slice_die::get_spec(root_die& r) const
+	{
+		return DEFAULT_DWARF_SPEC;
+	}
+}
@@ -0,0 +1,591 @@
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_set>
+#include <functional>
+#include <algorithm>
+#include "dwarfidl/merge.hpp"
+#include "dwarfidl/create.hpp"
+#include "dwarfidl/arena_root.hpp"
+#include "dwarfidl/keywords.hpp"
+
+namespace dwarfidl
+{
+	using namespace dwarf;
+	using namespace dwarf::core;
+	using dwarf::encap::attribute_value;
+	using std::vector;
+	using std::pair;
+	using std::make_pair;
+	using std::ostringstream;
+
+	std::ostream& operator<<(std::ostream& s, const merge_conflict& c)
+	{
+		s << c.where;
+		if (c.attr)
+		{
+			const char *keyword = keyword_for_attr(c.attr);
+			if (keyword) s << " [" << keyword << "]";
+			else s << " [attribute 0x" << std::hex << c.attr << std::dec << "]";
+		}
+		s << ": " << c.detail;
+		if (c.overridden) s << " (overridden)";
+		return s;
+	}
+
+	/* Each child of parent with its key, in order. */
+	static vector<pair<string, iterator_base> > keyed_children(const iterator_base& parent)
+	{
+		vector<pair<string, iterator_base> > out;
+		std::unordered_map<Dwarf_Half, unsigned> unnamed;
+		auto children = parent.children_here();
+		for (auto i = children.first; i != children.second; ++i)
+		{
+			if (i.name_here())
+			{
+				out.push_back(make_pair(merge_index::key(i.tag_here(), *i.name_here()), i));
+				continue;
+			}
+			ostringstream s;
+			s << "#" << unnamed[i.tag_here()]++;
+			out.push_back(make_pair(merge_index::key(i.tag_here(), s.str()), i));
+		}
+		return out;
+	}
+
+	merge_index::merge_index(root_die& r)
+	 : m_root(r), m_toplevel_built(false), m_resolution(nullptr)
+	{
+		arena_root_die *arena_root = dynamic_cast<arena_root_die *>(&r);
+		if (arena_root) m_resolution = &arena_root->resolution();
+		else
+		{
+			m_own_resolution.reset(new resolution_index(r));
+			m_resolution = m_own_resolution.get();
+		}
+	}
+
+	string merge_index::key(Dwarf_Half tag, const string& name_or_position)
+	{
+		ostringstream s;
+		s << tag << ":" << name_or_position;
+		return s.str();
+	}
+
+	const std::vector<iterator_base>& merge_index::toplevel(const string& k)
+	{
+		static const std::vector<iterator_base> none;
+		if (!m_toplevel_built)
+		{
+			auto cus = m_root.begin().children_here();
+			for (auto i_cu = cus.first; i_cu != cus.second; ++i_cu)
+			{
+				auto children = i_cu.children_here();
+				for (auto i = children.first; i != children.second; ++i)
+				{
+					if (i.name_here()) m_toplevel[key(i.tag_here(), *i.name_here())].push_back(i);
+				}
+			}
+			m_toplevel_built = true;
+		}
+		auto found = m_toplevel.find(k);
+		return found == m_toplevel.end() ? none : found->second;
+	}
+
+	const std::vector<iterator_base>& merge_index::children(const iterator_base& parent, const string& k)
+	{
+		static const std::vector<iterator_base> none;
+		auto found_table = m_children.find(parent.offset_here());
+		if (found_table == m_children.end())
+		{
+			found_table = m_children.insert(make_pair(parent.offset_here(), table())).first;
+			auto keyed = keyed_children(parent);
+			for (auto i_k = keyed.begin(); i_k != keyed.end(); ++i_k)
+			{
+				found_table->second[i_k->first].push_back(i_k->second);
+			}
+		}
+		auto found = found_table->second.find(k);
+		return found == found_table->second.end() ? none : found->second;
+	}
+
+	void merge_index::added(const iterator_base& created)
+	{
+		m_resolution->add(created);
+		iterator_base parent = created.parent();
+		if (parent.tag_here() == DW_TAG_compile_unit)
+		{
+			if (m_toplevel_built && created.name_here())
+			{
+				m_toplevel[key(created.tag_here(), *created.name_here())].push_back(created);
+			}
+			return;
+		}
+		/* An unnamed child's key depends on its siblings; cheaper to
+		 * index the parent again if it's ever looked into. */
+		if (!created.name_here()) { m_children.erase(parent.offset_here()); return; }
+		auto found_table = m_children.find(parent.offset_here());
+		if (found_table != m_children.end())
+		{
+			found_table->second[key(created.tag_here(), *created.name_here())].push_back(created);
+		}
+	}
+
+	void merge_index::replaced(const iterator_base& original, const iterator_base& copy)
+	{
+		m_resolution->add(copy);
+		if (!m_toplevel_built || !original.name_here()) return;
+		auto& v = m_toplevel[key(original.tag_here(), *original.name_here())];
+		std::replace(v.begin(), v.end(), original, copy);
+	}
+
+	iterator_base merge_index::additions_cu()
+	{
+		if (!m_additions_cu) m_additions_cu = m_root.make_new(m_root.begin(), DW_TAG_compile_unit);
+		return m_additions_cu;
+	}
+
+	namespace
+	{
+		class merger
+		{
+			struct matched
+			{
+				iterator_base overlay;
+				iterator_base target;
+				string where;
+			};
+
+			merge_index& m_index;
+			root_die& m_target;
+			arena_root_die& m_overlay;
+			bool m_override;
+			merge_report& m_report;
+			/* Overlay DIE offset and attribute of each pending reference,
+			 * to the name it is to be resolved from. */
+			std::map<pair<Dwarf_Off, Dwarf_Half>, string> m_pending;
+			/* Overlay DIEs that some overlay attribute refers to. */
+			std::unordered_set<Dwarf_Off> m_referenced;
+			std::unordered_map<Dwarf_Off, iterator_base> m_mapped;
+			vector<matched> m_matched;
+			/* Overlay DIEs with no match, to be added under parent (END for
+			 * the additions CU) once matching is done. */
+			struct addition
+			{
+				iterator_base overlay;
+				iterator_base parent;
+				string where_parent;
+			};
+			vector<addition> m_additions;
+
+			bool is_inline(const iterator_base& o) const
+			{ return !o.name_here() && m_referenced.find(o.offset_here()) != m_referenced.end(); }
+
+			string describe(const iterator_base& o, const string& where_parent) const
+			{
+				ostringstream s;
+				if (where_parent.empty())
+				{
+					const char *keyword = keyword_for_tag(o.tag_here());
+					s << (keyword ? keyword : "DIE") << " ";
+				}
+				else s << where_parent << ".";
+				if (o.name_here()) s << *o.name_here();
+				else s << "(anonymous)";
+				return s.str();
+			}
+
+			void conflict(const string& where, Dwarf_Half attr, const string& detail,
+				const iterator_base& target, bool overridden)
+			{
+				merge_conflict c = { where, attr, detail, target, overridden };
+				m_report.conflicts.push_back(c);
+			}
+
+			size_t structure_hash(const iterator_base& d) const
+			{
+				ostringstream s;
+				auto keyed = keyed_children(d);
+				for (auto i_k = keyed.begin(); i_k != keyed.end(); ++i_k) s << i_k->first << ";";
+				auto attrs = d.copy_attrs();
+				auto byte_size = attrs.find(DW_AT_byte_size);
+				if (byte_size != attrs.end()) s << "size " << byte_size->second;
+				return std::hash<string>()(s.str());
+			}
+
+			bool writable(const iterator_base& t) const
+			{
+				return dynamic_cast<arena_root_die *>(&m_target)
+					|| dynamic_cast<in_memory_abstract_die *>(&t.dereference());
+			}
+
+			/* copy_unwritable has made sure t is writable. */
+			void install(const iterator_base& t, Dwarf_Half attr, const attribute_value& v, bool replace)
+			{
+				arena_root_die *arena_root = dynamic_cast<arena_root_die *>(&m_target);
+				if (arena_root)
+				{
+					if (replace) arena_root->replace_attr(t, attr, v);
+					else arena_root->set_attr(t, attr, v);
+					return;
+				}
+				auto& m = dynamic_cast<in_memory_abstract_die&>(t.dereference()).attrs();
+				if (replace) m.erase(attr);
+				m.insert(make_pair(attr, v));
+			}
+
+			/* Whether merge_attributes would change p.target. A reference
+			 * to a DIE not yet added counts as a change. */
+			bool needs_write(const matched& p)
+			{
+				auto o_attrs = p.overlay.copy_attrs();
+				auto t_attrs = p.target.copy_attrs();
+				for (auto i_a = o_attrs.begin(); i_a != o_attrs.end(); ++i_a)
+				{
+					if (i_a->first == DW_AT_name || i_a->first == DW_AT_sibling) continue;
+					auto existing = t_attrs.find(i_a->first);
+					if (existing == t_attrs.end()) return true;
+					if (m_override && !same_value(p.overlay, i_a->first, i_a->second,
+						existing->second, p.target, 0)) return true;
+				}
+				return false;
+			}
+
+			static iterator_base toplevel_of(const iterator_base& t)
+			{
+				iterator_base top = t;
+				for (iterator_base parent = top.parent();
+					parent && parent.offset_here() != 0 && parent.tag_here() != DW_TAG_compile_unit;
+					parent = parent.parent()) top = parent;
+				return top;
+			}
+
+			/* Make an in-memory DIE like t under parent, and likewise its
+			 * children, noting each in copies; attributes come later. */
+			iterator_base copy_tree(const iterator_base& t, const iterator_base& parent,
+				std::unordered_map<Dwarf_Off, iterator_base>& copies)
+			{
+				iterator_base c = m_target.make_new(parent, t.tag_here());
+				copies[t.offset_here()] = c;
+				++m_report.dies_copied;
+				auto children = t.children_here();
+				for (auto i = children.first; i != children.second; ++i) copy_tree(i, c, copies);
+				return c;
+			}
+
+			/* Before anything is changed, copy into memory each top-level
+			 * DIE within which we would write to a DIE that isn't, and
+			 * merge into the copy instead. */
+			void copy_unwritable()
+			{
+				vector<iterator_base> tops;
+				std::unordered_set<Dwarf_Off> seen;
+				auto need = [&](const iterator_base& t) {
+					if (writable(t)) return;
+					iterator_base top = toplevel_of(t);
+					if (seen.insert(top.offset_here()).second) tops.push_back(top);
+				};
+				for (auto i_m = m_matched.begin(); i_m != m_matched.end(); ++i_m)
+				{
+					if (needs_write(*i_m)) need(i_m->target);
+				}
+				for (auto i_a = m_additions.begin(); i_a != m_additions.end(); ++i_a)
+				{
+					if (i_a->parent) need(i_a->parent);
+				}
+				if (tops.empty()) return;
+
+				std::unordered_map<Dwarf_Off, iterator_base> copies;
+				for (auto i_t = tops.begin(); i_t != tops.end(); ++i_t)
+				{
+					copy_tree(*i_t, m_index.additions_cu(), copies);
+				}
+				/* References within what was copied go to the copies. */
+				for (auto i_c = copies.begin(); i_c != copies.end(); ++i_c)
+				{
+					auto attrs = m_target.find(i_c->first).copy_attrs();
+					auto& m = dynamic_cast<in_memory_abstract_die&>(i_c->second.dereference()).attrs();
+					for (auto i_a = attrs.begin(); i_a != attrs.end(); ++i_a)
+					{
+						if (i_a->first == DW_AT_sibling) continue;
+						auto copied = (i_a->second.get_form() == attribute_value::REF)
+							? copies.find(i_a->second.get_ref().off) : copies.end();
+						if (copied == copies.end()) { m.insert(*i_a); continue; }
+						m.insert(make_pair(i_a->first, attribute_value(attribute_value::weak_ref(m_target,
+							copied->second.offset_here(), true, i_c->second.offset_here(), i_a->first))));
+					}
+				}
+				for (auto i_t = tops.begin(); i_t != tops.end(); ++i_t)
+				{
+					m_index.replaced(*i_t, copies[i_t->offset_here()]);
+				}
+				auto moved = [&copies](iterator_base& t) {
+					if (!t) return;
+					auto found = copies.find(t.offset_here());
+					if (found != copies.end()) t = found->second;
+				};
+				for (auto i_m = m_matched.begin(); i_m != m_matched.end(); ++i_m) moved(i_m->target);
+				for (auto i_a = m_additions.begin(); i_a != m_additions.end(); ++i_a) moved(i_a->parent);
+				for (auto i_m = m_mapped.begin(); i_m != m_mapped.end(); ++i_m) moved(i_m->second);
+			}
+
+			iterator_base resolve_pending(const iterator_base& o, Dwarf_Half attr, const iterator_base& t)
+			{
+				auto found = m_pending.find(make_pair(o.offset_here(), attr));
+				if (found == m_pending.end()) return iterator_base::END;
+				return m_index.resolution().resolve(t, found->second);
+			}
+
+			bool same_die(const iterator_base& o, const iterator_base& t, unsigned depth)
+			{
+				if (!o || !t || o.tag_here() != t.tag_here() || o.name_here() != t.name_here()) return false;
+				auto o_attrs = o.copy_attrs();
+				auto t_attrs = t.copy_attrs();
+				for (auto i_a = o_attrs.begin(); i_a != o_attrs.end(); ++i_a)
+				{
+					auto found = t_attrs.find(i_a->first);
+					if (found == t_attrs.end()
+						|| !same_value(o, i_a->first, i_a->second, found->second, t, depth)) return false;
+				}
+				auto o_children = o.children_here();
+				auto t_children = t.children_here();
+				auto i_t = t_children.first;
+				for (auto i_o = o_children.first; i_o != o_children.second; ++i_o, ++i_t)
+				{
+					if (i_t == t_children.second || !same_die(i_o, i_t, depth)) return false;
+				}
+				return i_t == t_children.second;
+			}
+
+			bool same_value(const iterator_base& o, Dwarf_Half attr, const attribute_value& ov,
+				const attribute_value& tv, const iterator_base& t, unsigned depth)
+			{
+				if (ov.get_form() != attribute_value::REF)
+				{
+					ostringstream os, ts;
+					os << ov; ts << tv;
+					return os.str() == ts.str();
+				}
+				if (tv.get_form() != attribute_value::REF) return false;
+				Dwarf_Off o_off = ov.get_ref().off;
+				Dwarf_Off t_off = tv.get_ref().off;
+				if (o_off == arena_root_die::pending_ref)
+				{
+					iterator_base found = resolve_pending(o, attr, t);
+					return found && found.offset_here() == t_off;
+				}
+				auto mapped = m_mapped.find(o_off);
+				if (mapped != m_mapped.end()) return mapped->second.offset_here() == t_off;
+				/* An inline DIE: alike if what the target has is alike. */
+				return depth < 8 && same_die(m_overlay.find(o_off), m_target.find(t_off), depth + 1);
+			}
+
+			/* What the overlay's value means in the target, making any
+			 * inline DIE it needs; false if it can't be had. */
+			bool target_value(const matched& p, Dwarf_Half attr, const attribute_value& ov,
+				attribute_value& out)
+			{
+				if (ov.get_form() != attribute_value::REF) { out = ov; return true; }
+				Dwarf_Off o_off = ov.get_ref().off;
+				iterator_base referee;
+				if (o_off == arena_root_die::pending_ref)
+				{
+					referee = resolve_pending(p.overlay, attr, p.target);
+					if (!referee)
+					{
+						auto found = m_pending.find(make_pair(p.overlay.offset_here(), attr));
+						conflict(p.where, attr, "could not resolve "
+							+ (found == m_pending.end() ? string("reference") : found->second),
+							p.target, false);
+						return false;
+					}
+				}
+				else
+				{
+					auto mapped = m_mapped.find(o_off);
+					iterator_base o_referee = m_overlay.find(o_off);
+					if (mapped != m_mapped.end()) referee = mapped->second;
+					else if (!o_referee.name_here()) referee = add(o_referee, m_index.additions_cu(), "");
+					else
+					{
+						/* A named DIE we didn't merge; use the target's own. */
+						referee = m_index.resolution().resolve(p.target, *o_referee.name_here());
+						if (!referee)
+						{
+							conflict(p.where, attr, "refers to unmerged " + *o_referee.name_here(),
+								p.target, false);
+							return false;
+						}
+					}
+				}
+				out = attribute_value(attribute_value::weak_ref(m_target, referee.offset_here(), true,
+					p.target.offset_here(), attr));
+				return true;
+			}
+
+		public:
+			merger(merge_index& index, arena_root_die& overlay, const vector<deferred_ref>& deferred,
+				bool override_existing, merge_report& report)
+			 : m_index(index), m_target(index.root()), m_overlay(overlay),
+			   m_override(override_existing), m_report(report)
+			{
+				for (auto i_d = deferred.begin(); i_d != deferred.end(); ++i_d)
+				{
+					m_pending[make_pair(i_d->die, i_d->attr)] = i_d->ident;
+				}
+				for (auto i = overlay.begin(); i != overlay.end(); ++i)
+				{
+					auto attrs = i.copy_attrs();
+					for (auto i_a = attrs.begin(); i_a != attrs.end(); ++i_a)
+					{
+						if (i_a->second.get_form() == attribute_value::REF
+							&& i_a->second.get_ref().off != arena_root_die::pending_ref)
+						{
+							m_referenced.insert(i_a->second.get_ref().off);
+						}
+					}
+				}
+			}
+
+			/* Make o and its children afresh under parent. */
+			iterator_base add(const iterator_base& o, const iterator_base& parent, const string& where_parent)
+			{
+				iterator_base t = m_target.make_new(parent, o.tag_here());
+				if (o.name_here()) install(t, DW_AT_name, attribute_value(*o.name_here()), false);
+				m_index.added(t);
+				m_mapped[o.offset_here()] = t;
+				++m_report.dies_added;
+				matched p = { o, t, describe(o, where_parent) };
+				m_matched.push_back(p);
+				auto children = o.children_here();
+				for (auto i = children.first; i != children.second; ++i) add(i, t, p.where);
+				return t;
+			}
+
+			void match(const iterator_base& o, const vector<iterator_base>& candidates,
+				const iterator_base& parent, const string& where_parent)
+			{
+				string where = describe(o, where_parent);
+				if (candidates.empty())
+				{
+					addition a = { o, parent, where_parent };
+					m_additions.push_back(a);
+					return;
+				}
+				if (candidates.size() > 1)
+				{
+					size_t h = structure_hash(candidates.front());
+					for (auto i_c = candidates.begin() + 1; i_c != candidates.end(); ++i_c)
+					{
+						if (structure_hash(*i_c) != h)
+						{
+							ostringstream s;
+							s << candidates.size() << " definitions differ; not merged";
+							conflict(where, 0, s.str(), iterator_base::END, false);
+							return;
+						}
+					}
+				}
+				m_mapped[o.offset_here()] = candidates.front();
+				for (auto i_c = candidates.begin(); i_c != candidates.end(); ++i_c)
+				{
+					++m_report.dies_matched;
+					matched p = { o, *i_c, where };
+					m_matched.push_back(p);
+					auto keyed = keyed_children(o);
+					for (auto i_k = keyed.begin(); i_k != keyed.end(); ++i_k)
+					{
+						if (is_inline(i_k->second)) continue;
+						match(i_k->second, m_index.children(*i_c, i_k->first), *i_c, where);
+					}
+				}
+			}
+
+			void match_toplevel(const iterator_base& cu)
+			{
+				auto children = cu.children_here();
+				for (auto i = children.first; i != children.second; ++i)
+				{
+					if (i.tag_here() == DW_TAG_compile_unit) { match_toplevel(i); continue; }
+					/* Unnamed ones are only made if something needs them. */
+					if (!i.name_here()) continue;
+					match(i, m_index.toplevel(merge_index::key(i.tag_here(), *i.name_here())),
+						iterator_base::END, "");
+				}
+			}
+
+			void add_unmatched()
+			{
+				for (auto i_a = m_additions.begin(); i_a != m_additions.end(); ++i_a)
+				{
+					add(i_a->overlay, i_a->parent ? i_a->parent : m_index.additions_cu(), i_a->where_parent);
+				}
+			}
+
+			void merge_attributes()
+			{
+				/* Indexed, because making inline DIEs appends. */
+				for (size_t n = 0; n < m_matched.size(); ++n)
+				{
+					matched p = m_matched[n];
+					auto o_attrs = p.overlay.copy_attrs();
+					auto t_attrs = p.target.copy_attrs();
+					for (auto i_a = o_attrs.begin(); i_a != o_attrs.end(); ++i_a)
+					{
+						Dwarf_Half attr = i_a->first;
+						if (attr == DW_AT_name || attr == DW_AT_sibling) continue;
+						auto existing = t_attrs.find(attr);
+						if (existing != t_attrs.end()
+							&& same_value(p.overlay, attr, i_a->second, existing->second, p.target, 0)) continue;
+						attribute_value v = i_a->second;
+						if (!target_value(p, attr, i_a->second, v)) continue;
+						if (existing == t_attrs.end())
+						{
+							install(p.target, attr, v, false);
+							++m_report.attrs_added;
+							continue;
+						}
+						ostringstream s;
+						s << "has " << existing->second << ", overlay has " << v;
+						conflict(p.where, attr, s.str(), p.target, m_override);
+						if (m_override)
+						{
+							install(p.target, attr, v, true);
+							++m_report.attrs_overridden;
+						}
+					}
+				}
+			}
+		};
+	}
+
+	merge_report merge_dwarfidl(merge_index& index, const string& overlay, bool override_existing /* = true */)
+	{
+		root_die& target = index.root();
+		if (!dynamic_cast<arena_root_die *>(&target) && !dynamic_cast<in_memory_root_die *>(&target))
+		{
+			throw std::invalid_argument("can only merge into an in-memory or arena root");
+		}
+		/* Names the overlay doesn't define are left for the target. */
+		arena_root_die scratch;
+		iterator_base scratch_cu = scratch.make_new(scratch.begin(), DW_TAG_compile_unit);
+		vector<deferred_ref> deferred;
+		creation_state state;
+		state.deferred = &deferred;
+		create_dies(scratch_cu, overlay, state);
+
+		merge_report report;
+		merger m(index, scratch, deferred, override_existing, report);
+		m.match_toplevel(scratch_cu);
+		m.copy_unwritable();
+		m.add_unmatched();
+		m.merge_attributes();
+		return report;
+	}
+
+	merge_report merge_dwarfidl(root_die& target, const string& overlay, bool override_existing /* = true */)
+	{
+		merge_index index(target);
+		return merge_dwarfidl(index, overlay, override_existing);
+	}
+}
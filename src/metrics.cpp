@@ -0,0 +1,114 @@
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include "dwarfidl/metrics.hpp"
+
+namespace dwarfidl
+{
+namespace metrics
+{
+	namespace detail
+	{
+		std::atomic<uint64_t> phase_calls[NPHASES];
+		std::atomic<uint64_t> phase_nanoseconds[NPHASES];
+		std::atomic<uint64_t> counters[NCOUNTERS];
+		thread_local unsigned phase_depth[NPHASES];
+	}
+
+	const char *phase_name(phase p)
+	{
+		switch (p)
+		{
+			case PARSE:  return "parse";
+			case CREATE: return "create";
+			case GATHER: return "gather";
+			case CLOSE:  return "close";
+			case ORDER:  return "order";
+			case PRINT:  return "print";
+			default: return "unknown";
+		}
+	}
+
+	const char *counter_name(counter c)
+	{
+		switch (c)
+		{
+			case DIES_VISITED:               return "dies_visited";
+			case SCOPED_RESOLVE_CALLS:       return "scoped_resolve_calls";
+			case POSTPONED_PASSES:           return "postponed_passes";
+			case FRAGMENTS_GENERATED:        return "fragments_generated";
+			case CONSTRAINT_SCAN_ITERATIONS: return "constraint_scan_iterations";
+			case BYTES_EMITTED:              return "bytes_emitted";
+			case INLINE_DIES_SHARED:         return "inline_dies_shared";
+			case SNIPPET_CACHE_HITS:         return "snippet_cache_hits";
+			default: return "unknown";
+		}
+	}
+
+	snapshot get()
+	{
+		snapshot snap;
+		for (unsigned i = 0; i < NPHASES; ++i)
+		{
+			snap.phase_calls[i] = detail::phase_calls[i].load(std::memory_order_relaxed);
+			snap.phase_nanoseconds[i] = detail::phase_nanoseconds[i].load(std::memory_order_relaxed);
+		}
+		for (unsigned i = 0; i < NCOUNTERS; ++i)
+		{
+			snap.counters[i] = detail::counters[i].load(std::memory_order_relaxed);
+		}
+		return snap;
+	}
+
+	void reset()
+	{
+		for (unsigned i = 0; i < NPHASES; ++i)
+		{
+			detail::phase_calls[i] = 0;
+			detail::phase_nanoseconds[i] = 0;
+		}
+		for (unsigned i = 0; i < NCOUNTERS; ++i) detail::counters[i] = 0;
+	}
+
+	void dump_json(std::ostream& s, const snapshot& snap)
+	{
+		s << "{\"phases\": {";
+		for (unsigned i = 0; i < NPHASES; ++i)
+		{
+			s << (i == 0 ? "" : ", ") << "\"" << phase_name(static_cast<phase>(i)) << "\": "
+				<< "{\"calls\": " << snap.phase_calls[i]
+				<< ", \"nanoseconds\": " << snap.phase_nanoseconds[i] << "}";
+		}
+		s << "}, \"counters\": {";
+		for (unsigned i = 0; i < NCOUNTERS; ++i)
+		{
+			s << (i == 0 ? "" : ", ") << "\"" << counter_name(static_cast<counter>(i)) << "\": "
+				<< snap.counters[i];
+		}
+		s << "}}" << std::endl;
+	}
+
+	void dump_json(std::ostream& s)
+	{
+		dump_json(s, get());
+	}
+
+	/* The environment is read once, when the library is loaded. */
+	static const char *dump_path;
+	static void dump_at_exit()
+	{
+		if (0 == strcmp(dump_path, "-")) { dump_json(std::cerr); return; }
+		std::ofstream f(dump_path);
+		if (f) dump_json(f);
+		else std::cerr << "dwarfidl: could not open " << dump_path << " to write metrics" << std::endl;
+	}
+	static struct init
+	{
+		init()
+		{
+			dump_path = getenv("DWARFIDL_METRICS");
+			if (dump_path && *dump_path) atexit(dump_at_exit);
+		}
+	} the_init;
+}
+}
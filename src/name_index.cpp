@@ -0,0 +1,42 @@
+#include "dwarfidl/name_index.hpp"
+
+using namespace dwarf;
+using namespace dwarf::core;
+
+namespace dwarfidl
+{
+	toplevel_name_index::toplevel_name_index(root_die& r)
+	{
+		auto cus = r.begin().children_here();
+		for (auto i_cu = cus.first; i_cu != cus.second; ++i_cu)
+		{
+			auto children = i_cu.children_here();
+			for (auto i = children.first; i != children.second; ++i) add(i);
+		}
+	}
+
+	void toplevel_name_index::add(const iterator_base& i)
+	{
+		if (!i.name_here()) return;
+		if (i.tag_here() == DW_TAG_subprogram || i.tag_here() == DW_TAG_variable)
+		{
+			auto external = i.as_a<program_element_die>()->get_external();
+			if (!external || !*external) return;
+		}
+		m_by_name[*i.name_here()].push_back(i);
+	}
+
+	iterator_base toplevel_name_index::find_visible_grandchild_named(const string& name) const
+	{
+		auto found = m_by_name.find(name);
+		return (found == m_by_name.end()) ? iterator_base::END : found->second.front();
+	}
+
+	const std::vector<iterator_base>&
+	toplevel_name_index::visible_grandchildren_named(const string& name) const
+	{
+		static const std::vector<iterator_base> none;
+		auto found = m_by_name.find(name);
+		return (found == m_by_name.end()) ? none : found->second;
+	}
+}
@@ -6,6 +6,7 @@
  */
 
 #include "print.hpp"
+#include "dwarfidl/keywords.hpp"
 #include <boost/algorithm/string.hpp>
 #include <boost/regex.hpp>
 
@@ -108,9 +109,10 @@ namespace tool {
 		
 		Dwarf_Off off = i_d.offset_here();
 		Dwarf_Half tag = i_d.tag_here();
+		const char *tag_keyword = dwarfidl::keyword_for_tag(tag);
 		
 		out << "@" << std::hex << off << ": "
-			<< string(i_d.spec_here().tag_lookup(tag)).substr(sizeof "DW_TAG_" - 1)
+			<< (tag_keyword ? tag_keyword : "(unknown tag)")
 			<< (i_d.name_here() ? " " + *i_d.name_here() : "")
 			<< " [";
 
@@ -118,8 +120,8 @@ namespace tool {
 		for (auto i_a = attrs.begin(); i_a != attrs.end(); ++i_a)
 		{
 			if (i_a != attrs.begin()) out << ", ";
-			Dwarf_Half attr = i_a->first;
-			out << string(i_d.spec_here().attr_lookup(attr)).substr(sizeof "DW_AT_" - 1);
+			const char *attr_keyword = dwarfidl::keyword_for_attr(i_a->first);
+			out << (attr_keyword ? attr_keyword : "(unknown attribute)");
 			out << " = " << i_a->second;
 		}
 		out << "] {";
@@ -307,5 +309,36 @@ namespace tool {
 
 	}
 
+	vector<string> 
+	local_name_parts_for(
+		iterator_df<> p_d,
+		bool use_friendly_names /* = true */)
+	{
+		if (p_d.name_here()) return vector<string>(1, *p_d.name_here());
+		if (p_d.tag_here() == DW_TAG_namespace) return vector<string>(1, "(anonymous namespace)");
+		if (use_friendly_names) return vector<string>(1, "(anonymous)");
+		ostringstream s;
+		s << "__anon_0x" << std::hex << p_d.offset_here();
+		return vector<string>(1, s.str());
+	}
+
+	vector<string> 
+	fq_name_parts_for(iterator_df<> p_d)
+	{
+		/* Local names of the DIE and its enclosing scopes, up to the CU. */
+		vector<vector<string> > scopes;
+		for (iterator_df<> i = p_d; i && i.offset_here() != 0 && i.tag_here() != DW_TAG_compile_unit;
+			i = i.parent())
+		{
+			scopes.push_back(local_name_parts_for(i));
+		}
+		vector<string> parts;
+		for (auto i_s = scopes.rbegin(); i_s != scopes.rend(); ++i_s)
+		{
+			parts.insert(parts.end(), i_s->begin(), i_s->end());
+		}
+		return parts;
+	}
+
 } // end namespace tool
 } // end namespace dwarf
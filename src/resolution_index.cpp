@@ -0,0 +1,75 @@
+#include "dwarfidl/resolution_index.hpp"
+#include "dwarfidl/arena_root.hpp"
+
+using namespace dwarf;
+using namespace dwarf::core;
+
+namespace dwarfidl
+{
+	resolution_index::resolution_index(arena_root_die& r) : m_root(r), m_arena(&r) {}
+
+	const char *resolution_index::key_for(const string& name) const
+	{
+		if (m_arena) return m_arena->strings().find(name);
+		auto found = m_names.find(name);
+		return found == m_names.end() ? nullptr : found->c_str();
+	}
+
+	const char *resolution_index::intern_name_of(const iterator_base& i)
+	{
+		if (m_arena) return m_arena->name_of(i.offset_here());
+		auto name = i.name_here();
+		return name ? m_names.insert(*name).first->c_str() : nullptr;
+	}
+
+	resolution_index::scope_names& resolution_index::children_of(const iterator_base& scope)
+	{
+		auto found = m_children.find(scope.offset_here());
+		if (found != m_children.end()) return found->second;
+
+		auto& names = m_children[scope.offset_here()];
+		auto children = scope.children_here();
+		for (auto i = children.first; i != children.second; ++i)
+		{
+			/* Keep the first, as scoped_resolve would find. */
+			const char *name = intern_name_of(i);
+			if (name) names.insert(std::make_pair(name, i));
+		}
+		return names;
+	}
+
+	iterator_base resolution_index::resolve(const iterator_base& context, const string& name)
+	{
+		const char *key = key_for(name);
+		/* Every name in an arena root is interned, so this one is in none. */
+		if (!key && m_arena) return iterator_base::END;
+		for (iterator_base scope = context; scope && scope.offset_here() != 0; scope = scope.parent())
+		{
+			auto& names = children_of(scope);
+			if (!key && !(key = key_for(name))) continue;
+			auto found = names.find(key);
+			if (found != names.end()) return found->second;
+		}
+		if (!m_visible) m_visible.reset(new toplevel_name_index(m_root));
+		return m_visible->find_visible_grandchild_named(name);
+	}
+
+	void resolution_index::add(const iterator_base& created)
+	{
+		const char *name = intern_name_of(created);
+		if (!name) return;
+		auto parent = created.parent();
+		auto found = m_children.find(parent.offset_here());
+		if (found != m_children.end())
+		{
+			found->second.insert(std::make_pair(name, created));
+		}
+		if (m_visible && parent.tag_here() == DW_TAG_compile_unit) m_visible->add(created);
+	}
+
+	void resolution_index::forget(const iterator_base& scope)
+	{
+		m_children.erase(scope.offset_here());
+		if (scope.offset_here() == 0 || scope.tag_here() == DW_TAG_compile_unit) m_visible.reset();
+	}
+}
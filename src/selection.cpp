@@ -0,0 +1,203 @@
+#include <stdexcept>
+#include <sstream>
+#include "dwarfidl/selection.hpp"
+#include "dwarfidl/keywords.hpp"
+#include "dwarfidl/print.hpp"
+#include "dwarfidl/dwarf_interface_walk.hpp"
+
+using namespace dwarf;
+using namespace dwarf::core;
+using std::ostringstream;
+
+namespace dwarfidl
+{
+	selection::selection(bool empty_matches_all)
+	 : m_tags({ DW_TAG_subprogram }), m_default_tags(true), m_exported_only(true),
+	   m_empty_matches_all(empty_matches_all)
+	{}
+
+	static bool has_prefix(const string& s, const string& prefix, string *rest)
+	{
+		if (s.compare(0, prefix.length(), prefix) != 0) return false;
+		*rest = s.substr(prefix.length());
+		return true;
+	}
+
+	/* Does the regex refer to its own groups, by backreference (\1, \g1,
+	 * \k<name>, (?P=name)) or by recursion ((?1), (?R), (?&name))? */
+	static bool refers_to_groups(const string& re)
+	{
+		for (size_t i = 0; i + 1 < re.size(); ++i)
+		{
+			char next = re[i + 1];
+			if (re[i] == '\\')
+			{
+				if ((next >= '1' && next <= '9') || next == 'g' || next == 'k') return true;
+				++i;
+			}
+			else if (re[i] == '(' && next == '?' && i + 2 < re.size())
+			{
+				char c = re[i + 2];
+				if ((c >= '0' && c <= '9') || c == 'R' || c == '&') return true;
+				/* (?-1) is relative recursion, but (?-i) turns off a flag. */
+				if ((c == '+' || c == '-') && i + 3 < re.size() && re[i + 3] >= '0' && re[i + 3] <= '9') return true;
+				if (c == 'P' && i + 3 < re.size() && (re[i + 3] == '=' || re[i + 3] == '>')) return true;
+			}
+		}
+		return false;
+	}
+
+	void selection::name_rules::add_pattern(const string& re, const string& rule)
+	{
+		boost::regex compiled;
+		try { compiled = boost::regex(re, boost::regex::perl); }
+		catch (boost::regex_error& e)
+		{
+			throw std::invalid_argument("bad pattern " + rule + ": " + e.what());
+		}
+		if (refers_to_groups(re)) separate.push_back(compiled);
+		else
+		{
+			patterns.push_back(re);
+			combined_stale = true;
+		}
+	}
+
+	void selection::add(const string& rule)
+	{
+		string rest;
+		name_rules& rules = (rule.find("::") != string::npos) ? m_qualified : m_plain;
+		if (has_prefix(rule, "glob:", &rest)) rules.add_pattern(glob_to_regex(rest), rule);
+		else if (has_prefix(rule, "re:", &rest)) rules.add_pattern(rest, rule);
+		else if (has_prefix(rule, "tag:", &rest))
+		{
+			Dwarf_Half tag = tag_for_keyword(rest.c_str());
+			if (tag == 0) throw std::invalid_argument("unknown tag " + rest);
+			/* The first tag rule replaces the default. */
+			if (m_default_tags) m_tags.clear();
+			m_default_tags = false;
+			m_tags.insert(tag);
+		}
+		else if (has_prefix(rule, "visibility:", &rest))
+		{
+			if (rest == "exported") m_exported_only = true;
+			else if (rest == "any") m_exported_only = false;
+			else throw std::invalid_argument("unknown visibility " + rest);
+		}
+		else rules.names.insert(rule);
+	}
+
+	void selection::read(std::istream& in)
+	{
+		string line;
+		while (std::getline(in, line))
+		{
+			if (line.empty() || line[0] == '#') continue;
+			add(line);
+		}
+	}
+
+	bool selection::name_rules::matches(const string& name) const
+	{
+		if (names.find(name) != names.end()) return true;
+		for (auto i_r = separate.begin(); i_r != separate.end(); ++i_r)
+		{
+			if (boost::regex_match(name, *i_r)) return true;
+		}
+		if (patterns.empty()) return false;
+		if (combined_stale)
+		{
+			ostringstream s;
+			for (auto i_p = patterns.begin(); i_p != patterns.end(); ++i_p)
+			{
+				s << (i_p == patterns.begin() ? "" : "|") << "(?:" << *i_p << ")";
+			}
+			combined = boost::regex(s.str(), boost::regex::perl | boost::regex::optimize);
+			combined_stale = false;
+		}
+		return boost::regex_match(name, combined);
+	}
+
+	bool selection::matches_name(const string& name) const
+	{
+		if (!has_name_rules()) return m_empty_matches_all;
+		return m_plain.matches(name);
+	}
+
+	bool selection::matches_qualified_name(const string& fq_name) const
+	{
+		if (!has_name_rules()) return m_empty_matches_all;
+		return m_qualified.matches(fq_name);
+	}
+
+	bool selection::matches_qualified_name(const std::vector<string>& fq_name_parts) const
+	{
+		if (!has_name_rules()) return m_empty_matches_all;
+		if (m_qualified.empty()) return false;
+		string name;
+		for (auto i_p = fq_name_parts.begin(); i_p != fq_name_parts.end(); ++i_p)
+		{
+			if (i_p != fq_name_parts.begin()) name += "::";
+			name += *i_p;
+		}
+		return m_qualified.matches(name);
+	}
+
+	bool selection::element_ok(const iterator_base& i) const
+	{
+		if (m_tags.find(i.tag_here()) == m_tags.end()) return false;
+		auto i_pe = i.as_a<program_element_die>();
+		if (!i_pe || !i_pe.name_here()) return false;
+		if (i_pe.is_a<variable_die>() && !i_pe.as_a<variable_die>()->has_static_storage()) return false;
+		return !(m_exported_only && i_pe->get_visibility()
+			&& *i_pe->get_visibility() != DW_VIS_exported);
+	}
+
+	bool selection::operator()(const iterator_base& i) const
+	{
+		if (!element_ok(i)) return false;
+		if (matches_name(*i.name_here())) return true;
+		if (!has_qualified_rules()) return false;
+		/* Only now is it worth finding the qualified name. */
+		if (m_scopes) return matches_qualified_name(m_scopes->fq_name_of(i));
+		return matches_qualified_name(dwarf::tool::fq_name_parts_for(i));
+	}
+
+	bool selection::operator()(const iterator_base& i, const std::vector<string>& fq_name_parts) const
+	{
+		if (!element_ok(i)) return false;
+		return matches_name(*i.name_here()) || matches_qualified_name(fq_name_parts);
+	}
+
+	string glob_to_regex(const string& glob)
+	{
+		string out;
+		bool in_class = false;
+		for (auto i = glob.begin(); i != glob.end(); ++i)
+		{
+			char c = *i;
+			if (in_class)
+			{
+				if (c == ']') in_class = false;
+				if (c == '\\') out += '\\';
+				out += c;
+				continue;
+			}
+			switch (c)
+			{
+				case '*': out += ".*"; break;
+				case '?': out += "."; break;
+				case '[':
+					in_class = true;
+					out += '[';
+					if (i + 1 != glob.end() && *(i + 1) == '!') { out += '^'; ++i; }
+					break;
+				case '.': case '+': case '(': case ')': case '{': case '}':
+				case '^': case '$': case '|': case '\\':
+					out += '\\'; out += c; break;
+				default: out += c; break;
+			}
+		}
+		return out;
+	}
+}
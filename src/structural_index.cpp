@@ -0,0 +1,91 @@
+#include <sstream>
+#include "dwarfidl/structural_index.hpp"
+
+using namespace dwarf;
+using namespace dwarf::core;
+using encap::attribute_value;
+using std::ostringstream;
+
+namespace dwarfidl
+{
+	static string cu_key(const iterator_base& cu, const string& key)
+	{
+		ostringstream s;
+		s << (cu ? cu.offset_here() : 0) << " " << key;
+		return s.str();
+	}
+
+	void structural_index::write_ref(std::ostream& s, Dwarf_Half attr, Dwarf_Off target)
+	{
+		s << attr << "=@" << target << ";";
+	}
+
+	void structural_index::write_attr(std::ostream& s, Dwarf_Half attr, const attribute_value& v)
+	{
+		switch (v.get_form())
+		{
+			/* Relative or not, create_dies's references hold the offset. */
+			case attribute_value::REF: write_ref(s, attr, v.get_ref().off); return;
+			case attribute_value::STRING: {
+				/* Length first, so no string can look like more of the key. */
+				const string& str = v.get_string();
+				s << attr << "=" << str.size() << "\"" << str << ";";
+			} return;
+			default: s << attr << "=" << v << ";"; return;
+		}
+	}
+
+	static void write_key(std::ostream& s, const iterator_base& i)
+	{
+		s << i.tag_here() << "[";
+		auto attrs = i.copy_attrs();
+		for (auto i_a = attrs.begin(); i_a != attrs.end(); ++i_a)
+		{
+			if (i_a->first == DW_AT_sibling) continue;
+			structural_index::write_attr(s, i_a->first, i_a->second);
+		}
+		s << "]{";
+		auto children = i.children_here();
+		for (auto i_c = children.first; i_c != children.second; ++i_c)
+		{
+			s << "(";
+			write_key(s, i_c);
+			s << ")";
+		}
+		s << "}";
+	}
+
+	string structural_index::key_of(const iterator_base& i)
+	{
+		ostringstream s;
+		write_key(s, i);
+		return s.str();
+	}
+
+	iterator_base structural_index::find(const iterator_base& cu, Dwarf_Half tag, const string& key)
+	{
+		if (cu && m_scanned.insert(std::make_pair(cu.offset_here(), tag)).second)
+		{
+			auto children = cu.children_here();
+			for (auto i = children.first; i != children.second; ++i)
+			{
+				/* The first of several identical DIEs is the one to share. */
+				if (i.tag_here() == tag) m_dies.insert(std::make_pair(cu_key(cu, key_of(i)), i));
+			}
+		}
+		auto found = m_dies.find(cu_key(cu, key));
+		return (found == m_dies.end()) ? m_root.end() : found->second;
+	}
+
+	void structural_index::add(const iterator_base& cu, const string& key, const iterator_base& created)
+	{
+		m_dies.insert(std::make_pair(cu_key(cu, key), created));
+	}
+
+	void structural_index::forget(const iterator_base& cu)
+	{
+		Dwarf_Off off = cu ? cu.offset_here() : 0;
+		m_scanned.erase(m_scanned.lower_bound(std::make_pair(off, Dwarf_Half(0))),
+			m_scanned.upper_bound(std::make_pair(off, Dwarf_Half(~0))));
+	}
+}
@@ -0,0 +1,172 @@
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include "dwarfidl/synthetic.hpp"
+#include "dwarfidl/create.hpp"
+
+using namespace dwarf;
+using namespace dwarf::core;
+using encap::attribute_value;
+using std::ostringstream;
+using std::vector;
+using std::max;
+using std::min;
+using std::make_pair;
+
+namespace dwarfidl
+{
+	namespace
+	{
+		struct scalar { const char *name; unsigned size; };
+		const scalar scalars[] = { { "int", 4 }, { "long\\ int", 8 }, { "char", 1 } };
+		const unsigned nscalars = sizeof scalars / sizeof scalars[0];
+
+		struct layout { unsigned size; unsigned align; };
+
+		unsigned align_up(unsigned off, unsigned align)
+		{ return (off + align - 1) / align * align; }
+
+		string location(unsigned off)
+		{
+			ostringstream s;
+			s << "[data_member_location = { plus_uconst(" << off << "); }]";
+			return s.str();
+		}
+
+		/* Pointer rings never straddle the shared/unshared boundary, so
+		 * that the shared structs come out the same in every CU. */
+		void ring_bounds(const synthetic_params& p, unsigned i, unsigned *lo, unsigned *hi)
+		{
+			unsigned shared = min(p.shared_structs, p.structs_per_cu);
+			unsigned base = (i < shared) ? 0 : shared;
+			unsigned end = (i < shared) ? shared : p.structs_per_cu;
+			*lo = base + (i - base) / p.pointer_cycle_length * p.pointer_cycle_length;
+			*hi = min(*lo + p.pointer_cycle_length, end);
+		}
+	}
+
+	string generate_synthetic_dwarfidl(const synthetic_params& p, unsigned cu_index)
+	{
+		const unsigned n = p.structs_per_cu;
+		const unsigned shared = min(p.shared_structs, n);
+		vector<string> names(n);
+		for (unsigned i = 0; i < n; ++i)
+		{
+			ostringstream s;
+			if (i < shared) s << "shared_s" << i;
+			else s << "cu" << cu_index << "_s" << i;
+			names[i] = s.str();
+		}
+		/* What other structs use to embed struct i: the end of its
+		 * typedef chain, if it has one. */
+		auto embed_name = [&p, &names](unsigned i) {
+			if (p.typedef_chain_length == 0) return names[i];
+			ostringstream s;
+			s << names[i] << "_t" << (p.typedef_chain_length - 1);
+			return s.str();
+		};
+
+		ostringstream s;
+		for (unsigned k = 0; k < nscalars; ++k)
+		{
+			s << "base_type " << scalars[k].name << " [byte_size = " << scalars[k].size
+				<< ", encoding = " << (k == 2 ? 6 /* signed char */ : 5 /* signed */) << "];" << std::endl;
+		}
+
+		/* Struct i points back to i - 1 within its ring, and the first in
+		 * the ring points forward to the last. That forward reference is the
+		 * only one, and it goes through a declaration made inline, so that
+		 * the declaration sits in the first struct's scope. At CU level the
+		 * last struct's name then finds only its definition, which is what
+		 * its typedefs, accessor and embedders should refer to. (A ring of
+		 * one is a struct pointing to itself, which resolves as the struct
+		 * is named before its members are created.) */
+		vector<layout> layouts(n);
+		for (unsigned i = 0; i < n; ++i)
+		{
+			ostringstream members;
+			unsigned off = 0;
+			unsigned align = 1;
+			auto place = [&off, &align](unsigned size, unsigned a) {
+				off = align_up(off, a);
+				unsigned placed = off;
+				off += size;
+				align = max(align, a);
+				return placed;
+			};
+			for (unsigned m = 0; m < p.width; ++m)
+			{
+				const scalar& sc = scalars[(i + m) % nscalars];
+				unsigned at = place(sc.size, sc.size);
+				members << "\tmember m" << m << " : " << sc.name << " " << location(at) << ";" << std::endl;
+			}
+			if (p.anonymous_union_every != 0 && i % p.anonymous_union_every == 0)
+			{
+				unsigned at = place(8, 8);
+				members << "\tmember u : (union_type [byte_size = 8] { "
+					<< "member x : int " << location(0) << "; "
+					<< "member y : long\\ int " << location(0) << "; }) "
+					<< location(at) << ";" << std::endl;
+			}
+			if (p.pointer_cycle_length != 0)
+			{
+				unsigned lo, hi;
+				ring_bounds(p, i, &lo, &hi);
+				unsigned target = (i == lo) ? hi - 1 : i - 1;
+				unsigned at = place(8, 8);
+				members << "\tmember next : (pointer_type [type = ";
+				if (target > i) members << "(structure_type " << names[target] << " [declaration = true])";
+				else members << names[target];
+				members << ", byte_size = 8]) " << location(at) << ";" << std::endl;
+			}
+			/* Levels give the nesting depth. We embed the previous struct. */
+			unsigned level = (p.depth == 0) ? 0 : i % (p.depth + 1);
+			if (level > 0)
+			{
+				unsigned inner = i - 1;
+				unsigned at = place(layouts[inner].size, layouts[inner].align);
+				members << "\tmember inner : " << embed_name(inner) << " "
+					<< location(at) << ";" << std::endl;
+			}
+			layouts[i].size = max(1u, align_up(off, align));
+			layouts[i].align = align;
+
+			s << "structure_type " << names[i] << " [byte_size = " << layouts[i].size << "] {"
+				<< std::endl << members.str() << "};" << std::endl;
+			for (unsigned t = 0; t < p.typedef_chain_length; ++t)
+			{
+				s << "typedef " << names[i] << "_t" << t << " : ";
+				if (t == 0) s << names[i]; else s << names[i] << "_t" << (t - 1);
+				s << ";" << std::endl;
+			}
+			if (p.functions)
+			{
+				s << "subprogram get_" << names[i] << " (p : (pointer_type [type = "
+					<< names[i] << ", byte_size = 8])) -> int [external = true];" << std::endl;
+			}
+		}
+		return s.str();
+	}
+
+	iterator_base create_synthetic_dies(in_memory_root_die& r, const synthetic_params& p)
+	{
+		iterator_base first_cu;
+		/* One index across all the CUs, as a repeated caller would keep. */
+		resolution_index index(r);
+		creation_state state;
+		state.index = &index;
+		for (unsigned c = 0; c < p.ncus; ++c)
+		{
+			auto cu = r.make_new(r.begin(), DW_TAG_compile_unit);
+			ostringstream name;
+			name << "synthetic_cu" << c;
+			auto& attrs = dynamic_cast<core::in_memory_abstract_die&>(cu.dereference()).attrs();
+			attrs.insert(make_pair(DW_AT_name, attribute_value(name.str())));
+			attrs.insert(make_pair(DW_AT_language,
+				attribute_value(static_cast<Dwarf_Unsigned>(DW_LANG_C99))));
+			create_dies(cu, generate_synthetic_dwarfidl(p, c), state);
+			if (!first_cu) first_cu = cu;
+		}
+		return first_cu;
+	}
+}
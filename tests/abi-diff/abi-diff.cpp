@@ -0,0 +1,117 @@
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include <dwarfpp/lib.hpp>
+#include <dwarfidl/create.hpp>
+#include <dwarfidl/dwarf_interface_walk.hpp>
+#include <dwarfidl/abi_diff.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::set;
+using namespace dwarf;
+using namespace dwarf::core;
+
+static const char old_text[] =
+	"base_type int [byte_size = 4, encoding = 5];\n"
+	"base_type long\\ int [byte_size = 8, encoding = 5];\n"
+	"structure_type point [byte_size = 8] {\n"
+	"	member x : int [data_member_location = { plus_uconst(0); }];\n"
+	"	member y : int [data_member_location = { plus_uconst(4); }];\n"
+	"};\n"
+	"structure_type unchanged [byte_size = 4] {\n"
+	"	member a : int [data_member_location = { plus_uconst(0); }];\n"
+	"};\n"
+	"subprogram move (p : (pointer_type [type = point, byte_size = 8]), dx : int) -> int [external = true];\n"
+	"subprogram same (u : (pointer_type [type = unchanged, byte_size = 8])) -> int [external = true];\n"
+	"subprogram going (x : int) -> int [external = true];\n";
+
+/* point grows a member in front, move's dx widens, going goes, coming comes. */
+static const char new_text[] =
+	"base_type int [byte_size = 4, encoding = 5];\n"
+	"base_type long\\ int [byte_size = 8, encoding = 5];\n"
+	"structure_type point [byte_size = 12] {\n"
+	"	member z : int [data_member_location = { plus_uconst(0); }];\n"
+	"	member x : int [data_member_location = { plus_uconst(4); }];\n"
+	"	member y : int [data_member_location = { plus_uconst(8); }];\n"
+	"};\n"
+	"structure_type unchanged [byte_size = 4] {\n"
+	"	member a : int [data_member_location = { plus_uconst(0); }];\n"
+	"};\n"
+	"subprogram move (p : (pointer_type [type = point, byte_size = 8]), dx : long\\ int) -> int [external = true];\n"
+	"subprogram same (u : (pointer_type [type = unchanged, byte_size = 8])) -> int [external = true];\n"
+	"subprogram coming (x : int) -> int [external = true];\n";
+
+static void gather(in_memory_root_die& r, const char *text, set<iterator_base>& dies)
+{
+	auto cu = r.make_new(r.begin(), DW_TAG_compile_unit);
+	dwarfidl::create_dies(cu, string(text));
+	type_set types;
+	dwarf::tool::gather_interface_dies(r, dies, types,
+		[](const iterator_base& i) {
+			return i.tag_here() == DW_TAG_subprogram || i.tag_here() == DW_TAG_structure_type;
+		});
+}
+
+static bool has(const std::vector<dwarfidl::abi_change>& changes, dwarfidl::abi_change::kind k,
+	const string& where)
+{
+	for (auto i_c = changes.begin(); i_c != changes.end(); ++i_c)
+	{
+		if (i_c->k == k && i_c->where == where) return true;
+	}
+	return false;
+}
+
+int main(int argc, char **argv)
+{
+	in_memory_root_die old_r, new_r;
+	set<iterator_base> old_dies, new_dies;
+	gather(old_r, old_text, old_dies);
+	gather(new_r, new_text, new_dies);
+
+	auto changes = dwarfidl::diff_interfaces(old_dies, new_dies);
+	for (auto i_c = changes.begin(); i_c != changes.end(); ++i_c) cout << *i_c << endl;
+	using dwarfidl::abi_change;
+	assert(has(changes, abi_change::SIZE_CHANGED, "struct point"));
+	assert(has(changes, abi_change::MEMBER_ADDED, "struct point.z"));
+	assert(has(changes, abi_change::MEMBER_MOVED, "struct point.x"));
+	assert(has(changes, abi_change::MEMBER_MOVED, "struct point.y"));
+	assert(has(changes, abi_change::SIGNATURE_CHANGED, "move(arg 2)"));
+	assert(has(changes, abi_change::REMOVED, "going"));
+	assert(has(changes, abi_change::ADDED, "coming"));
+	/* Unchanged things aren't looked into, let alone reported. */
+	for (auto i_c = changes.begin(); i_c != changes.end(); ++i_c)
+	{
+		assert(i_c->where.find("same") == string::npos && i_c->where.find("unchanged") == string::npos);
+	}
+
+	std::ostringstream patch;
+	dwarfidl::write_dwarfidl_patch(patch, changes);
+	cout << patch.str();
+	assert(patch.str().find("// removed: going") != string::npos);
+
+	/* With only the functions in the slice, point's changes come under
+	 * move, and the patch still has point's new definition. */
+	set<iterator_base> old_fns, new_fns;
+	for (auto i = old_dies.begin(); i != old_dies.end(); ++i)
+	{
+		if (i->tag_here() == DW_TAG_subprogram) old_fns.insert(*i);
+	}
+	for (auto i = new_dies.begin(); i != new_dies.end(); ++i)
+	{
+		if (i->tag_here() == DW_TAG_subprogram) new_fns.insert(*i);
+	}
+	auto fn_changes = dwarfidl::diff_interfaces(old_fns, new_fns);
+	assert(has(fn_changes, abi_change::SIZE_CHANGED, "move(arg 1)*"));
+	std::ostringstream fn_patch;
+	dwarfidl::write_dwarfidl_patch(fn_patch, fn_changes);
+	cout << fn_patch.str();
+	assert(fn_patch.str().find("structure_type point") != string::npos);
+	assert(fn_patch.str().find("member z") != string::npos);
+
+	/* Nothing changes against itself. */
+	assert(dwarfidl::diff_interfaces(new_dies, new_dies).empty());
+	return 0;
+}
@@ -0,0 +1,263 @@
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include <map>
+#include <dwarfpp/lib.hpp>
+#include <dwarfidl/arena_root.hpp>
+#include <dwarfidl/create.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using namespace dwarf;
+using namespace dwarf::core;
+using encap::attribute_value;
+using encap::loc_expr;
+using dwarfidl::arena_root_die;
+
+static iterator_base child_named(const iterator_base& scope, const string& name)
+{
+	auto children = scope.children_here();
+	for (auto i = children.first; i != children.second; ++i)
+	{
+		if (i.name_here() && *i.name_here() == name) return i;
+	}
+	return iterator_base::END;
+}
+
+static Dwarf_Off ref_of(const iterator_base& i, Dwarf_Half attr)
+{
+	auto attrs = i.copy_attrs();
+	auto found = attrs.find(attr);
+	assert(found != attrs.end() && found->second.get_form() == attribute_value::REF);
+	return found->second.get_ref().off;
+}
+
+static const char text[] =
+	"base_type int [byte_size = 4, encoding = 5];\n"
+	"structure_type point [byte_size = 8] {\n"
+	"	member x : int [data_member_location = { plus_uconst(0); }];\n"
+	"	member y : int [data_member_location = { plus_uconst(4); }];\n"
+	"};\n"
+	"subprogram f (p : (pointer_type [byte_size = 8, type = point])) -> int;\n";
+
+static void navigation()
+{
+	arena_root_die r;
+	auto cu = r.make_new(r.begin(), DW_TAG_compile_unit);
+	dwarfidl::create_dies(cu, string(text));
+	/* Offsets count from 1 in the order DIEs were made. */
+	assert(cu.offset_here() == 1 && cu.depth() == 1);
+	assert(r.find(1) == cu && !r.find(r.ndies() + 1));
+	for (Dwarf_Off off = 1; off <= r.ndies(); ++off)
+	{
+		auto i = r.find(off);
+		assert(i && i.offset_here() == off);
+		assert(i.enclosing_cu() == cu);
+	}
+	auto top = r.begin().children_here();
+	assert(top.first == cu);
+	++top.first;
+	assert(top.first == top.second);
+
+	auto point = child_named(cu, "point");
+	auto x = child_named(point, "x"), y = child_named(point, "y");
+	assert(point && x && y);
+	assert(x.parent() == point && point.parent() == cu && cu.parent() == r.begin());
+	assert(x.depth() == point.depth() + 1);
+	auto members = point.children_here();
+	assert(members.first == x);
+	++members.first;
+	assert(members.first == y);
+	++members.first;
+	assert(members.first == members.second);
+	/* Preorder visits every DIE once. */
+	unsigned n = 0;
+	for (iterator_df<> i = r.begin(); i; ++i) ++n;
+	assert(n == r.ndies() + 1);
+
+	auto f = child_named(cu, "f");
+	auto p = child_named(f, "p");
+	assert(f && p);
+	auto ptr = r.find(ref_of(p, DW_AT_type));
+	assert(ptr.tag_here() == DW_TAG_pointer_type);
+	assert(ref_of(ptr, DW_AT_type) == point.offset_here());
+	assert(r.resolution().resolve(f, "point") == point);
+	assert(r.resolution().resolve(p, "int") == child_named(cu, "int"));
+	assert(!r.resolution().resolve(f, "nonesuch"));
+	assert(r.name_of(point.offset_here()) == r.strings().find("point"));
+}
+
+static void round_trips()
+{
+	arena_root_die r;
+	auto cu = r.make_new(r.begin(), DW_TAG_compile_unit);
+	auto t = r.make_new(cu, DW_TAG_base_type);
+	auto v = r.make_new(cu, DW_TAG_variable);
+	r.set_attr(v, DW_AT_name, attribute_value(string("v")));
+	r.set_attr(v, DW_AT_external, attribute_value(static_cast<Dwarf_Bool>(1)));
+	r.set_attr(v, DW_AT_decl_line, attribute_value(static_cast<Dwarf_Unsigned>(42)));
+	r.set_attr(v, DW_AT_const_value, attribute_value(static_cast<Dwarf_Signed>(-7)));
+	r.set_attr(v, DW_AT_low_pc, attribute_value(attribute_value::address{0x401000}));
+	r.set_attr(v, DW_AT_type, attribute_value(attribute_value::weak_ref(r, t.offset_here(), true,
+		v.offset_here(), DW_AT_type)));
+	r.set_attr(v, DW_AT_sibling, attribute_value(attribute_value::weak_ref(r, t.offset_here(), false,
+		v.offset_here(), DW_AT_sibling)));
+	encap::loclist ll;
+	loc_expr e1, e2;
+	e1.lopc = 0x10; e1.hipc = 0x20;
+	Dwarf_Loc op;
+	op.lr_atom = DW_OP_fbreg; op.lr_number = 16; op.lr_number2 = 0; op.lr_offset = 0;
+	e1.push_back(op);
+	e2.lopc = 0x20; e2.hipc = 0x30;
+	op.lr_atom = DW_OP_breg7; op.lr_number = 8; op.lr_number2 = 3; op.lr_offset = 1;
+	e2.push_back(op);
+	op.lr_atom = DW_OP_deref; op.lr_number = 0; op.lr_number2 = 0; op.lr_offset = 2;
+	e2.push_back(op);
+	ll.push_back(e1);
+	ll.push_back(e2);
+	r.set_attr(v, DW_AT_location, attribute_value(ll));
+
+	assert(v.name_here() && *v.name_here() == "v");
+	auto attrs = v.copy_attrs();
+	assert(attrs.find(DW_AT_name)->second.get_string() == "v");
+	assert(attrs.find(DW_AT_external)->second.get_flag());
+	assert(attrs.find(DW_AT_decl_line)->second.get_unsigned() == 42);
+	assert(attrs.find(DW_AT_const_value)->second.get_signed() == -7);
+	assert(attrs.find(DW_AT_low_pc)->second.get_address().addr == 0x401000);
+	auto type_ref = attrs.find(DW_AT_type)->second.get_ref();
+	assert(type_ref.off == t.offset_here() && type_ref.abs);
+	auto sibling_ref = attrs.find(DW_AT_sibling)->second.get_ref();
+	assert(sibling_ref.off == t.offset_here() && !sibling_ref.abs);
+	auto got = attrs.find(DW_AT_location)->second.get_loclist();
+	assert(got.size() == 2);
+	assert(got[0].lopc == 0x10 && got[0].hipc == 0x20 && got[0].size() == 1);
+	assert(got[0][0].lr_atom == DW_OP_fbreg && got[0][0].lr_number == 16);
+	assert(got[1].lopc == 0x20 && got[1].hipc == 0x30 && got[1].size() == 2);
+	assert(got[1][0].lr_atom == DW_OP_breg7 && got[1][0].lr_number == 8
+		&& got[1][0].lr_number2 == 3 && got[1][0].lr_offset == 1);
+	assert(got[1][1].lr_atom == DW_OP_deref && got[1][1].lr_offset == 2);
+	/* Strings are interned. */
+	auto w = r.make_new(cu, DW_TAG_variable);
+	r.set_attr(w, DW_AT_name, attribute_value(string("v")));
+	assert(r.node(*r.index_of_offset(w.offset_here())).name == r.node(*r.index_of_offset(v.offset_here())).name);
+
+	/* replace_attr overwrites, where set_attr leaves alone. */
+	r.set_attr(v, DW_AT_decl_line, attribute_value(static_cast<Dwarf_Unsigned>(1)));
+	assert(v.copy_attrs().find(DW_AT_decl_line)->second.get_unsigned() == 42);
+	r.replace_attr(v, DW_AT_decl_line, attribute_value(static_cast<Dwarf_Unsigned>(43)));
+	assert(v.copy_attrs().find(DW_AT_decl_line)->second.get_unsigned() == 43);
+	r.replace_attr(v, DW_AT_name, attribute_value(string("renamed")));
+	assert(*v.name_here() == "renamed");
+	r.replace_attr(v, DW_AT_decl_file, attribute_value(static_cast<Dwarf_Unsigned>(2)));
+	assert(v.copy_attrs().find(DW_AT_decl_file)->second.get_unsigned() == 2);
+	/* Others are as they were. */
+	assert(v.copy_attrs().size() == attrs.size() + 1);
+	assert(v.copy_attrs().find(DW_AT_location)->second.get_loclist().size() == 2);
+	r.set_ref(v, DW_AT_type, w.offset_here());
+	assert(ref_of(v, DW_AT_type) == w.offset_here());
+}
+
+static void adoption()
+{
+	arena_root_die r;
+	auto cu = r.make_new(r.begin(), DW_TAG_compile_unit);
+	dwarfidl::create_dies(cu, string("base_type int [byte_size = 4, encoding = 5];\n"));
+	Dwarf_Off before = r.ndies();
+
+	arena_root_die staging;
+	auto staging_cu = staging.make_new(staging.begin(), DW_TAG_compile_unit);
+	/* An absolute offset is one in the root the DIEs end up in, here
+	 * that of int. */
+	Dwarf_Off int_off = child_named(cu, "int").offset_here();
+	std::ostringstream staged;
+	staged << "structure_type node [byte_size = 8] {\n"
+		"	member next : (pointer_type [byte_size = 8, type = node]);\n"
+		"};\n"
+		"variable count [type = @" << int_off << "];\n";
+	dwarfidl::create_dies(staging_cu, staged.str());
+	auto staging_node = child_named(staging_cu, "node");
+	Dwarf_Off node_off = staging_node.offset_here();
+	Dwarf_Off staging_ndies = staging.ndies();
+
+	Dwarf_Off base = r.adopt(staging, staging_cu, cu);
+	assert(base == before);
+	/* The staging CU isn't carried over, so node moves up one less. */
+	assert(r.ndies() == before + staging_ndies - 1);
+	auto node = child_named(cu, "node");
+	assert(node && node.offset_here() == node_off + base - 1);
+	assert(node.offset_here() == arena_root_die::adopted_offset(node_off, base, staging_cu.offset_here()));
+	assert(node.parent() == cu && node.depth() == cu.depth() + 1);
+	/* References within what was adopted are renumbered with it. */
+	auto next = child_named(node, "next");
+	assert(next);
+	auto ptr = r.find(ref_of(next, DW_AT_type));
+	assert(ptr && ptr.tag_here() == DW_TAG_pointer_type && ptr.enclosing_cu() == cu);
+	assert(ref_of(ptr, DW_AT_type) == node.offset_here());
+	/* But not one by absolute offset. */
+	assert(ref_of(child_named(cu, "count"), DW_AT_type) == int_off);
+	/* The CU's existing children come first, and names resolve. */
+	auto children = cu.children_here();
+	assert(children.first.name_here() && *children.first.name_here() == "int");
+	assert(r.resolution().resolve(cu, "node") == node);
+	/* Every DIE is reachable from the root. */
+	unsigned n = 0;
+	for (iterator_df<> i = r.begin(); i; ++i) ++n;
+	assert(n == r.ndies() + 1);
+	/* Adopted strings are ours. */
+	assert(r.strings().find("node") == r.node(*r.index_of_offset(node.offset_here())).name);
+}
+
+static void replacement()
+{
+	arena_root_die r;
+	auto cu = r.make_new(r.begin(), DW_TAG_compile_unit);
+	dwarfidl::create_dies(cu, string("base_type int [byte_size = 4, encoding = 5];\n"
+		"variable a : int;\n"
+		"subroutine_type [type = int] { formal_parameter : int; };\n"
+		"subroutine_type [type = int] { formal_parameter : int; };\n"
+		"variable b : int;\n"));
+	auto children = cu.children_here();
+	Dwarf_Off int_off = children.first.offset_here();
+	++children.first; ++children.first;
+	auto s1 = children.first;
+	++children.first;
+	auto s2 = children.first;
+	auto b = child_named(cu, "b");
+	Dwarf_Off s1_off = s1.offset_here(), s2_off = s2.offset_here(), b_off = b.offset_here();
+	Dwarf_Off p2_off = s2.children_here().first.offset_here();
+	r.set_ref(b, DW_AT_type, p2_off);
+	Dwarf_Off before = r.ndies();
+
+	std::map<Dwarf_Off, Dwarf_Off> same;
+	same[s2_off] = s1_off;
+	same[p2_off] = s1.children_here().first.offset_here();
+	auto moved = r.replace_dies(same);
+	assert(r.ndies() == before - 2);
+	assert(moved[s2_off] == s1_off && moved[int_off] == int_off);
+	assert(moved[b_off] == b_off - 2);
+	/* References to what was dropped go to what replaced it. */
+	b = child_named(cu, "b");
+	assert(b.offset_here() == b_off - 2);
+	assert(ref_of(b, DW_AT_type) == moved[p2_off]);
+	assert(r.find(ref_of(b, DW_AT_type)).parent().offset_here() == s1_off);
+	assert(ref_of(child_named(cu, "a"), DW_AT_type) == int_off);
+	/* The rest keep their order, all reachable. */
+	unsigned n = 0;
+	for (iterator_df<> i = r.begin(); i; ++i) ++n;
+	assert(n == r.ndies() + 1);
+	children = cu.children_here();
+	for (unsigned i = 0; i < 3; ++i) ++children.first;
+	assert(children.first == b);
+	assert(r.resolution().resolve(cu, "b") == b);
+}
+
+int main(int argc, char **argv)
+{
+	navigation();
+	round_trips();
+	adoption();
+	replacement();
+	cout << "ok" << endl;
+	return 0;
+}
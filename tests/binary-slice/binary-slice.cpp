@@ -0,0 +1,150 @@
+#include <fstream>
+#include <cstring>
+#include <cstddef>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "dwarfidl/lang.hpp"
+#include "dwarfidl/dwarfprint.hpp"
+#include "dwarfidl/binary_slice.hpp"
+#include "dwarfidl/mapped_slice_root.hpp"
+
+using namespace std;
+using namespace dwarf;
+using namespace dwarf::core;
+
+using dwarf::tool::gather_interface_dies;
+
+/* Count the DIEs in a tree, and also record the sequence of their tags,
+ * which should be preserved by a round-trip through the binary format. */
+static unsigned count_dies(iterator_df<> i, ostringstream& tags)
+{
+	unsigned n = 1;
+	tags << i.tag_here() << (i.name_here() ? *i.name_here() : "") << ";";
+	auto children = i.children_here();
+	for (auto i_c = children.first; i_c != children.second; ++i_c)
+	{
+		if (i_c.tag_here() > 0x4000 || i_c.tag_here() == DW_TAG_inlined_subroutine
+			|| i_c.tag_here() == DW_TAG_lexical_block || i_c.tag_here() == DW_TAG_variable)
+		{ continue; }
+		n += count_dies(i_c, tags);
+	}
+	return n;
+}
+
+int main(int argc, char **argv)
+{
+	assert(argc > 1);
+	FILE* f = fopen(argv[1], "r");
+	root_die r(fileno(f));
+
+	set<string> element_names = { "main", "fopen" };
+	set<iterator_base> dies;
+	type_set types;
+	gather_interface_dies(r, dies, types,
+		[element_names](const iterator_base& i) {
+			auto i_pe = i.as_a<program_element_die>();
+			return i_pe && i_pe.name_here() && i_pe.is_a<subprogram_die>()
+				&& element_names.find(*i_pe.name_here()) != element_names.end();
+		});
+	assert(dies.size() > 0);
+
+	char tmpname[] = "/tmp/tmp.XXXXXX";
+	int fd = mkstemp(tmpname);
+	if (fd == -1) exit(42);
+	close(fd);
+	{
+		std::ofstream outf(tmpname, ios::binary);
+		dwarfidl::write_binary_slice(outf, dies, types);
+	}
+
+	/* What we expect: every toplevel DIE's subtree, in set order, minus
+	 * anything already written as part of an earlier subtree. */
+	ostringstream expected_tags;
+	unsigned expected = 0;
+	set<Dwarf_Off> seen;
+	for (auto i_d = dies.begin(); i_d != dies.end(); ++i_d)
+	{
+		iterator_df<> i = *i_d;
+		bool nested = false;
+		for (iterator_df<> p = i.parent(); p; p = p.parent())
+		{ if (seen.find(p.offset_here()) != seen.end()) { nested = true; break; } }
+		if (nested) continue;
+		seen.insert(i.offset_here());
+		expected += count_dies(i, expected_tags);
+	}
+
+	dwarfidl::mapped_binary_slice slice(tmpname);
+	assert(slice.hdr().ndies == expected);
+
+	in_memory_root_die loaded;
+	auto created_cu = loaded.make_new(loaded.begin(), DW_TAG_compile_unit);
+	dwarfidl::load_binary_slice(created_cu, slice);
+
+	ostringstream loaded_tags;
+	unsigned nloaded = 0;
+	auto children = created_cu.children_here();
+	for (auto i_c = children.first; i_c != children.second; ++i_c)
+	{
+		nloaded += count_dies(i_c, loaded_tags);
+	}
+	assert(nloaded == expected);
+	assert(loaded_tags.str() == expected_tags.str());
+
+	/* The same again, but reading straight from the mapping. */
+	dwarfidl::mapped_slice_root_die view(tmpname);
+	ostringstream view_tags;
+	unsigned nviewed = 0;
+	auto grandchildren = view.grandchildren();
+	set<iterator_base> view_dies;
+	for (auto i_g = std::move(grandchildren.first); i_g != grandchildren.second; ++i_g)
+	{
+		nviewed += count_dies(i_g, view_tags);
+		view_dies.insert(i_g);
+	}
+	assert(nviewed == expected);
+	assert(view_tags.str() == expected_tags.str());
+	/* Every reference the view gives out leads to one of its records. */
+	for (auto i = view.begin(); i != view.end(); ++i)
+	{
+		auto attrs = i.copy_attrs();
+		for (auto i_a = attrs.begin(); i_a != attrs.end(); ++i_a)
+		{
+			if (i_a->second.get_form() != encap::attribute_value::REF) continue;
+			assert(view.index_of_offset(i_a->second.get_ref().off));
+		}
+	}
+	/* The printer should work over the view, as over any root. */
+	ostringstream printed;
+	print_dies(printed, view_dies);
+	assert(printed.str().length() > 0);
+
+	/* A record pointing outside the file is caught when it's opened. */
+	string bytes;
+	{
+		std::ifstream inf(tmpname, ios::binary);
+		bytes.assign(std::istreambuf_iterator<char>(inf), std::istreambuf_iterator<char>());
+	}
+	uint32_t bad = slice.hdr().ndies + 1000;
+	memcpy(&bytes[slice.hdr().dies_off + offsetof(dwarfidl::binslice::die_record, first_child)],
+		&bad, sizeof bad);
+	char corrupt_name[] = "/tmp/tmp.XXXXXX";
+	fd = mkstemp(corrupt_name);
+	if (fd == -1) exit(42);
+	close(fd);
+	{
+		std::ofstream outf(corrupt_name, ios::binary);
+		outf.write(bytes.data(), bytes.size());
+	}
+	bool thrown = false;
+	try { dwarfidl::mapped_binary_slice corrupt(corrupt_name); }
+	catch (std::runtime_error& e) { thrown = true; }
+	assert(thrown);
+
+	unlink(corrupt_name);
+	unlink(tmpname);
+	return 0;
+}
@@ -0,0 +1,184 @@
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include <set>
+#include <dwarfpp/lib.hpp>
+#include <dwarfidl/create.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using namespace dwarf;
+using namespace dwarf::core;
+
+static iterator_base type_of(const iterator_base& i)
+{
+	return i.root().find(i.copy_attrs().find(DW_AT_type)->second.get_ref().off);
+}
+
+static iterator_base named(root_die& r, const iterator_base& scope, const string& name)
+{
+	auto children = scope.children_here();
+	for (auto i = children.first; i != children.second; ++i)
+	{
+		if (i.name_here() && *i.name_here() == name) return i;
+	}
+	return r.end();
+}
+
+static const char types_text[] =
+	"base_type int [byte_size = 4, encoding = 5];\n"
+	"base_type long\\ int [byte_size = 8, encoding = 5];\n"
+	"variable a : (pointer_type [byte_size = 8, type = int]);\n";
+
+/* In s1 and s2, t names different types, so the function types that
+ * mention it must not be shared even though their text is the same. */
+static const char more_text[] =
+	"variable b : (pointer_type [type = int, byte_size = 8]);\n"
+	"variable c : (pointer_type [byte_size = 8, type = long\\ int]);\n"
+	"structure_type s1 [byte_size = 8] {\n"
+	"	typedef t : int;\n"
+	"	member f : (pointer_type [byte_size = 8, type = (subroutine_type { formal_parameter : t; })]);\n"
+	"};\n"
+	"structure_type s2 [byte_size = 8] {\n"
+	"	typedef t : long\\ int;\n"
+	"	member f : (pointer_type [byte_size = 8, type = (subroutine_type { formal_parameter : t; })]);\n"
+	"};\n";
+
+static void check(root_die& r, const iterator_base& cu)
+{
+	auto a = named(r, cu, "a"), b = named(r, cu, "b"), c = named(r, cu, "c");
+	assert(a && b && c);
+	/* Made by separate calls, and written differently, but the same. */
+	assert(type_of(a) == type_of(b));
+	assert(type_of(a) != type_of(c));
+	auto f1 = named(r, named(r, cu, "s1"), "f"), f2 = named(r, named(r, cu, "s2"), "f");
+	assert(f1 && f2);
+	assert(type_of(f1) != type_of(f2));
+	assert(type_of(type_of(f1)) != type_of(type_of(f2)));
+}
+
+/* Names used before they are declared, including from one piece of the
+ * concurrent split to another. */
+static const char forward_text[] =
+	"base_type int [byte_size = 4, encoding = 5];\n"
+	"variable v1 : later1;\n"
+	"structure_type s1 [byte_size = 8] {\n"
+	"	member next : (pointer_type [byte_size = 8, type = s4]);\n"
+	"};\n"
+	"variable v2 : (pointer_type [byte_size = 8, type = s3]);\n"
+	"structure_type s2 [byte_size = 4] {\n"
+	"	member n : later2;\n"
+	"};\n"
+	"subprogram f (p : (pointer_type [byte_size = 8, type = s1])) -> later1;\n"
+	"structure_type s3 [byte_size = 8] {\n"
+	"	member back : (pointer_type [byte_size = 8, type = s2]);\n"
+	"};\n"
+	"typedef later2 : int;\n"
+	"structure_type s4 [byte_size = 4] {\n"
+	"	member m : int;\n"
+	"};\n"
+	"typedef later1 : later2;\n";
+
+/* The same inline DIEs in every piece, some naming what comes later. */
+static const char repeated_text[] =
+	"base_type int [byte_size = 4, encoding = 5];\n"
+	"variable p1 : (pointer_type [byte_size = 8, type = int]);\n"
+	"variable q1 : (pointer_type [byte_size = 8, type = (pointer_type [byte_size = 8, type = later])]);\n"
+	"variable p2 : (pointer_type [byte_size = 8, type = int]);\n"
+	"variable q2 : (pointer_type [byte_size = 8, type = (pointer_type [byte_size = 8, type = later])]);\n"
+	"variable p3 : (pointer_type [byte_size = 8, type = int]);\n"
+	"variable q3 : (pointer_type [byte_size = 8, type = (pointer_type [byte_size = 8, type = later])]);\n"
+	"typedef later : int;\n";
+
+/* A DIE, its parent and its attributes, with references described by
+ * the name of what they refer to or, if it has none, its description. */
+static string describe(const iterator_base& i)
+{
+	std::ostringstream s;
+	s << i.tag_here() << " " << (i.name_here() ? *i.name_here() : "") << " in ";
+	auto parent = i.parent();
+	s << ((parent && parent.name_here()) ? *parent.name_here() : "?") << " [";
+	auto attrs = i.copy_attrs();
+	for (auto i_a = attrs.begin(); i_a != attrs.end(); ++i_a)
+	{
+		if (i_a->first == DW_AT_name || i_a->first == DW_AT_sibling) continue;
+		s << i_a->first << "=";
+		if (i_a->second.get_form() == encap::attribute_value::REF)
+		{
+			auto target = i.root().find(i_a->second.get_ref().off);
+			assert(target);
+			if (target.name_here()) s << *target.name_here();
+			else s << "(" << describe(target) << ")";
+		}
+		else s << i_a->second;
+		s << ";";
+	}
+	s << "]";
+	return s.str();
+}
+
+static std::multiset<string> describe_all(root_die& r)
+{
+	std::multiset<string> out;
+	for (iterator_df<> i = r.begin(); i; ++i) if (i.offset_here() != 0) out.insert(describe(i));
+	return out;
+}
+
+int main(int argc, char **argv)
+{
+	/* An arena root keeps what it has shared between calls. */
+	{
+		dwarfidl::arena_root_die r;
+		auto cu = r.make_new(r.begin(), DW_TAG_compile_unit);
+		dwarfidl::create_dies(cu, string(types_text));
+		dwarfidl::create_dies(cu, string(more_text));
+		check(r, cu);
+		assert(r.structure().size() > 0);
+	}
+	/* Other roots find what's in the CU already. */
+	{
+		in_memory_root_die r;
+		auto cu = r.make_new(r.begin(), DW_TAG_compile_unit);
+		dwarfidl::create_dies(cu, string(types_text));
+		dwarfidl::create_dies(cu, string(more_text));
+		check(r, cu);
+	}
+	/* Creating in pieces on several threads gives what creating in one
+	 * go does, whatever order the DIEs end up in. */
+	{
+		dwarfidl::arena_root_die serial, concurrent;
+		auto serial_cu = serial.make_new(serial.begin(), DW_TAG_compile_unit);
+		auto concurrent_cu = concurrent.make_new(concurrent.begin(), DW_TAG_compile_unit);
+		dwarfidl::create_dies(serial_cu, string(forward_text));
+		dwarfidl::create_dies_concurrently(concurrent_cu, string(forward_text), 4);
+		assert(serial.ndies() == concurrent.ndies());
+		/* No staging CU is left behind, reachable or not. */
+		assert(describe_all(concurrent).size() == concurrent.ndies());
+		assert(describe_all(serial) == describe_all(concurrent));
+		auto v1 = named(concurrent, concurrent_cu, "v1");
+		assert(v1 && type_of(v1) == named(concurrent, concurrent_cu, "later1"));
+		auto back = named(concurrent, named(concurrent, concurrent_cu, "s3"), "back");
+		assert(type_of(type_of(back)) == named(concurrent, concurrent_cu, "s2"));
+	}
+	/* Inline DIEs are shared between the pieces too. */
+	{
+		dwarfidl::arena_root_die serial, concurrent;
+		auto serial_cu = serial.make_new(serial.begin(), DW_TAG_compile_unit);
+		auto concurrent_cu = concurrent.make_new(concurrent.begin(), DW_TAG_compile_unit);
+		dwarfidl::create_dies(serial_cu, string(repeated_text));
+		auto first = dwarfidl::create_dies_concurrently(concurrent_cu, string(repeated_text), 4);
+		assert(first && first.name_here() && *first.name_here() == "int");
+		assert(serial.ndies() == concurrent.ndies());
+		assert(describe_all(concurrent).size() == concurrent.ndies());
+		assert(describe_all(serial) == describe_all(concurrent));
+		auto p1 = named(concurrent, concurrent_cu, "p1"), q1 = named(concurrent, concurrent_cu, "q1");
+		assert(type_of(named(concurrent, concurrent_cu, "p2")) == type_of(p1));
+		assert(type_of(named(concurrent, concurrent_cu, "p3")) == type_of(p1));
+		assert(type_of(named(concurrent, concurrent_cu, "q3")) == type_of(q1));
+		assert(type_of(type_of(q1)) != type_of(p1));
+		assert(type_of(type_of(type_of(q1))) == named(concurrent, concurrent_cu, "later"));
+	}
+	cout << "ok" << endl;
+	return 0;
+}
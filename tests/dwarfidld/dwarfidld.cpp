@@ -0,0 +1,152 @@
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using std::cout;
+using std::endl;
+using std::string;
+
+/* Something for SLICE to select, by a plain and a qualified rule. */
+extern "C" int __attribute__((noinline)) dwarfidld_probe(int x) { return x + 1; }
+namespace probe_ns
+{
+	int __attribute__((noinline)) scoped_probe(int x) { return x * 2; }
+}
+
+static void send_all(int fd, const string& s)
+{
+	size_t done = 0;
+	while (done < s.size())
+	{
+		ssize_t n = write(fd, s.data() + done, s.size() - done);
+		assert(n > 0);
+		done += n;
+	}
+}
+
+static string read_line(int fd)
+{
+	string line;
+	char c;
+	while (read(fd, &c, 1) == 1 && c != '\n') line += c;
+	return line;
+}
+
+/* One reply: "OK" and the body, or "ERR" and the message. */
+static std::pair<string, string> reply(int fd)
+{
+	string line = read_line(fd);
+	if (line.compare(0, 4, "ERR ") == 0) return std::make_pair("ERR", line.substr(4));
+	assert(line.compare(0, 3, "OK ") == 0);
+	size_t len = std::stoul(line.substr(3));
+	string body(len, '\0');
+	size_t done = 0;
+	while (done < len)
+	{
+		ssize_t n = read(fd, &body[done], len - done);
+		assert(n > 0);
+		done += n;
+	}
+	return std::make_pair("OK", body);
+}
+
+static string ask(int fd, const string& request)
+{
+	send_all(fd, request + "\n");
+	auto r = reply(fd);
+	assert(r.first == "OK");
+	return r.second;
+}
+
+int main(int argc, char **argv)
+{
+	assert(argc > 1);
+	string binary = argv[1];
+	/* The daemon as built in the tree, unless DWARFIDLD says otherwise. */
+	const char *daemon = getenv("DWARFIDLD");
+	if (!daemon) daemon = "../../examples/dwarfidld";
+	char dir[] = "/tmp/dwarfidld-test.XXXXXX";
+	assert(mkdtemp(dir));
+	string path = string(dir) + "/sock";
+
+	pid_t pid = fork();
+	assert(pid >= 0);
+	if (pid == 0)
+	{
+		execl(daemon, daemon, path.c_str(), (char *) nullptr);
+		_exit(127);
+	}
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	assert(fd >= 0);
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path.c_str());
+	/* Give it a while to start listening. */
+	int tries = 0;
+	while (connect(fd, (struct sockaddr *) &addr, sizeof addr) != 0)
+	{
+		assert(++tries < 200);
+		usleep(50 * 1000);
+	}
+	/* Only we can connect. */
+	struct stat st;
+	assert(stat(path.c_str(), &st) == 0 && (st.st_mode & 0777) == 0600);
+
+	string stats = ask(fd, "STATS");
+	assert(stats[0] == '{' && stats.find("\"requests\": 1,") != string::npos);
+
+	/* A reply is framed by its length, whatever it contains. */
+	string slice = ask(fd, "SLICE " + binary + " dwarfidld_probe");
+	assert(slice.find("dwarfidld_probe") != string::npos);
+	assert(slice.find("scoped_probe") == string::npos);
+	assert(ask(fd, "SLICE " + binary + " dwarfidld_probe") == slice);
+	assert(ask(fd, "STATS").find("\"reply_cache_hits\": 1,") != string::npos);
+	/* Qualified rules look inside namespaces. */
+	assert(ask(fd, "SLICE " + binary + " probe_ns::scoped_probe").find("scoped_probe") != string::npos);
+
+	/* Errors are one line each, and leave the connection usable. */
+	send_all(fd, "BOGUS\n");
+	auto r = reply(fd);
+	assert(r.first == "ERR" && r.second == "unknown request BOGUS");
+	send_all(fd, "SLICE " + string(dir) + "/nonesuch\n");
+	r = reply(fd);
+	assert(r.first == "ERR" && r.second.find("cannot stat") == 0);
+	send_all(fd, "SLICE\n");
+	assert(reply(fd).first == "ERR");
+
+	/* Requests sent together are answered in order. */
+	send_all(fd, "STATS\nSLICE " + binary + " dwarfidld_probe\nSTATS\n");
+	assert(reply(fd).second.find("\"reply_cache_hits\": 1,") != string::npos);
+	assert(reply(fd).second == slice);
+	assert(reply(fd).second.find("\"reply_cache_hits\": 2,") != string::npos);
+
+	/* A second client is served while the first stays connected. */
+	int other = socket(AF_UNIX, SOCK_STREAM, 0);
+	assert(other >= 0 && connect(other, (struct sockaddr *) &addr, sizeof addr) == 0);
+	assert(ask(other, "STATS").find("\"roots_loaded\": 1,") != string::npos);
+	close(other);
+
+	send_all(fd, "QUIT\n");
+	assert(read_line(fd) == "OK 0");
+	int status;
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	assert(access(path.c_str(), F_OK) != 0);
+	close(fd);
+	rmdir(dir);
+
+	/* Keep the probes. */
+	cout << dwarfidld_probe(1) + probe_ns::scoped_probe(1) - 4 << endl;
+	cout << "ok" << endl;
+	return 0;
+}
@@ -1,9 +1,12 @@
 #include <fstream>
+#include <stdexcept>
 #include <string>
 #include <boost/iostreams/filtering_streambuf.hpp>
 
 #include "dwarfidl/lang.hpp"
 #include "dwarfidl/dwarfprint.hpp"
+#include "dwarfidl/dwarf_interface_walk.hpp"
+#include "dwarfidl/selection.hpp"
 
 using namespace std;
 using namespace dwarf;
@@ -17,6 +20,13 @@ typedef ANTLR3_BASE_TREE Tree;
 typedef ANTLR3_COMMON_TREE CommonTree;
 
 using dwarf::tool::gather_interface_dies;
+using dwarf::tool::gather_scoped_interface_dies;
+
+/* Only reachable by its qualified name. */
+namespace dwarfprint_test
+{
+	int probe(int x) { return x + 1; }
+}
 
 /* This struct will get copied, so should not keep state itself. */
 struct counting_filter : boost::iostreams::output_filter
@@ -76,52 +86,21 @@ int main(int argc, char **argv)
 		}
 	} r(fileno(f));
 	
-	/* If the user gives us a list of function names on stdin, we use that. */
-//	using std::cin;
-//	std::istream& in = /* p_in ? *p_in :*/ cin;
-	/* populate the subprogram and types lists. */
-	char buf[4096];
-	set<string> element_names = { "main", "fopen" };
+	/* We select some visible subprograms and variables by name. */
+	dwarfidl::selection sel;
+	sel.add("main");
+	sel.add("fopen");
+	sel.add("tag:subprogram");
+	sel.add("tag:variable");
 	map<string, iterator_base> named_element_dies;
-// 	while (in.getline(buf, sizeof buf - 1))
-// 	{
-// 		/* Find a toplevel grandchild that is a subprogram of this name. */
-// 		element_names.insert(buf);
-// 	}
 
 	set<iterator_base> dies;
 	type_set types;
 	gather_interface_dies(r, dies, types,
-		[element_names, &named_element_dies](const iterator_base& i) {
-		/* This is the basic test for whether an interface element is of 
-		 * interest. For us, it's just whether it's a visible subprogram or variable
-		 * in our list. Or, if our list is empty, it's any subprogram. Variables too!*/
-
-		bool result;
-		auto i_pe = i.as_a<program_element_die>();
-		if (i_pe && i_pe.name_here()
-			&& ((i_pe.is_a<variable_die>() && i_pe.as_a<variable_die>()->has_static_storage())
-				|| i_pe.is_a<subprogram_die>())
-			&& (!i_pe->get_visibility() || *i_pe->get_visibility() == DW_VIS_exported)
-			&& (
-				element_names.size() == 0 
-				|| element_names.find(*i_pe.name_here()) != element_names.end()))
-		{
-			if (element_names.size() == 0)
-			{
-				result = true;
-			}
-			else if (element_names.find(*i_pe.name_here()) != element_names.end())
-			{
-				named_element_dies[*i_pe.name_here()] = i;
-				result = true;
-			} else result = false;
-		} else result = false;;
-
-		// if (i_pe && i_pe.name_here()) {
-		// 	cerr << "Considering " << *(i_pe.name_here()) << " => " << result << endl;
-		// }
-		return result;
+		[&sel, &named_element_dies](const iterator_base& i) {
+		if (!sel(i)) return false;
+		named_element_dies[*i.name_here()] = i;
+		return true;
 	});
 	char tmpname[] = "/tmp/tmp.XXXXXX";
 	int fd = mkstemp(tmpname);
@@ -155,5 +134,43 @@ int main(int argc, char **argv)
 	assert(nlines == counting_outf.newlines_written() - 1);
 	unlink(tmpname);
 
+	/* A qualified rule reaches into namespaces, and gets the qualified
+	 * names from the walk; "probe" alone shouldn't match. */
+	dwarfidl::selection scoped_sel;
+	scoped_sel.add("dwarfprint_test::probe");
+	assert(scoped_sel.has_qualified_rules());
+	set<iterator_base> scoped_dies;
+	type_set scoped_types;
+	gather_scoped_interface_dies(r, scoped_dies, scoped_types, std::cref(scoped_sel), true);
+	iterator_base probe = iterator_base::END;
+	for (auto i_d = scoped_dies.begin(); i_d != scoped_dies.end(); ++i_d)
+	{
+		if (i_d->tag_here() == DW_TAG_subprogram) { assert(!probe); probe = *i_d; }
+	}
+	assert(probe && *probe.name_here() == "probe");
+	assert(!scoped_sel.matches_name("probe"));
+	/* Without the parts, the selection works them out, or asks an index. */
+	assert(scoped_sel(probe));
+	dwarf::tool::scope_index scopes(r);
+	assert(scopes.fq_name_of(probe) == "dwarfprint_test::probe");
+	scoped_sel.use_scope_index(&scopes);
+	assert(scoped_sel(probe));
+	set<iterator_base> toplevel_dies;
+	type_set toplevel_types;
+	gather_scoped_interface_dies(r, toplevel_dies, toplevel_types, std::cref(scoped_sel));
+	assert(toplevel_dies.find(probe) == toplevel_dies.end());
+
+	/* A bad pattern is caught when it is added. */
+	dwarfidl::selection pattern_sel;
+	bool threw = false;
+	try { pattern_sel.add("re:mem(cpy"); } catch (std::invalid_argument&) { threw = true; }
+	assert(threw);
+	/* A backreference means what it says alongside other patterns. */
+	pattern_sel.add("re:(x)y");
+	pattern_sel.add("re:(a)\\1");
+	pattern_sel.add("glob:str*");
+	assert(pattern_sel.matches_name("aa") && pattern_sel.matches_name("xy") && pattern_sel.matches_name("strlen"));
+	assert(!pattern_sel.matches_name("ab") && !pattern_sel.matches_name("xya"));
+
 	return 0;
 }
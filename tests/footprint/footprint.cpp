@@ -0,0 +1,221 @@
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <dwarfpp/lib.hpp>
+#include <dwarfidl/create.hpp>
+#include <dwarfidl/footprint.hpp>
+#include <dwarfidl/footprint_cxx.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using namespace dwarf;
+using namespace dwarf::core;
+using namespace dwarfidl::footprint;
+
+static const char dwarfidl_text[] =
+	"base_type int [byte_size = 4, encoding = 5];\n"
+	"base_type long\\ unsigned\\ int [byte_size = 8, encoding = 7];\n"
+	"structure_type iovec [byte_size = 16] {\n"
+	"	member iov_base : (pointer_type [byte_size = 8]) [data_member_location = { plus_uconst(0); }];\n"
+	"	member iov_len : long\\ unsigned\\ int [data_member_location = { plus_uconst(8); }];\n"
+	"};\n"
+	"footprint_function bytes(p, n) { p{0..n} };\n"
+	"subprogram writev (fd : int, iov : (pointer_type [type = iovec, byte_size = 8]), iovcnt : int) -> int\n"
+	"	[footprint = { r: iov[0..iovcnt]; r: bytes(v.iov_base, v.iov_len) for v in iov[0..iovcnt]; }];\n"
+	"subprogram fill (buf : (pointer_type [type = int, byte_size = 8]), n : int)\n"
+	"	[footprint = { w: buf[i] for i in n; r: buf{4*i..4*i+8} for i in n; }];\n"
+	"subprogram first (iov : (pointer_type [type = iovec, byte_size = 8]))\n"
+	"	[footprint = { r: bytes(iov, if iov != 0 then iov.iov_len else 0); }];\n"
+	"subprogram prefix (iov : (pointer_type [type = iovec, byte_size = 8]), n : int)\n"
+	"	[footprint = { r: iov.iov_base{i..i+1} for i in n; }];\n";
+
+/* Memory that reads the same in any process: each byte is a function of
+ * its address, and the low pages aren't there. The generated checker gets
+ * a copy of this text. */
+#define FAKE_MEMORY \
+	"static bool fake_read(void *ctx, uint64_t addr, void *buf, size_t len)\n" \
+	"{\n" \
+	"	if (addr < 4096) return false;\n" \
+	"	for (size_t k = 0; k < len; ++k) ((unsigned char *) buf)[k] = (addr + k) * 37 + 11;\n" \
+	"	return true;\n" \
+	"}\n"
+static bool fake_read(void *ctx, uint64_t addr, void *buf, size_t len)
+{
+	if (addr < 4096) return false;
+	for (size_t k = 0; k < len; ++k) ((unsigned char *) buf)[k] = (addr + k) * 37 + 11;
+	return true;
+}
+
+/* Our "traced process" is ourselves. */
+static bool read_self(void *ctx, uint64_t addr, void *buf, size_t len)
+{
+	memcpy(buf, reinterpret_cast<void *>(addr), len);
+	return true;
+}
+
+/* The same, but like a real tracee, the zero page isn't there. */
+static bool read_mapped(void *ctx, uint64_t addr, void *buf, size_t len)
+{
+	if (addr < 4096) return false;
+	return read_self(ctx, addr, buf, len);
+}
+
+int main(int argc, char **argv)
+{
+	auto str = antlr3StringStreamNew(
+		const_cast<unsigned char *>(reinterpret_cast<const unsigned char *>(dwarfidl_text)),
+		ANTLR3_ENC_8BIT, strlen(dwarfidl_text),
+		const_cast<unsigned char *>(reinterpret_cast<const unsigned char *>("footprint")));
+	assert(str);
+	auto lexer = dwarfidlNewCLexerNew(str);
+	auto tokenStream = antlr3CommonTokenStreamSourceNew(ANTLR3_SIZE_HINT, TOKENSOURCE(lexer));
+	auto parser = dwarfidlNewCParserNew(tokenStream);
+	antlr::tree::Tree *tree = parser->toplevel(parser).tree;
+
+	in_memory_root_die r;
+	auto cu = r.make_new(r.begin(), DW_TAG_compile_unit);
+	dwarfidl::create_dies(cu, tree);
+
+	compiler c;
+	auto programs = c.compile_all(tree, cu);
+	assert(programs.size() == 4);
+	const program& p = programs["writev"];
+	cout << p;
+	assert(p.arg_names.size() == 3);
+
+	char a[3], b[5];
+	struct iovec iov[16] = { { a, sizeof a }, { b, sizeof b } };
+	uint64_t args[] = { 1, reinterpret_cast<uint64_t>(&iov[0]), 2 };
+	std::vector<access> out;
+	status s = evaluate(p, args, read_self, nullptr, out);
+	cout << "Status: " << status_name(s) << endl;
+	assert(s == OK);
+	assert(out.size() == 3);
+	assert(out[0].base == args[1] && out[0].length == 2 * sizeof (struct iovec) && out[0].dir == READ);
+	assert(out[1].base == reinterpret_cast<uint64_t>(a) && out[1].length == sizeof a);
+	assert(out[2].base == reinterpret_cast<uint64_t>(b) && out[2].length == sizeof b);
+
+	/* A garbage count makes a loop that the step limit cuts off
+	 * (before it runs off the end of iov). */
+	args[2] = 1000;
+	out.clear();
+	s = evaluate(p, args, read_self, nullptr, out, 10);
+	assert(s == STEP_LIMIT_EXCEEDED);
+
+	/* Loops over a contiguous range don't iterate, so size doesn't matter;
+	 * the two clauses' ranges overlap, and come out coalesced. */
+	const program& fill = programs["fill"];
+	cout << fill;
+	uint64_t fill_args[] = { 0x10000, 1u << 30 };
+	footprint_set fs;
+	s = evaluate(fill, fill_args, read_self, nullptr, fs, 10);
+	assert(s == OK);
+	assert(fs.iterative_size() == 2);
+	auto i_fs = fs.begin();
+	assert(i_fs->first.lower() == 0x10000 && i_fs->first.upper() == 0x10000 + 4 * (1ul << 30)
+		&& i_fs->second == READ_WRITE);
+	++i_fs;
+	assert(i_fs->first.lower() == 0x10000 + 4 * (1ul << 30) && i_fs->first.upper() == i_fs->first.lower() + 4
+		&& i_fs->second == READ);
+
+	/* Only the arm taken is evaluated, so a null pointer is never read. */
+	const program& first = programs["first"];
+	cout << first;
+	uint64_t first_args[] = { 0 };
+	out.clear();
+	s = evaluate(first, first_args, read_mapped, nullptr, out);
+	assert(s == OK);
+	first_args[0] = reinterpret_cast<uint64_t>(&iov[0]);
+	out.clear();
+	s = evaluate(first, first_args, read_mapped, nullptr, out);
+	assert(s == OK && out.size() == 1 && out[0].base == reinterpret_cast<uint64_t>(&iov[0])
+		&& out[0].length == sizeof a);
+
+	/* A loop that doesn't run reads nothing, even what doesn't vary. */
+	const program& prefix = programs["prefix"];
+	cout << prefix;
+	uint64_t prefix_args[] = { 0, 0 };
+	out.clear();
+	s = evaluate(prefix, prefix_args, read_mapped, nullptr, out);
+	assert(s == OK && out.empty());
+	prefix_args[0] = reinterpret_cast<uint64_t>(&iov[0]);
+	prefix_args[1] = 2;
+	out.clear();
+	s = evaluate(prefix, prefix_args, read_mapped, nullptr, out);
+	assert(s == OK && out.size() == 1 && out[0].base == reinterpret_cast<uint64_t>(a) && out[0].length == 2);
+
+	/* A batch gives the same answers as one call per tuple. */
+	const size_t ntuples = 1000;
+	std::vector<uint64_t> bufs(ntuples), counts(ntuples);
+	for (size_t k = 0; k < ntuples; ++k) { bufs[k] = 0x1000 * k; counts[k] = k % 17; }
+	const uint64_t *columns[] = { bufs.data(), counts.data() };
+	std::vector<footprint_set> batch;
+	std::vector<status> statuses;
+	evaluate_batch(fill, columns, ntuples, read_self, nullptr, batch, statuses, 4);
+	for (size_t k = 0; k < ntuples; ++k)
+	{
+		uint64_t one_args[] = { bufs[k], counts[k] };
+		footprint_set one;
+		assert(evaluate(fill, one_args, read_self, nullptr, one) == statuses[k]);
+		assert(one == batch[k]);
+	}
+
+	/* The generated C++ agrees with evaluate() on the same inputs. */
+	struct arg_tuple { const char *name; uint64_t args[3]; };
+	const arg_tuple tuples[] = {
+		{ "writev", { 1, 0x10000, 0 } }, { "writev", { 1, 0x10000, 3 } }, { "writev", { 1, 0, 2 } },
+		{ "fill", { 0x20000, 0 } }, { "fill", { 0x20000, 5 } },
+		{ "first", { 0 } }, { "first", { 0x30000 } },
+		{ "prefix", { 0, 0 } }, { "prefix", { 0x40000, 3 } }, { "prefix", { 0, 2 } }
+	};
+	std::ostringstream expected;
+	for (auto& t : tuples)
+	{
+		std::vector<access> accesses;
+		status st = evaluate(programs[t.name], t.args, fake_read, nullptr, accesses);
+		expected << t.name << " " << (int) st << endl;
+		for (auto& a : accesses) expected << a.base << " " << a.length << " " << (int) a.dir << endl;
+	}
+
+	char src_name[] = "/tmp/footprint-cxx.XXXXXX";
+	int fd = mkstemp(src_name);
+	if (fd == -1) exit(42);
+	close(fd);
+	string src = string(src_name) + ".cpp", exe = string(src_name) + ".exe", got_name = string(src_name) + ".out";
+	{
+		std::ofstream out(src);
+		write_cxx(out, programs);
+		out << "#include <iostream>" << endl << "#include <sstream>" << endl << FAKE_MEMORY << endl
+			<< "int main()" << endl << "{" << endl
+			<< "\tstd::ostringstream accesses;" << endl
+			<< "\tauto read = [](uint64_t addr, void *buf, size_t len) { return fake_read(nullptr, addr, buf, len); };" << endl
+			<< "\tauto sink = [&accesses](uint64_t base, uint64_t length, int dir) {" << endl
+			<< "\t\taccesses << base << \" \" << length << \" \" << dir << std::endl; };" << endl;
+		for (auto& t : tuples)
+		{
+			out << "\t{ const uint64_t args[] = { " << t.args[0] << "u, " << t.args[1] << "u, " << t.args[2] << "u }; "
+				<< "accesses.str(\"\"); int st = footprint_" << t.name << "(args, read, sink); "
+				<< "std::cout << \"" << t.name << " \" << st << std::endl << accesses.str(); }" << endl;
+		}
+		out << "\treturn 0;" << endl << "}" << endl;
+	}
+	const char *cxx = getenv("CXX");
+	string cmd = string(cxx ? cxx : "c++") + " -std=c++11 -o " + exe + " " + src;
+	assert(system(cmd.c_str()) == 0);
+	assert(system((exe + " > " + got_name).c_str()) == 0);
+	std::ifstream got_in(got_name);
+	std::ostringstream got;
+	got << got_in.rdbuf();
+	unlink(src_name); unlink(src.c_str()); unlink(exe.c_str()); unlink(got_name.c_str());
+	cout << got.str();
+	assert(got.str() == expected.str());
+
+	return 0;
+}
@@ -0,0 +1,123 @@
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <dwarfpp/lib.hpp>
+#include <dwarfidl/create.hpp>
+#include <dwarfidl/merge.hpp>
+#include <dwarfidl/arena_root.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using namespace dwarf;
+using namespace dwarf::core;
+
+static const char base_text[] =
+	"base_type int [byte_size = 4, encoding = 5];\n"
+	"structure_type point [byte_size = 8] {\n"
+	"	member x : int [data_member_location = { plus_uconst(0); }];\n"
+	"	member y : int [data_member_location = { plus_uconst(4); }];\n"
+	"};\n";
+
+/* point gets a declaration flag, a member and a different size; line is new. */
+static const char overlay_text[] =
+	"structure_type point [byte_size = 12, declaration = false] {\n"
+	"	member z : int [data_member_location = { plus_uconst(8); }];\n"
+	"};\n"
+	"structure_type line [byte_size = 16] {\n"
+	"	member from : point [data_member_location = { plus_uconst(0); }];\n"
+	"};\n";
+
+/* Something to merge into as read from our own debugging information. */
+struct merge_probe { int a; int b; };
+merge_probe probe;
+
+static const char probe_overlay[] =
+	"structure_type merge_probe {\n"
+	"	member c : int [data_member_location = { plus_uconst(8); }];\n"
+	"};\n";
+
+/* DIEs read from the file are copied into memory before being merged into. */
+static void merge_into_file(const char *path)
+{
+	using dwarfidl::merge_index;
+	FILE *f = fopen(path, "r");
+	assert(f);
+	{
+		in_memory_root_die r(fileno(f));
+		merge_index index(r);
+		auto found = index.toplevel(merge_index::key(DW_TAG_structure_type, "merge_probe"));
+		assert(found.size() == 1);
+		Dwarf_Off original = found[0].offset_here();
+		auto report = dwarfidl::merge_dwarfidl(index, probe_overlay);
+		for (auto i_c = report.conflicts.begin(); i_c != report.conflicts.end(); ++i_c) cout << *i_c << endl;
+		assert(report.conflicts.empty());
+		assert(report.dies_matched == 1 && report.dies_added == 1 && report.dies_copied == 3);
+		auto copy = index.toplevel(merge_index::key(DW_TAG_structure_type, "merge_probe"));
+		assert(copy.size() == 1 && copy[0].offset_here() != original);
+		assert(index.children(copy[0], merge_index::key(DW_TAG_member, "a")).size() == 1);
+		auto c = index.children(copy[0], merge_index::key(DW_TAG_member, "c"));
+		assert(c.size() == 1 && c[0].parent() == copy[0]);
+		/* The file's own is as it was. */
+		unsigned n = 0;
+		auto children = r.find(original).children_here();
+		for (auto i = children.first; i != children.second; ++i) ++n;
+		assert(n == 2);
+		/* The copy can be written in place from now on. */
+		report = dwarfidl::merge_dwarfidl(index, probe_overlay);
+		assert(report.dies_copied == 0 && report.dies_added == 0 && report.conflicts.empty());
+	}
+	fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+	in_memory_root_die r;
+	auto cu = r.make_new(r.begin(), DW_TAG_compile_unit);
+	dwarfidl::create_dies(cu, string(base_text));
+
+	dwarfidl::merge_index index(r);
+	auto report = dwarfidl::merge_dwarfidl(index, overlay_text, /* override_existing */ false);
+	for (auto i_c = report.conflicts.begin(); i_c != report.conflicts.end(); ++i_c) cout << *i_c << endl;
+	assert(report.dies_matched == 1);
+	assert(report.dies_added == 3);
+	assert(report.conflicts.size() == 1);
+	assert(report.conflicts[0].attr == DW_AT_byte_size && !report.conflicts[0].overridden);
+
+	auto point = index.toplevel(dwarfidl::merge_index::key(DW_TAG_structure_type, "point"));
+	assert(point.size() == 1);
+	assert(point[0].copy_attrs().find(DW_AT_byte_size)->second.get_unsigned() == 8);
+	auto z = index.children(point[0], dwarfidl::merge_index::key(DW_TAG_member, "z"));
+	assert(z.size() == 1);
+	/* line.from refers to the existing point, not a copy. */
+	auto line = index.toplevel(dwarfidl::merge_index::key(DW_TAG_structure_type, "line"));
+	assert(line.size() == 1);
+	auto from = index.children(line[0], dwarfidl::merge_index::key(DW_TAG_member, "from"));
+	assert(from.size() == 1 && from[0].copy_attrs().find(DW_AT_type)->second.get_ref().off
+		== point[0].offset_here());
+
+	/* Merging again finds everything there already, bar the size. */
+	report = dwarfidl::merge_dwarfidl(index, overlay_text);
+	assert(report.dies_added == 0 && report.attrs_added == 0);
+	assert(report.attrs_overridden == 1);
+	assert(point[0].copy_attrs().find(DW_AT_byte_size)->second.get_unsigned() == 12);
+
+	/* An arena root's own resolution index learns of what is added. */
+	{
+		dwarfidl::arena_root_die a;
+		auto a_cu = a.make_new(a.begin(), DW_TAG_compile_unit);
+		dwarfidl::create_dies(a_cu, string(base_text));
+		dwarfidl::merge_index a_index(a);
+		assert(&a_index.resolution() == &a.resolution());
+		/* Have the index look in the additions CU while it's empty. */
+		auto additions = a_index.additions_cu();
+		assert(a.resolution().resolve(additions, "point"));
+		report = dwarfidl::merge_dwarfidl(a_index, overlay_text);
+		auto a_line = a_index.toplevel(dwarfidl::merge_index::key(DW_TAG_structure_type, "line"));
+		assert(a_line.size() == 1);
+		assert(a.resolution().resolve(additions, "line") == a_line[0]);
+	}
+
+	merge_into_file(argv[0]);
+	return 0;
+}